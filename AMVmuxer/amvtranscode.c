@@ -0,0 +1,635 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "avformat.h"
+#include "swscale.h"
+#include "fifo.h"
+
+/*
+  Fast AMV transcoder.
+
+  Converts any input readable by libavformat (or raw yuv420p video) into
+  AMV without the generic ffmpeg.c loop. Stages run in separate threads
+  connected by bounded queues:
+
+  decode   demuxes and decodes input, resamples audio
+     |
+  scale    converts decoded frames to AMV size and frame rate
+     |     (frames are dropped or duplicated like ffmpeg.c does)
+  encode   encodes AMV video frames
+     |
+  mux      (main thread) encodes audio and writes audio and video packets
+           into AMV file (the muxer sets the size of each audio chunk as
+           the previous one is written, AMV audio chunks are tiny)
+
+  usage: amvtranscode [options] input output.amv
+  output - writes AMV to stdout, its header is made for the duration of input
+  -s WxH        AMV frame size (default 160x120)
+  -r fps        AMV frame rate (default 16)
+  -ar rate      audio sample rate (default 22050)
+  -yuv WxH:fps  input is raw yuv420p video of given size and frame rate
+  -queue n      number of frames queued between stages (default 8)
+  -threads n    encode n video frames in parallel (default 1)
+
+  Output is the same as of
+  ffmpeg -i input -f amv -r 16 -s 160x120 -ac 1 -ar 22050 output.amv
+*/
+
+#define VIDEO_BUFFER_SIZE(w, h) ((w) * (h) * 4 + 10000)
+#define AUDIO_BUFFER_SIZE 192000
+#define RAW_AUDIO -1 ///< stream_index of resampled audio passed from decode to mux stage
+
+/** bounded queue between two stages */
+typedef struct {
+    void **items;
+    int size, head, count;
+    int producers;          ///< number of producers which did not finish yet
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+} Queue;
+
+/** picture passed between decode, scale and encode stages */
+typedef struct {
+    AVPicture pict;
+    int64_t pts;            ///< AV_TIME_BASE units after decode, frame number after scale
+} Frame;
+
+typedef struct {
+    AVFormatContext *ic, *oc;
+    int video_index, audio_index;
+    AVCodecContext *vdec, *adec, *venc, *aenc;
+    ReSampleContext *resample;
+    AVFifoBuffer audio_fifo;
+    int width, height;
+    AVRational frame_rate;
+
+    Queue decoded, scaled, packets;
+    int64_t video_frames, audio_frames;
+} Transcoder;
+
+static void queue_init(Queue *q, int size, int producers)
+{
+    q->items = av_mallocz(size * sizeof(void*));
+    q->size = size;
+    q->head = q->count = 0;
+    q->producers = producers;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+}
+
+static void queue_put(Queue *q, void *item)
+{
+    pthread_mutex_lock(&q->lock);
+    while(q->count == q->size)
+        pthread_cond_wait(&q->not_full, &q->lock);
+    q->items[(q->head + q->count++) % q->size] = item;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * \return next item, NULL when all producers finished and queue is empty
+ */
+static void *queue_get(Queue *q)
+{
+    void *item = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    while(!q->count && q->producers)
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    if(q->count) {
+        item = q->items[q->head];
+        q->head = (q->head + 1) % q->size;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return item;
+}
+
+static void queue_finish(Queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->producers--;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void queue_free(Queue *q)
+{
+    av_free(q->items);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+}
+
+static Frame *frame_alloc(int pix_fmt, int width, int height)
+{
+    Frame *f = av_mallocz(sizeof(Frame));
+
+    if(avpicture_alloc(&f->pict, pix_fmt, width, height) < 0) {
+        fprintf(stderr, "Cannot allocate picture\n");
+        exit(1);
+    }
+    return f;
+}
+
+static void frame_free(Frame *f)
+{
+    avpicture_free(&f->pict);
+    av_free(f);
+}
+
+/**
+ * Sets up packet of encoded data, packet owns buf. Data starts after
+ * PKT_HEADROOM bytes, where the muxer writes the chunk header.
+ */
+static void init_packet(Transcoder *t, AVPacket *pkt, AVCodecContext *enc, int stream_index, uint8_t *buf, int size)
+{
+    av_init_packet(pkt);
+    pkt->stream_index = stream_index;
+    pkt->data = buf + PKT_HEADROOM;
+    pkt->size = size;
+    pkt->destruct = av_destruct_packet_headroom;
+    if(enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
+        pkt->pts = av_rescale_q(enc->coded_frame->pts, enc->time_base,
+                                t->oc->streams[stream_index]->time_base);
+    if(enc->codec_type == CODEC_TYPE_AUDIO || (enc->coded_frame && enc->coded_frame->key_frame))
+        pkt->flags |= PKT_FLAG_KEY;
+    pkt->flags |= PKT_FLAG_HEADROOM;
+}
+
+/**
+ * Passes packet to mux stage, packet data is owned by muxer from now on.
+ */
+static void send_packet(Transcoder *t, AVCodecContext *enc, int stream_index, uint8_t *buf, int size)
+{
+    AVPacket *pkt = av_malloc(sizeof(AVPacket));
+
+    init_packet(t, pkt, enc, stream_index, buf, size);
+    queue_put(&t->packets, pkt);
+}
+
+/**
+ * Encodes all whole audio chunks in fifo and writes them, runs in mux stage.
+ * The muxer sets frame_size of the encoder to the size of the next chunk
+ * when a chunk is written.
+ * \param flush encode rest of fifo as last (shorter) frame, if encoder
+ *              supports it (rest is dropped otherwise, as ffmpeg does)
+ * \return <0 on write error
+ */
+static int encode_audio(Transcoder *t, int flush)
+{
+    AVCodecContext *enc = t->aenc;
+    static int16_t samples[AUDIO_BUFFER_SIZE / 2];
+    AVPacket pkt;
+    uint8_t *buf;
+    int size, frame_bytes, ret;
+
+    if(!(enc->codec->capabilities & CODEC_CAP_SMALL_LAST_FRAME))
+        flush = 0;
+    while(av_fifo_size(&t->audio_fifo) >= (frame_bytes = enc->frame_size * 2 * enc->channels) ||
+          (flush && av_fifo_size(&t->audio_fifo) > 0)) {
+        int fs_tmp = enc->frame_size;
+
+        if(av_fifo_size(&t->audio_fifo) < frame_bytes) {
+            frame_bytes = av_fifo_size(&t->audio_fifo);
+            enc->frame_size = frame_bytes / (2 * enc->channels);
+        }
+        av_fifo_read(&t->audio_fifo, (uint8_t*)samples, frame_bytes);
+
+        buf = av_malloc(AUDIO_BUFFER_SIZE);
+        size = avcodec_encode_audio(enc, buf + PKT_HEADROOM, AUDIO_BUFFER_SIZE - PKT_HEADROOM, samples);
+        enc->frame_size = fs_tmp;
+        if(size > 0) {
+            init_packet(t, &pkt, enc, 1, buf, size);
+            ret = av_interleaved_write_frame(t->oc, &pkt);
+            av_free_packet(&pkt);
+            if(ret < 0)
+                return ret;
+            t->audio_frames++;
+        } else
+            av_free(buf);
+    }
+    return 0;
+}
+
+/**
+ * Passes resampled audio to mux stage.
+ */
+static void send_audio(Transcoder *t, int16_t *samples, int size)
+{
+    AVPacket *pkt = av_malloc(sizeof(AVPacket));
+
+    av_new_packet(pkt, size);
+    memcpy(pkt->data, samples, size);
+    pkt->stream_index = RAW_AUDIO;
+    queue_put(&t->packets, pkt);
+}
+
+static void decode_audio(Transcoder *t, AVPacket *pkt)
+{
+    static int16_t samples[AVCODEC_MAX_AUDIO_FRAME_SIZE / 2];
+    static int16_t resampled[AVCODEC_MAX_AUDIO_FRAME_SIZE * 4];
+    uint8_t *ptr = pkt->data;
+    int len = pkt->size, ret, size;
+
+    while(len > 0) {
+        size = sizeof(samples);
+        ret = avcodec_decode_audio2(t->adec, samples, &size, ptr, len);
+        if(ret < 0)
+            break;
+        ptr += ret;
+        len -= ret;
+        if(size <= 0)
+            continue;
+
+        if(t->resample) {
+            size = audio_resample(t->resample, resampled, samples,
+                                  size / (2 * t->adec->channels));
+            send_audio(t, resampled, size * 2 * t->aenc->channels);
+        } else
+            send_audio(t, samples, size);
+    }
+}
+
+static void *decode_thread(void *arg)
+{
+    Transcoder *t = arg;
+    AVStream *st = t->ic->streams[t->video_index];
+    int64_t start = t->ic->start_time != AV_NOPTS_VALUE ? t->ic->start_time : 0;
+    int64_t next_pts = 0;
+    AVFrame picture;
+    AVPacket pkt;
+    Frame *f;
+    int got_picture;
+
+    while(av_read_frame(t->ic, &pkt) >= 0) {
+        if(pkt.stream_index == t->video_index) {
+            if(pkt.dts != AV_NOPTS_VALUE)
+                next_pts = av_rescale_q(pkt.dts, st->time_base, AV_TIME_BASE_Q) - start;
+
+            avcodec_get_frame_defaults(&picture);
+            avcodec_decode_video(t->vdec, &picture, &got_picture, pkt.data, pkt.size);
+            if(got_picture) {
+                f = frame_alloc(t->vdec->pix_fmt, t->vdec->width, t->vdec->height);
+                av_picture_copy(&f->pict, (AVPicture*)&picture, t->vdec->pix_fmt,
+                                t->vdec->width, t->vdec->height);
+                f->pts = next_pts;
+                queue_put(&t->decoded, f);
+                next_pts += av_rescale(AV_TIME_BASE, st->r_frame_rate.den, st->r_frame_rate.num);
+            }
+        } else if(pkt.stream_index == t->audio_index && t->aenc)
+            decode_audio(t, &pkt);
+        av_free_packet(&pkt);
+    }
+
+    queue_finish(&t->decoded);
+    queue_finish(&t->packets);
+    return NULL;
+}
+
+static void *scale_thread(void *arg)
+{
+    Transcoder *t = arg;
+    struct SwsContext *sws = NULL;
+    const int pix_fmt = t->venc->pix_fmt;
+    int64_t next_frame = 0;
+    Frame *in, *out;
+    double delta;
+    int nb_frames, i;
+
+    while((in = queue_get(&t->decoded))) {
+        // same frame dropping / duplication as ffmpeg.c (video_sync_method 1)
+        delta = in->pts * av_q2d(t->frame_rate) / AV_TIME_BASE - next_frame;
+        nb_frames = 1;
+        if(delta < -1.1)
+            nb_frames = 0;
+        else if(delta > 1.1)
+            nb_frames = lrintf(delta);
+
+        if(nb_frames) {
+            if(!sws)
+                sws = sws_getContext(t->vdec->width, t->vdec->height, t->vdec->pix_fmt,
+                                     t->width, t->height, pix_fmt, SWS_BICUBIC, NULL, NULL, NULL);
+            out = frame_alloc(pix_fmt, t->width, t->height);
+            sws_scale(sws, in->pict.data, in->pict.linesize, 0, t->vdec->height,
+                      out->pict.data, out->pict.linesize);
+
+            for(i = 1; i < nb_frames; i++) {
+                Frame *dup = frame_alloc(pix_fmt, t->width, t->height);
+                av_picture_copy(&dup->pict, &out->pict, pix_fmt, t->width, t->height);
+                dup->pts = next_frame++;
+                queue_put(&t->scaled, dup);
+            }
+            out->pts = next_frame++;
+            queue_put(&t->scaled, out);
+        }
+        frame_free(in);
+    }
+
+    if(sws)
+        sws_freeContext(sws);
+    queue_finish(&t->scaled);
+    return NULL;
+}
+
+/**
+ * Encodes picture (NULL flushes the encoder) and passes the packet, if any,
+ * to mux stage.
+ * \return size of the packet
+ */
+static int encode_video(Transcoder *t, AVFrame *picture)
+{
+    const int buf_size = VIDEO_BUFFER_SIZE(t->width, t->height);
+    uint8_t *buf = av_malloc(buf_size);
+    int size;
+
+    // encoder writes straight into packet buffer which is passed to muxer,
+    // which writes it to the output together with the chunk header
+    size = avcodec_encode_video(t->venc, buf + PKT_HEADROOM, buf_size - PKT_HEADROOM, picture);
+    if(size > 0) {
+        send_packet(t, t->venc, 0, buf, size);
+        t->video_frames++;
+    } else
+        av_free(buf);
+    return size;
+}
+
+static void *encode_thread(void *arg)
+{
+    Transcoder *t = arg;
+    AVFrame picture;
+    Frame *f;
+    int i;
+
+    while((f = queue_get(&t->scaled))) {
+        avcodec_get_frame_defaults(&picture);
+        for(i = 0; i < 4; i++) {
+            picture.data[i]     = f->pict.data[i];
+            picture.linesize[i] = f->pict.linesize[i];
+        }
+        picture.pts = f->pts;
+        encode_video(t, &picture);
+        frame_free(f);
+    }
+    // frame threads of the encoder still hold the last frames
+    if(t->venc->codec->capabilities & CODEC_CAP_DELAY)
+        while(encode_video(t, NULL) > 0);
+
+    queue_finish(&t->packets);
+    return NULL;
+}
+
+static int open_input(Transcoder *t, const char *filename, const char *yuv)
+{
+    AVFormatParameters params, *ap = NULL;
+    AVInputFormat *fmt = NULL;
+    AVCodec *codec;
+    int i, w, h, fps;
+
+    if(yuv) {
+        if(sscanf(yuv, "%dx%d:%d", &w, &h, &fps) != 3) {
+            fprintf(stderr, "Invalid raw video parameters '%s'\n", yuv);
+            return -1;
+        }
+        memset(&params, 0, sizeof(params));
+        params.width = w;
+        params.height = h;
+        params.pix_fmt = PIX_FMT_YUV420P;
+        params.time_base = (AVRational){1, fps};
+        ap = &params;
+        fmt = av_find_input_format("rawvideo");
+    }
+    if(av_open_input_file(&t->ic, filename, fmt, 0, ap) < 0) {
+        fprintf(stderr, "%s: could not open\n", filename);
+        return -1;
+    }
+    if(av_find_stream_info(t->ic) < 0) {
+        fprintf(stderr, "%s: could not find codec parameters\n", filename);
+        return -1;
+    }
+
+    t->video_index = t->audio_index = -1;
+    for(i = 0; i < t->ic->nb_streams; i++) {
+        AVCodecContext *dec = t->ic->streams[i]->codec;
+
+        if(dec->codec_type == CODEC_TYPE_VIDEO && t->video_index < 0)
+            t->video_index = i;
+        else if(dec->codec_type == CODEC_TYPE_AUDIO && t->audio_index < 0)
+            t->audio_index = i;
+        else
+            t->ic->streams[i]->discard = AVDISCARD_ALL;
+    }
+    if(t->video_index < 0) {
+        fprintf(stderr, "%s: no video stream\n", filename);
+        return -1;
+    }
+
+    t->vdec = t->ic->streams[t->video_index]->codec;
+    if(!(codec = avcodec_find_decoder(t->vdec->codec_id)) || avcodec_open(t->vdec, codec) < 0) {
+        fprintf(stderr, "Unsupported video codec\n");
+        return -1;
+    }
+    if(t->audio_index >= 0) {
+        t->adec = t->ic->streams[t->audio_index]->codec;
+        if(!(codec = avcodec_find_decoder(t->adec->codec_id)) || avcodec_open(t->adec, codec) < 0) {
+            fprintf(stderr, "Unsupported audio codec, audio is skipped\n");
+            t->ic->streams[t->audio_index]->discard = AVDISCARD_ALL;
+            t->adec = NULL;
+            t->audio_index = -1;
+        }
+    }
+    return 0;
+}
+
+static int open_output(Transcoder *t, const char *filename, int sample_rate, int threads)
+{
+    AVOutputFormat *fmt = guess_format("amv", NULL, NULL);
+    AVCodec *codec;
+    AVStream *st, *ist = t->ic->streams[t->video_index];
+
+    if(!fmt) {
+        fprintf(stderr, "AMV muxer is not compiled in\n");
+        return -1;
+    }
+    t->oc = av_alloc_format_context();
+    t->oc->oformat = fmt;
+    if(!strcmp(filename, "-"))
+        filename = "pipe:";
+    snprintf(t->oc->filename, sizeof(t->oc->filename), "%s", filename);
+    // frame count in header of streamed output, from the video stream as
+    // the container duration is that of its longest stream
+    if(ist->duration != AV_NOPTS_VALUE)
+        t->oc->duration = av_rescale_q(ist->duration, ist->time_base, AV_TIME_BASE_Q);
+    else if(t->ic->duration != AV_NOPTS_VALUE)
+        t->oc->duration = t->ic->duration;
+
+    st = av_new_stream(t->oc, 0);
+    t->venc = st->codec;
+    t->venc->codec_id = fmt->video_codec;
+    t->venc->codec_type = CODEC_TYPE_VIDEO;
+    t->venc->width = t->width;
+    t->venc->height = t->height;
+    t->venc->time_base = (AVRational){t->frame_rate.den, t->frame_rate.num};
+    t->venc->bit_rate = 200000; // defaults of ffmpeg, for same header
+    if(threads > 1) {
+        // whole frames in parallel, each one is too small to split into slices
+        t->venc->thread_count = threads;
+        t->venc->flags2 |= CODEC_FLAG2_FRAME_THREADS;
+    }
+    codec = avcodec_find_encoder(t->venc->codec_id);
+    if(!codec) {
+        fprintf(stderr, "AMV encoder is not compiled in\n");
+        return -1;
+    }
+    t->venc->pix_fmt = codec->pix_fmts ? codec->pix_fmts[0] : PIX_FMT_YUV420P;
+
+    if(t->adec) {
+        st = av_new_stream(t->oc, 1);
+        t->aenc = st->codec;
+        t->aenc->codec_id = fmt->audio_codec;
+        t->aenc->codec_type = CODEC_TYPE_AUDIO;
+        t->aenc->sample_rate = sample_rate;
+        t->aenc->channels = 1;
+        t->aenc->bit_rate = 64000;
+    }
+
+    if(av_set_parameters(t->oc, NULL) < 0)
+        return -1;
+
+    if(avcodec_open(t->venc, codec) < 0) {
+        fprintf(stderr, "Could not open video encoder\n");
+        return -1;
+    }
+    if(t->aenc) {
+        if(!(codec = avcodec_find_encoder(t->aenc->codec_id)) || avcodec_open(t->aenc, codec) < 0) {
+            fprintf(stderr, "Could not open audio encoder\n");
+            return -1;
+        }
+        if(t->adec->channels != t->aenc->channels || t->adec->sample_rate != t->aenc->sample_rate)
+            t->resample = audio_resample_init(t->aenc->channels, t->adec->channels,
+                                              t->aenc->sample_rate, t->adec->sample_rate);
+        av_fifo_init(&t->audio_fifo, 2 * AVCODEC_MAX_AUDIO_FRAME_SIZE);
+    }
+
+    if(url_fopen(&t->oc->pb, filename, URL_WRONLY) < 0) {
+        fprintf(stderr, "%s: could not open\n", filename);
+        return -1;
+    }
+    // sets size of first audio chunk, so it is written before encoding starts
+    if(av_write_header(t->oc) < 0) {
+        fprintf(stderr, "Could not write header\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    Transcoder t;
+    pthread_t decoder, scaler, encoder;
+    const char *yuv = NULL;
+    int sample_rate = 22050, queue_size = 8, threads = 1;
+    struct timeval start, end;
+    AVPacket *pkt;
+    double elapsed;
+    int i, ret;
+
+    memset(&t, 0, sizeof(t));
+    t.width = 160;
+    t.height = 120;
+    t.frame_rate = (AVRational){16, 1};
+
+    for(i = 1; i < argc - 2; i++) {
+        if(!strcmp(argv[i], "-s") && i + 1 < argc - 2)
+            sscanf(argv[++i], "%dx%d", &t.width, &t.height);
+        else if(!strcmp(argv[i], "-r") && i + 1 < argc - 2)
+            t.frame_rate = (AVRational){atoi(argv[++i]), 1};
+        else if(!strcmp(argv[i], "-ar") && i + 1 < argc - 2)
+            sample_rate = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-yuv") && i + 1 < argc - 2)
+            yuv = argv[++i];
+        else if(!strcmp(argv[i], "-queue") && i + 1 < argc - 2)
+            queue_size = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-threads") && i + 1 < argc - 2)
+            threads = atoi(argv[++i]);
+        else
+            break;
+    }
+    if(i != argc - 2 || t.width <= 0 || t.height <= 0 || t.frame_rate.num <= 0 ||
+       sample_rate <= 0 || queue_size <= 0 || threads <= 0) {
+        fprintf(stderr, "usage: %s [-s WxH] [-r fps] [-ar rate] [-yuv WxH:fps] [-queue n] [-threads n]\n"
+                        "       input output.amv\n", argv[0]);
+        return 1;
+    }
+
+    av_register_all();
+
+    if(open_input(&t, argv[argc - 2], yuv) < 0 || open_output(&t, argv[argc - 1], sample_rate, threads) < 0)
+        return 1;
+
+    queue_init(&t.decoded, queue_size, 1);
+    queue_init(&t.scaled, queue_size, 1);
+    // resampled audio comes from decode stage, video packets from encode stage
+    queue_init(&t.packets, 2 * queue_size, 2);
+
+    gettimeofday(&start, NULL);
+    pthread_create(&decoder, NULL, decode_thread, &t);
+    pthread_create(&scaler, NULL, scale_thread, &t);
+    pthread_create(&encoder, NULL, encode_thread, &t);
+
+    while((pkt = queue_get(&t.packets))) {
+        if(pkt->stream_index == RAW_AUDIO) {
+            av_fifo_write(&t.audio_fifo, pkt->data, pkt->size);
+            ret = encode_audio(&t, 0);
+        } else
+            ret = av_interleaved_write_frame(t.oc, pkt);
+        if(ret < 0) {
+            fprintf(stderr, "Error while writing packet\n");
+            return 1;
+        }
+        av_free_packet(pkt);
+        av_free(pkt);
+    }
+    if(t.aenc && encode_audio(&t, 1) < 0) {
+        fprintf(stderr, "Error while writing packet\n");
+        return 1;
+    }
+
+    pthread_join(decoder, NULL);
+    pthread_join(scaler, NULL);
+    pthread_join(encoder, NULL);
+
+    av_write_trailer(t.oc);
+    url_fclose(&t.oc->pb);
+    gettimeofday(&end, NULL);
+
+    elapsed = end.tv_sec - start.tv_sec + (end.tv_usec - start.tv_usec) / 1e6;
+    fprintf(stderr, "video frames: %"PRId64", audio frames: %"PRId64", %.2fs, %.1f fps\n",
+            t.video_frames, t.audio_frames, elapsed, t.video_frames / elapsed);
+
+    avcodec_close(t.venc);
+    if(t.aenc) {
+        avcodec_close(t.aenc);
+        av_fifo_free(&t.audio_fifo);
+        if(t.resample)
+            audio_resample_close(t.resample);
+        avcodec_close(t.adec);
+    }
+    avcodec_close(t.vdec);
+    av_close_input_file(t.ic);
+    for(i = 0; i < t.oc->nb_streams; i++) {
+        av_free(t.oc->streams[i]->codec);
+        av_free(t.oc->streams[i]);
+    }
+    av_free(t.oc);
+    queue_free(&t.decoded);
+    queue_free(&t.scaled);
+    queue_free(&t.packets);
+    return 0;
+}
@@ -1,102 +1,431 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#define GOOD_FILE "hole_correct.amv"
-#define BAD_FILE "hole.amv"
+/*
+  AMV structural diff and validation tool.
+
+  Maps both files into memory, walks chunks of their movi lists and
+  checks them (chunk ids, JPEG markers of video frames, ADPCM header and
+  sample count of audio chunks, AMV_END_ tag), then compares chunk
+  sequence, chunk sizes, ADPCM headers and sample counts of both files.
+
+  usage: compare_amv [-j jobs] reference.amv test.amv
+         compare_amv [-j jobs] -d reference_dir test_dir
+
+  With -d every *.amv file of reference_dir is compared with the file of
+  the same name in test_dir, pairs are checked by jobs threads (default:
+  number of CPUs).
+
+  Output is one JSON object, with one result per pair:
+
+  {"pairs":N,"failed":N,"results":[{"reference":"...","test":"...",
+   "match":0|1,"audio_match":0|1,"reference_file":{...},"test_file":{...},"chunks":N,
+   "first_sequence_mismatch":N,"video_size_mismatches":N,
+   "audio_size_mismatches":N,"adpcm_header_mismatches":N,
+   "sample_count_mismatches":N,"first_size_mismatch_offset":N}, ...]}
+
+  Files match when both are valid, have the same chunk sequence and
+  the same audio sample counts (video sizes may differ between encoders).
+  Encoders may choose other ADPCM predictors, so header and audio size
+  mismatches do not fail a pair; audio_match is 1 only when there are
+  none of them and no sample count mismatches either.
+  first_* fields are -1 when there is no mismatch.
+
+  exit code is 0 when all pairs match, 1 otherwise
+*/
 
 #define VIDEO_SECT_ID 0x63643030 //00dc
 #define AUDIO_SECT_ID 0x62773130 //01wb
 
-int main(void)
+#define RL16(p) ((p)[0] | (p)[1] << 8)
+#define RL32(p) ((uint32_t)((p)[0] | (p)[1] << 8 | (p)[2] << 16 | (uint32_t)(p)[3] << 24))
+
+enum { VIDEO, AUDIO };
+
+typedef struct {
+    uint32_t offset;        ///< offset of chunk id in file
+    uint32_t size;
+    int type;
+    int predictor, step_index;
+    uint32_t samples;
+} Chunk;
+
+typedef struct {
+    const char *name;
+    const uint8_t *data;
+    size_t size;
+    int width, height, fps;
+    int video, audio;
+    uint64_t samples;
+    int nb_chunks;
+    Chunk *chunks;
+    int errors;
+    char error[256];        ///< first error
+} AMVFile;
+
+typedef struct {
+    char *reference, *test;
+    char *json;             ///< result of comparison
+    size_t json_size;
+    int match;
+    int audio_match;        ///< audio chunk sizes and ADPCM headers are equal too
+} Pair;
+
+static void file_error(AMVFile *f, const char *fmt, ...)
 {
-    FILE *fgood,*fbad;
-    char buf[200];
-    unsigned int good_sect_len,bad_sect_len;
-    unsigned int good_sect_id,bad_sect_id;
-    unsigned int video_num,audio_num;
-    unsigned int samples=0;
-    unsigned int good_samples,bad_samples;
-    fgood=fopen(GOOD_FILE,"rb");
-    if(!fgood) {
-        printf("Error opening good file '%s'\n",GOOD_FILE);
+    va_list ap;
+
+    if(!f->errors++) {
+        va_start(ap, fmt);
+        vsnprintf(f->error, sizeof(f->error), fmt, ap);
+        va_end(ap);
+    }
+}
+
+static const uint8_t *find_tag(const uint8_t *p, const uint8_t *end, const char *tag)
+{
+    for(; p + 4 <= end; p++)
+        if(!memcmp(p, tag, 4))
+            return p;
+    return NULL;
+}
+
+/**
+ * \brief maps file and walks its chunks
+ * \return 0 on success, -1 if file can not be read
+ */
+static int amv_open(AMVFile *f, const char *name)
+{
+    const uint8_t *p, *end, *movi = NULL;
+    struct stat st;
+    int fd, max_chunks = 0;
+
+    memset(f, 0, sizeof(*f));
+    f->name = name;
+
+    if((fd = open(name, O_RDONLY)) < 0) {
+        file_error(f, "can not open");
         return -1;
     }
-    fbad=fopen(BAD_FILE,"rb");
-    if(!fbad) {
-        printf("Error opening bad file '%s'\n",BAD_FILE);
-        fclose(fgood);
-	return -1;
-    }
-    while(1) {
-        fseek(fgood,0x138,SEEK_SET);
-        fread(buf,4,1,fgood);
-        if(strncmp(buf,"movi",4)){
-            printf("Wring header size in '%s'\n",GOOD_FILE);
+    if(fstat(fd, &st) < 0 || st.st_size < 12) {
+        file_error(f, "too short");
+        close(fd);
+        return -1;
+    }
+    f->size = st.st_size;
+    f->data = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(f->data == MAP_FAILED) {
+        f->data = NULL;
+        file_error(f, "can not map");
+        return -1;
+    }
+    end = f->data + f->size;
+
+    if(memcmp(f->data, "RIFF", 4) || memcmp(f->data + 8, "AMV ", 4))
+        file_error(f, "no RIFF AMV header");
+
+    if((p = find_tag(f->data + 12, end, "amvh")) && p + 8 + 44 <= end) {
+        f->width  = RL32(p + 8 + 32);
+        f->height = RL32(p + 8 + 36);
+        f->fps    = RL32(p + 8 + 40);
+    } else
+        file_error(f, "no amvh header");
+
+    // movi list does not have fixed offset, look for its LIST tag
+    for(p = f->data + 12; (p = find_tag(p, end, "movi")); p++)
+        if(p - f->data >= 8 && !memcmp(p - 8, "LIST", 4)) {
+            movi = p + 4;
+            break;
+        }
+    if(!movi) {
+        file_error(f, "no movi list");
+        return 0;
+    }
+
+    for(p = movi; ; ) {
+        Chunk *c;
+        uint32_t id;
+
+        if(p + 8 > end) {
+            file_error(f, "no AMV_END_ at 0x%x", (unsigned)(p - f->data));
             break;
-	}
-        fseek(fbad,0x138,SEEK_SET);
-        fread(buf,4,1,fbad);
-        if(strncmp(buf,"movi",4)){
-            printf("Wring header size in '%s'\n",BAD_FILE);
+        }
+        if(!memcmp(p, "AMV_END_", 8))
             break;
-	}
-        video_num=0;
-        audio_num=0;
-        while(!feof(fgood) && !feof(fbad)) {
-            printf("Offset: good=0x%x, bad=0x%x\n",ftell(fgood),ftell(fbad));
-            fread(&good_sect_id,4,1,fgood);
-            fread(&bad_sect_id,4,1,fbad);
-            if(!strncmp(&good_sect_id,"AMV_",4)){
-                printf("EOF reached in '%s'\n",GOOD_FILE);
-                break;
-            }
-            if(!strncmp(&bad_sect_id,"AMV_",4)){
-                printf("EOF reached in '%s'\n",BAD_FILE);
-                break;
-            }
-	    if(good_sect_id!=VIDEO_SECT_ID && good_sect_id!=AUDIO_SECT_ID){
-                printf("Wrong sect id in '%s' at offset 0x%X: :0x%X\n",GOOD_FILE,ftell(fgood),good_sect_id);
-                break;
-            }
-	    if(bad_sect_id!=VIDEO_SECT_ID && bad_sect_id!=AUDIO_SECT_ID){
-                printf("Wrong sect id in '%s':0x%X\n",BAD_FILE,bad_sect_id);
-                break;
-            }
-            if(good_sect_id!=bad_sect_id) {
-                printf("Sect id are not equal: bad=0x%X, good=0x%X\n",good_sect_id,bad_sect_id);
+
+        id = RL32(p);
+        if(id != VIDEO_SECT_ID && id != AUDIO_SECT_ID) {
+            file_error(f, "wrong chunk id 0x%08X at 0x%x", id, (unsigned)(p - f->data));
+            break;
+        }
+        if(RL32(p + 4) > end - p - 8) {
+            file_error(f, "chunk at 0x%x exceeds file", (unsigned)(p - f->data));
+            break;
+        }
+
+        if(f->nb_chunks == max_chunks) {
+            Chunk *chunks;
+
+            max_chunks = max_chunks ? 2 * max_chunks : 1024;
+            if(!(chunks = realloc(f->chunks, max_chunks * sizeof(Chunk)))) {
+                file_error(f, "out of memory at 0x%x", (unsigned)(p - f->data));
                 break;
             }
-            if(good_sect_id==VIDEO_SECT_ID) video_num++;
-            if(good_sect_id==AUDIO_SECT_ID) audio_num++;
-            fread(&good_sect_len,4,1,fgood);
-            fread(&bad_sect_len,4,1,fbad);
-            if(good_sect_id==AUDIO_SECT_ID) samples+=(bad_sect_len-8)*2+1;
-            if(good_sect_len!=bad_sect_len) {
-                printf("Sect length for %.4s (bad offset 0x%x) #%d are not equal: good=0x%X, bad=0x%X %d\n",
-                        &good_sect_id,ftell(fbad),(video_num+audio_num),good_sect_len,bad_sect_len,samples);
-            }else{
-                printf("Sect length for %.4s (bad offset 0x%x) #%d is equal: 0x%X (%d)\n",
-                        &good_sect_id,ftell(fbad),(video_num+audio_num),good_sect_len,samples);
-            }
-            if(good_sect_id==AUDIO_SECT_ID){
-                fseek(fbad,4,SEEK_CUR);
-                fseek(fgood,4,SEEK_CUR);
-                fread(&bad_samples,4,1,fbad);
-                fread(&good_samples,4,1,fgood);
-                printf("Samples count for %.4s (bad offset 0x%x) #%d are %s equal: good=0x%X, bad=0x%X %d\n",
-                        &good_sect_id,ftell(fbad),(video_num+audio_num),good_samples==bad_samples?"":"not",good_samples,bad_samples);
-                fseek(fgood,good_sect_len-8,SEEK_CUR);
-                fseek(fbad,bad_sect_len-8,SEEK_CUR);
-            }else{
-            fseek(fgood,good_sect_len,SEEK_CUR);
-            fseek(fbad,bad_sect_len,SEEK_CUR);
+            f->chunks = chunks;
+        }
+        c = &f->chunks[f->nb_chunks++];
+        memset(c, 0, sizeof(*c));
+        c->offset = p - f->data;
+        c->size   = RL32(p + 4);
+        p += 8;
+
+        if(id == VIDEO_SECT_ID) {
+            c->type = VIDEO;
+            f->video++;
+            if(c->size && (c->size < 4 || RL16(p) != 0xD8FF || RL16(p + c->size - 2) != 0xD9FF))
+                file_error(f, "video chunk at 0x%x is not SOI..EOI", c->offset);
+        } else {
+            c->type = AUDIO;
+            f->audio++;
+            if(c->size < 8)
+                file_error(f, "audio chunk at 0x%x has no ADPCM header", c->offset);
+            else {
+                c->predictor  = (int16_t)RL16(p);
+                c->step_index = RL16(p + 2);
+                c->samples    = RL32(p + 4);
+                f->samples   += c->samples;
+                if(c->step_index > 88)
+                    file_error(f, "step index %d at 0x%x", c->step_index, c->offset);
+                if(c->samples != 2 * (c->size - 8))
+                    file_error(f, "%u samples in %u bytes at 0x%x", c->samples, c->size - 8, c->offset);
             }
+        }
+        p += c->size;
+    }
+    return 0;
+}
 
+static void amv_close(AMVFile *f)
+{
+    if(f->data)
+        munmap((void*)f->data, f->size);
+    free(f->chunks);
+}
+
+static void json_string(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for(; *s; s++) {
+        if(*s == '"' || *s == '\\')
+            fprintf(out, "\\%c", *s);
+        else if((unsigned char)*s < 0x20)
+            fprintf(out, "\\u%04x", *s);
+        else
+            fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+static void json_file(FILE *out, const AMVFile *f)
+{
+    fprintf(out, "{\"valid\":%d,\"size\":%lu,\"width\":%d,\"height\":%d,\"fps\":%d,"
+                 "\"video_chunks\":%d,\"audio_chunks\":%d,\"samples\":%llu,\"errors\":%d",
+            !f->errors, (unsigned long)f->size, f->width, f->height, f->fps,
+            f->video, f->audio, (unsigned long long)f->samples, f->errors);
+    if(f->errors) {
+        fprintf(out, ",\"error\":");
+        json_string(out, f->error);
+    }
+    fputc('}', out);
+}
+
+static void compare_pair(Pair *pair)
+{
+    AMVFile ref, test;
+    FILE *out = open_memstream(&pair->json, &pair->json_size);
+    int i, n, sequence = -1, size_offset = -1;
+    int video_sizes = 0, audio_sizes = 0, headers = 0, samples = 0;
+
+    amv_open(&ref, pair->reference);
+    amv_open(&test, pair->test);
+
+    n = ref.nb_chunks < test.nb_chunks ? ref.nb_chunks : test.nb_chunks;
+    for(i = 0; i < n; i++) {
+        const Chunk *r = &ref.chunks[i], *t = &test.chunks[i];
+
+        if(r->type != t->type) {
+            sequence = i;
+            break;
         }
-        printf("Check successfully finished\n");
-        break;
+        if(r->size != t->size) {
+            if(size_offset < 0)
+                size_offset = t->offset;
+            if(r->type == VIDEO)
+                video_sizes++;
+            else
+                audio_sizes++;
+        }
+        if(r->type == AUDIO) {
+            if(r->predictor != t->predictor || r->step_index != t->step_index)
+                headers++;
+            if(r->samples != t->samples)
+                samples++;
+        }
+    }
+    if(sequence < 0 && ref.nb_chunks != test.nb_chunks)
+        sequence = n;
+
+    pair->audio_match = !audio_sizes && !headers && !samples;
+    pair->match = !ref.errors && !test.errors && sequence < 0 && !samples &&
+                  ref.width == test.width && ref.height == test.height && ref.fps == test.fps;
+
+    fprintf(out, "{\"reference\":");
+    json_string(out, pair->reference);
+    fprintf(out, ",\"test\":");
+    json_string(out, pair->test);
+    fprintf(out, ",\"match\":%d,\"audio_match\":%d,\"reference_file\":",
+            pair->match, pair->audio_match);
+    json_file(out, &ref);
+    fprintf(out, ",\"test_file\":");
+    json_file(out, &test);
+    fprintf(out, ",\"chunks\":%d,\"first_sequence_mismatch\":%d,\"video_size_mismatches\":%d,"
+                 "\"audio_size_mismatches\":%d,\"adpcm_header_mismatches\":%d,"
+                 "\"sample_count_mismatches\":%d,\"first_size_mismatch_offset\":%d}",
+            i, sequence, video_sizes, audio_sizes, headers, samples, size_offset);
+    fclose(out);
+
+    amv_close(&ref);
+    amv_close(&test);
+}
+
+static Pair *pairs;
+static int nb_pairs, next_pair;
+static pthread_mutex_t pair_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *worker(void *arg)
+{
+    int i;
+
+    (void)arg;
+
+    for(;;) {
+        pthread_mutex_lock(&pair_lock);
+        i = next_pair++;
+        pthread_mutex_unlock(&pair_lock);
+        if(i >= nb_pairs)
+            return NULL;
+        compare_pair(&pairs[i]);
     }
-    
-    fclose(fgood);
-    fclose(fbad);
+}
+
+static char *join(const char *dir, const char *name)
+{
+    char *s = malloc(strlen(dir) + strlen(name) + 2);
+
+    sprintf(s, "%s/%s", dir, name);
+    return s;
+}
+
+static int cmp_pairs(const void *a, const void *b)
+{
+    return strcmp(((const Pair*)a)->reference, ((const Pair*)b)->reference);
+}
+
+static int add_dir(const char *ref_dir, const char *test_dir)
+{
+    struct dirent *e;
+    DIR *d = opendir(ref_dir);
+    size_t len;
+
+    if(!d) {
+        fprintf(stderr, "%s: can not open\n", ref_dir);
+        return -1;
+    }
+    while((e = readdir(d))) {
+        Pair *new_pairs;
+
+        len = strlen(e->d_name);
+        if(len < 4 || strcasecmp(e->d_name + len - 4, ".amv"))
+            continue;
+        if(!(new_pairs = realloc(pairs, (nb_pairs + 1) * sizeof(Pair)))) {
+            fprintf(stderr, "%s: out of memory\n", ref_dir);
+            closedir(d);
+            return -1;
+        }
+        pairs = new_pairs;
+        memset(&pairs[nb_pairs], 0, sizeof(Pair));
+        pairs[nb_pairs].reference = join(ref_dir, e->d_name);
+        pairs[nb_pairs].test      = join(test_dir, e->d_name);
+        nb_pairs++;
+    }
+    closedir(d);
+    qsort(pairs, nb_pairs, sizeof(Pair), cmp_pairs);
     return 0;
 }
+
+int main(int argc, char **argv)
+{
+    pthread_t *threads;
+    int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 1, dir = 0, failed = 0;
+
+    if(argc > i + 1 && !strcmp(argv[i], "-j")) {
+        jobs = atoi(argv[i + 1]);
+        i += 2;
+    }
+    if(argc > i && !strcmp(argv[i], "-d")) {
+        dir = 1;
+        i++;
+    }
+    if(argc != i + 2) {
+        fprintf(stderr, "usage: %s [-j jobs] reference.amv test.amv\n"
+                        "       %s [-j jobs] -d reference_dir test_dir\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    if(dir) {
+        if(add_dir(argv[i], argv[i + 1]) < 0)
+            return 2;
+    } else {
+        pairs = calloc(1, sizeof(Pair));
+        pairs[0].reference = strdup(argv[i]);
+        pairs[0].test      = strdup(argv[i + 1]);
+        nb_pairs = 1;
+    }
+
+    if(jobs < 1)
+        jobs = 1;
+    if(jobs > nb_pairs)
+        jobs = nb_pairs;
+    threads = calloc(jobs, sizeof(pthread_t));
+    for(i = 0; i < jobs; i++)
+        pthread_create(&threads[i], NULL, worker, NULL);
+    for(i = 0; i < jobs; i++)
+        pthread_join(threads[i], NULL);
+
+    for(i = 0; i < nb_pairs; i++)
+        failed += !pairs[i].match;
+
+    printf("{\"pairs\":%d,\"failed\":%d,\"results\":[", nb_pairs, failed);
+    for(i = 0; i < nb_pairs; i++) {
+        printf("%s%s", i ? ",\n" : "\n", pairs[i].json);
+        free(pairs[i].json);
+        free(pairs[i].reference);
+        free(pairs[i].test);
+    }
+    printf("]}\n");
+
+    free(threads);
+    free(pairs);
+    return failed ? 1 : 0;
+}
@@ -415,6 +415,8 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx
                                           &new_pkt.data, &new_pkt.size,
                                           pkt->data, pkt->size,
                                           pkt->flags & PKT_FLAG_KEY);
+        if(new_pkt.data != pkt->data)
+            new_pkt.flags &= ~PKT_FLAG_HEADROOM;
         if(a){
             av_free_packet(pkt);
             new_pkt.destruct= av_destruct_packet;
@@ -513,24 +515,23 @@ static void do_audio_out(AVFormatContext *s,
         /* output resampled raw samples */
         av_fifo_write(&ost->fifo, buftmp, size_out);
 
-        frame_bytes = enc->frame_size * 2 * enc->channels;
-
-        while (av_fifo_read(&ost->fifo, audio_buf, frame_bytes) == 0) {
+        /* frame_size may change after each frame (AMV muxer) */
+        while (av_fifo_read(&ost->fifo, audio_buf, frame_bytes = enc->frame_size * 2 * enc->channels) == 0) {
             AVPacket pkt;
             av_init_packet(&pkt);
 
-            ret = avcodec_encode_audio(enc, audio_out, audio_out_size,
+            /* room for the chunk header, so the muxer can write without a copy */
+            ret = avcodec_encode_audio(enc, audio_out + PKT_HEADROOM, audio_out_size - PKT_HEADROOM,
                                        (short *)audio_buf);
             audio_size += ret;
             pkt.stream_index= ost->index;
-            pkt.data= audio_out;
+            pkt.data= audio_out + PKT_HEADROOM;
             pkt.size= ret;
             if(enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
                 pkt.pts= av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
-            pkt.flags |= PKT_FLAG_KEY;
+            pkt.flags |= PKT_FLAG_KEY | PKT_FLAG_HEADROOM;
+            ost->sync_opts += frame_bytes / (2 * enc->channels);
             write_frame(s, &pkt, ost->st->codec, bitstream_filters[ost->file_index][pkt.stream_index]);
-
-            ost->sync_opts += enc->frame_size;
         }
     } else {
         AVPacket pkt;
@@ -812,7 +813,7 @@ static void do_video_out(AVFormatContext *s,
 //            big_picture.pts= av_rescale(ost->sync_opts, AV_TIME_BASE*(int64_t)enc->time_base.num, enc->time_base.den);
 //av_log(NULL, AV_LOG_DEBUG, "%"PRId64" -> encoder\n", ost->sync_opts);
             ret = avcodec_encode_video(enc,
-                                       bit_buffer, bit_buffer_size,
+                                       bit_buffer + PKT_HEADROOM, bit_buffer_size - PKT_HEADROOM,
                                        &big_picture);
             if (ret == -1) {
                 fprintf(stderr, "Video encoding failed\n");
@@ -820,8 +821,9 @@ static void do_video_out(AVFormatContext *s,
             }
             //enc->frame_number = enc->real_pict_num;
             if(ret>0){
-                pkt.data= bit_buffer;
+                pkt.data= bit_buffer + PKT_HEADROOM;
                 pkt.size= ret;
+                pkt.flags |= PKT_FLAG_HEADROOM;
                 if(enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
                     pkt.pts= av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
 /*av_log(NULL, AV_LOG_DEBUG, "encoder -> %"PRId64"/%"PRId64"\n",
@@ -3151,6 +3153,10 @@ static void opt_output_file(const char *filename)
 
         oc->timestamp = rec_timestamp;
 
+        /* lets muxers write final header at once (e.g. ACT into a pipe) */
+        if (recording_time > 0)
+            oc->duration = recording_time;
+
         if (str_title)
             av_strlcpy(oc->title, str_title, sizeof(oc->title));
         if (str_author)
@@ -22,6 +22,10 @@
 #include "bitstream.h"
 #include "bytestream.h"
 
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 /**
  * @file adpcm.c
  * ADPCM codecs.
@@ -146,10 +150,47 @@ typedef struct ADPCMChannelStatus {
 typedef struct ADPCMContext {
     int channel; /* for stereo MOVs, decode left, then decode right, then tell it's decoded */
     ADPCMChannelStatus status[6];
-    int extra_amv_samples; //number of samples to put into next frame
     int samples_written;
 } ADPCMContext;
 
+/* AMV tables, indexed by [step_index][nibble] */
+static int     amv_diff_table[89][16];   ///< encoder: (step * yamaha_difflookup[nibble]) / 8
+static uint8_t amv_index_table[89][16];  ///< step_index after coding nibble
+static int     amv_expand_table[89][16]; ///< decoder: sample difference << 8 | next step_index
+
+static void build_amv_tables(void)
+{
+    int i, j;
+
+    for (i = 0; i < 89; i++) {
+        for (j = 0; j < 16; j++) {
+            int diff = ((2 * (j & 7) + 1) * step_table[i]) >> 3;
+            if (j & 8)
+                diff = -diff;
+            amv_diff_table[i][j]   = (step_table[i] * yamaha_difflookup[j]) / 8;
+            amv_index_table[i][j]  = av_clip(i + index_table[j], 0, 88);
+            amv_expand_table[i][j] = diff * 256 + amv_index_table[i][j];
+        }
+    }
+}
+
+static void adpcm_ima_amv_init_tables(void)
+{
+#ifdef HAVE_PTHREADS
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+    pthread_once(&once, build_amv_tables);
+#else
+    /* callers serialize avcodec_open() */
+    static int done = 0;
+
+    if (!done) {
+        build_amv_tables();
+        done = 1;
+    }
+#endif
+}
+
 /* XXX: implement encoding */
 
 #ifdef CONFIG_ENCODERS
@@ -196,7 +237,13 @@ static int adpcm_encode_init(AVCodecContext *avctx)
             av_log(avctx, AV_LOG_ERROR, "Only 22050 sample rate is supported\n");
             return -1;
         }
-        break;        
+        /* the trellis keeps 2^trellis paths of FREEZE_INTERVAL nibbles on the stack */
+        if (avctx->trellis > 8) {
+            av_log(avctx, AV_LOG_ERROR, "trellis depth %d is too large, the maximum is 8\n", avctx->trellis);
+            return -1;
+        }
+        adpcm_ima_amv_init_tables();
+        break;
     default:
         return -1;
         break;
@@ -226,6 +273,44 @@ static inline unsigned char adpcm_ima_compress_sample(ADPCMChannelStatus *c, sho
     return nibble;
 }
 
+/**
+ * Encodes 2*n samples into n bytes, first sample in the high nibble.
+ * Bitexact with adpcm_ima_compress_sample(), the division is replaced by
+ * comparing 4*|delta| against 4, 2 and 1 steps.
+ */
+static void adpcm_ima_amv_compress(ADPCMChannelStatus *c, const short *samples,
+                                   uint8_t *dst, int n)
+{
+    int predictor  = c->prev_sample;
+    int step_index = c->step_index;
+    int i, k;
+
+    for (i = 0; i < n; i++) {
+        int byte = 0;
+        for (k = 0; k < 2; k++) {
+            const int step = step_table[step_index];
+            int delta  = *samples++ - predictor;
+            int nibble = 0;
+
+            if (delta < 0) {
+                nibble = 8;
+                delta  = -delta;
+            }
+            delta <<= 2;
+            if (delta >= step << 2) { nibble |= 4; delta -= step << 2; }
+            if (delta >= step << 1) { nibble |= 2; delta -= step << 1; }
+            if (delta >= step)        nibble |= 1;
+
+            predictor  = av_clip_int16(predictor + amv_diff_table[step_index][nibble]);
+            step_index = amv_index_table[step_index][nibble];
+            byte = (byte << 4) | nibble;
+        }
+        *dst++ = byte;
+    }
+    c->prev_sample = predictor;
+    c->step_index  = step_index;
+}
+
 static inline unsigned char adpcm_ms_compress_sample(ADPCMChannelStatus *c, short sample)
 {
     int predictor, nibble, bias;
@@ -465,34 +550,23 @@ static int adpcm_encode_frame(AVCodecContext *avctx,
         bytestream_put_le16(&dst, c->status[0].prev_sample);
         bytestream_put_le16(&dst, c->status[0].step_index);
 
-        //if frame_size is odd, place extra sample into each even frame
+        /* the AMV muxer sets frame_size of each chunk, it is always even */
         n = avctx->frame_size>>1;
-        c->extra_amv_samples+=avctx->frame_size&1;
-        n+=c->extra_amv_samples>>1;
-        c->extra_amv_samples&=1;
-
-        i=(c->samples_written+2*n)%avctx->sample_rate;
-
-        if(i && i+avctx->frame_size > avctx->sample_rate)
-            n+=(avctx->sample_rate-i)>>1;
 
         bytestream_put_le32(&dst, n<<1);
 
+        /* trellis searches 2^trellis candidate paths for the least squared error */
         if(avctx->trellis > 0)
         {
             uint8_t buf[2*n];
             adpcm_compress_trellis(avctx, samples, buf, &c->status[0], 2*n);
             for(i=0; i < n; i++)
                 *dst++ =  (buf[2*i] << 4) | buf[2*i+1];
-            samples+=2*n;
-        }else
-            while ( n ) {
-                *dst =  (adpcm_ima_compress_sample(&c->status[0], *samples++) << 4);
-                *dst |= (adpcm_ima_compress_sample(&c->status[0], *samples++) & 0x0F);
-                n--;
-                dst++;
-            }
-        c->samples_written+=samples-(short*)data;
+        }else{
+            adpcm_ima_amv_compress(&c->status[0], samples, dst, n);
+            dst += n;
+        }
+        c->samples_written+=2*n;
         break;
     case CODEC_ID_ADPCM_IMA_WAV:
         n = avctx->frame_size / 8;
@@ -701,6 +775,9 @@ static int adpcm_decode_init(AVCodecContext * avctx)
     case CODEC_ID_ADPCM_CT:
         c->status[0].step = c->status[1].step = 511;
         break;
+    case CODEC_ID_ADPCM_IMA_AMV:
+        adpcm_ima_amv_init_tables();
+        break;
     case CODEC_ID_ADPCM_IMA_WS:
         if (avctx->extradata && avctx->extradata_size == 2 * 4) {
             c->status[0].predictor = AV_RL32(avctx->extradata);
@@ -740,6 +817,49 @@ static inline short adpcm_ima_expand_nibble(ADPCMChannelStatus *c, char nibble,
     return (short)c->predictor;
 }
 
+static inline int amv_clip_int16(int a)
+{
+    a = FFMAX(a, -32768);
+    return FFMIN(a, 32767);
+}
+
+#define AMV_EXPAND_NIBBLE(nibble)                        \
+    e          = amv_expand_table[step_index][nibble];   \
+    predictor  = amv_clip_int16(predictor + (e >> 8));   \
+    step_index = e & 0xFF;                               \
+    *samples++ = predictor;
+
+/**
+ * Decodes n bytes of AMV ADPCM, high nibble first, into 2*n samples.
+ * Gives the same output as adpcm_ima_expand_nibble() with shift 3.
+ */
+static void adpcm_ima_amv_expand(ADPCMChannelStatus *c, const uint8_t *src,
+                                 int n, short *samples)
+{
+    int predictor  = c->predictor;
+    int step_index = c->step_index;
+    int i, e;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        const unsigned int w = AV_RB32(src + i);
+        AMV_EXPAND_NIBBLE( w >> 28       );
+        AMV_EXPAND_NIBBLE((w >> 24) & 0xF);
+        AMV_EXPAND_NIBBLE((w >> 20) & 0xF);
+        AMV_EXPAND_NIBBLE((w >> 16) & 0xF);
+        AMV_EXPAND_NIBBLE((w >> 12) & 0xF);
+        AMV_EXPAND_NIBBLE((w >>  8) & 0xF);
+        AMV_EXPAND_NIBBLE((w >>  4) & 0xF);
+        AMV_EXPAND_NIBBLE( w        & 0xF);
+    }
+    for (; i < n; i++) {
+        AMV_EXPAND_NIBBLE(src[i] >> 4 );
+        AMV_EXPAND_NIBBLE(src[i] & 0xF);
+    }
+    c->predictor  = predictor;
+    c->step_index = step_index;
+}
+#undef AMV_EXPAND_NIBBLE
+
 static inline short adpcm_ms_expand_nibble(ADPCMChannelStatus *c, char nibble)
 {
     int predictor;
@@ -1265,22 +1385,15 @@ static int adpcm_decode_frame(AVCodecContext *avctx,
         samples += 28 * samples_in_chunk * avctx->channels;
         break;
     }
-    case CODEC_ID_ADPCM_IMA_AMV:
     case CODEC_ID_ADPCM_IMA_SMJPEG:
         c->status[0].predictor = (int16_t)bytestream_get_le16(&src);
         c->status[0].step_index = bytestream_get_le16(&src);
 
-        if (avctx->codec->id == CODEC_ID_ADPCM_IMA_AMV)
-            src+=4;
-
         while (src < buf + buf_size) {
             char hi, lo;
             lo = *src & 0x0F;
             hi = (*src >> 4) & 0x0F;
 
-            if (avctx->codec->id == CODEC_ID_ADPCM_IMA_AMV)
-                FFSWAP(char, hi, lo);
-
             *samples++ = adpcm_ima_expand_nibble(&c->status[0],
                 lo, 3);
             *samples++ = adpcm_ima_expand_nibble(&c->status[0],
@@ -1492,6 +1605,32 @@ static int adpcm_decode_frame(AVCodecContext *avctx,
     return src - buf;
 }
 
+/**
+ * AMV audio chunks are a 8 byte header (predictor, step index and the
+ * number of samples) followed by the nibbles, so they are decoded here
+ * directly instead of in adpcm_decode_frame().
+ */
+static int adpcm_ima_amv_decode_frame(AVCodecContext *avctx,
+                                      void *data, int *data_size,
+                                      uint8_t *buf, int buf_size)
+{
+    ADPCMContext *c = avctx->priv_data;
+    int n = buf_size - 8;
+
+    if (!buf_size)
+        return 0;
+
+    if (n < 0 || *data_size/4 < n)
+        return -1;
+
+    c->status[0].predictor  = (int16_t)AV_RL16(buf);
+    c->status[0].step_index = av_clip(AV_RL16(buf + 2), 0, 88);
+    adpcm_ima_amv_expand(&c->status[0], buf + 8, n, data);
+
+    *data_size = 4 * n;
+    return buf_size;
+}
+
 
 
 #ifdef CONFIG_ENCODERS
@@ -1526,13 +1665,26 @@ AVCodec name ## _decoder = {                    \
 #define ADPCM_DECODER(id,name)
 #endif
 
+#ifdef CONFIG_DECODERS
+AVCodec adpcm_ima_amv_decoder = {
+    "adpcm_ima_amv",
+    CODEC_TYPE_AUDIO,
+    CODEC_ID_ADPCM_IMA_AMV,
+    sizeof(ADPCMContext),
+    adpcm_decode_init,
+    NULL,
+    NULL,
+    adpcm_ima_amv_decode_frame,
+};
+#endif
+
 #define ADPCM_CODEC(id, name)                   \
 ADPCM_ENCODER(id,name) ADPCM_DECODER(id,name)
 
 ADPCM_CODEC(CODEC_ID_ADPCM_4XM, adpcm_4xm);
 ADPCM_CODEC(CODEC_ID_ADPCM_CT, adpcm_ct);
 ADPCM_CODEC(CODEC_ID_ADPCM_EA, adpcm_ea);
-ADPCM_CODEC(CODEC_ID_ADPCM_IMA_AMV, adpcm_ima_amv);
+ADPCM_ENCODER(CODEC_ID_ADPCM_IMA_AMV, adpcm_ima_amv);
 ADPCM_CODEC(CODEC_ID_ADPCM_IMA_DK3, adpcm_ima_dk3);
 ADPCM_CODEC(CODEC_ID_ADPCM_IMA_DK4, adpcm_ima_dk4);
 ADPCM_CODEC(CODEC_ID_ADPCM_IMA_QT, adpcm_ima_qt);
@@ -1552,3 +1704,69 @@ ADPCM_CODEC(CODEC_ID_ADPCM_XA, adpcm_xa);
 ADPCM_CODEC(CODEC_ID_ADPCM_YAMAHA, adpcm_yamaha);
 
 #undef ADPCM_CODEC
+
+#ifdef TEST
+#include <stdio.h>
+#undef printf
+#undef exit
+#undef random
+
+/* compares the AMV fast paths with the generic per nibble code */
+#define MAX_BYTES 1500
+
+int main(int argc, char **argv)
+{
+    ADPCMChannelStatus ref, fast;
+    uint8_t buf[MAX_BYTES];
+    short samples[2*MAX_BYTES], out[2*MAX_BYTES];
+    int i, n, iter, errors = 0;
+
+    adpcm_ima_amv_init_tables();
+    srandom(0);
+
+    for (iter = 0; iter < 2000; iter++) {
+        n = random() % MAX_BYTES;
+
+        /* decoder */
+        for (i = 0; i < n; i++)
+            buf[i] = random();
+        ref.predictor  = fast.predictor  = (int16_t)random();
+        ref.step_index = fast.step_index = random() % 89;
+        for (i = 0; i < n; i++) {
+            samples[2*i  ] = adpcm_ima_expand_nibble(&ref, buf[i] >> 4  , 3);
+            samples[2*i+1] = adpcm_ima_expand_nibble(&ref, buf[i] & 0x0F, 3);
+        }
+        adpcm_ima_amv_expand(&fast, buf, n, out);
+        if (memcmp(samples, out, 4*n) || ref.predictor != fast.predictor ||
+            ref.step_index != fast.step_index) {
+            printf("decoder mismatch, iteration %d, %d bytes\n", iter, n);
+            errors++;
+        }
+
+#ifdef CONFIG_ENCODERS
+        /* encoder, alternate noise and slowly varying signals */
+        for (i = 0; i < 2*n; i++)
+            samples[i] = iter & 1 ? (int16_t)random()
+                                  : (int16_t)(i * (iter % 97) * 31);
+        ref.prev_sample = fast.prev_sample = samples[0];
+        ref.step_index  = fast.step_index  = random() % 89;
+        for (i = 0; i < n; i++) {
+            int nibble = adpcm_ima_compress_sample(&ref, samples[2*i]) << 4;
+            out[i] = nibble | adpcm_ima_compress_sample(&ref, samples[2*i+1]);
+        }
+        adpcm_ima_amv_compress(&fast, samples, buf, n);
+        for (i = 0; i < n; i++)
+            if (out[i] != buf[i])
+                break;
+        if (i < n || ref.prev_sample != fast.prev_sample ||
+            ref.step_index != fast.step_index) {
+            printf("encoder mismatch, iteration %d, %d bytes\n", iter, n);
+            errors++;
+        }
+#endif
+    }
+
+    printf("adpcm_ima_amv: %s\n", errors ? "FAILED" : "OK");
+    return !!errors;
+}
+#endif /* TEST */
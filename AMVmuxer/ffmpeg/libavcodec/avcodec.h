@@ -420,6 +420,7 @@ typedef struct RcOverride{
 #define CODEC_FLAG2_SKIP_RD       0x00004000 ///< RD optimal MB level residual skipping
 #define CODEC_FLAG2_CHUNKS        0x00008000 ///< Input bitstream might be truncated at a packet boundaries instead of only at frame boundaries.
 #define CODEC_FLAG2_NON_LINEAR_QUANT 0x00010000 ///< Use MPEG-2 nonlinear quantizer.
+#define CODEC_FLAG2_FRAME_THREADS 0x00020000 ///< Encode thread_count whole frames in parallel instead of slices (AMV).
 
 /* Unsupported options :
  *              Syntax Arithmetic coding (SAC)
@@ -2141,6 +2142,14 @@ typedef struct AVCodecContext {
      * - decoding: Set by user.
      */
     int request_channels;
+
+    /**
+     * maximal size of a coded frame in bytes, 0 for no limit
+     * AC coefficients are dropped from frames which would be larger (AMV).
+     * - encoding: Set by user.
+     * - decoding: unused
+     */
+    int max_frame_size;
 } AVCodecContext;
 
 /**
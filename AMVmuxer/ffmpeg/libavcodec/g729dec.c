@@ -71,8 +71,6 @@ static int ff_g729a_encoder_init(AVCodecContext * avctx)
 {
     G729Context *ctx=avctx->priv_data;
 
-    ctx->priv=g729a_encoder_init();
-
     if(avctx->channels!=1)
     {
         av_log(avctx, AV_LOG_ERROR, "Only one channel is suported\n");
@@ -86,6 +84,13 @@ static int ff_g729a_encoder_init(AVCodecContext * avctx)
         return -1;
     }
 
+    ctx->priv=g729a_encoder_init();
+    if(!ctx->priv){
+        /* reference library supports only one encoder at a time */
+        av_log(avctx, AV_LOG_ERROR, "Could not initialize G.729A encoder\n");
+        return -1;
+    }
+
     avctx->frame_size=formats[ctx->format].frame_size*8;
     avctx->block_align=avctx->frame_size;
 
@@ -115,6 +120,16 @@ static int ff_g729a_encode_frame(AVCodecContext *avctx,
 
     return (put_bits_count(&pb)+7)/8;
 }
+
+static int ff_g729a_encoder_close(AVCodecContext *avctx)
+{
+    G729Context *ctx=avctx->priv_data;
+
+    g729a_encoder_uninit(ctx->priv);
+    ctx->priv=NULL;
+    av_freep(&avctx->coded_frame);
+    return 0;
+}
 #endif //CONFIG_ENCODERS
 
 static int ff_g729a_decoder_init(AVCodecContext * avctx)
@@ -130,6 +145,11 @@ static int ff_g729a_decoder_init(AVCodecContext * avctx)
     }
 
     ctx->priv=g729a_decoder_init();
+    if(!ctx->priv){
+        /* reference library supports only one decoder at a time */
+        av_log(avctx, AV_LOG_ERROR, "Could not initialize G.729A decoder\n");
+        return -1;
+    }
 #ifdef DEBUG_DUMP
 ctx->f=fopen("test2.bit","wb");
 ctx->f2=fopen("test2.raw","wb");
@@ -151,38 +171,72 @@ static int ff_g729a_close(AVCodecContext *avctx)
     return 0;
 }
 
+/**
+ * \brief checks whether frame is all zero bits
+ *
+ * Such frame fails the pitch parity check, so no encoder produces it.
+ * Demuxers use it to mark frames missing from the stream.
+ */
+static int g729a_frame_lost(const uint8_t *buf, int size)
+{
+    while(size--)
+        if(*buf++)
+            return 0;
+    return 1;
+}
+
+/**
+ * Decodes all whole frames of packet (e.g. ACT demuxer emits whole chunks)
+ * as long as they fit into output buffer. Lost (all-zero) frames are
+ * concealed by the decoder.
+ */
 static int ff_g729a_decode_frame(AVCodecContext *avctx,
                              void *data, int *data_size,
                              uint8_t *buf, int buf_size)
 {
     G729Context *ctx=avctx->priv_data;
-    GetBitContext gb;
-    int i,j,k;
+    int i,j,k,n;
     int l_frame=formats[ctx->format].frame_size*8;
+    int frame_size=formats[ctx->format].frame_size;
+    int count;
     uint16_t serial[200];
+    short *out=data;
 
-    init_get_bits(&gb, buf, buf_size);
+    count=FFMIN(buf_size / frame_size,
+                  *data_size / (2*l_frame*formats[ctx->format].frames));
 
     *data_size=0;
-    for(j=0; j<formats[ctx->format].frames; j++){
-        int dst=0;
-        serial[dst++]=0x6b21;
-        serial[dst++]=80;
-        
-        for(i=0;i<FFMIN((200-2)/8, buf_size);i++)
-            for(k=0; k<8; k++){
-                serial[dst++]=get_bits1(&gb)?0x81:0x7f;
+    for(n=0; n<count; n++){
+        if(g729a_frame_lost(buf, frame_size)){
+            for(j=0; j<formats[ctx->format].frames; j++){
+                g729a_decode_lost_frame(ctx->priv, out, l_frame);
+                out+=l_frame;
+                *data_size+=2*l_frame;
             }
+            buf+=frame_size;
+            continue;
+        }
+        for(j=0; j<formats[ctx->format].frames; j++){
+            int dst=0;
+            serial[dst++]=0x6b21;
+            serial[dst++]=80;
+
+            for(i=0;i<FFMIN((200-2)/8, frame_size/formats[ctx->format].frames);i++, buf++)
+                for(k=7; k>=0; k--){
+                    serial[dst++]=(*buf>>k)&1?0x81:0x7f;
+                }
 #ifdef DEBUG_DUMP
-        fwrite(serial,sizeof(uint16_t),l_frame+2,ctx->f);
+            fwrite(serial,sizeof(uint16_t),l_frame+2,ctx->f);
 #endif
-        g729a_decode_frame(ctx->priv,serial, 0/*not used yet*/,(short*)data+j*l_frame, l_frame);
-        *data_size+=2*l_frame;
+            g729a_decode_frame(ctx->priv,serial, 0/*not used yet*/,out, l_frame);
+            out+=l_frame;
+            *data_size+=2*l_frame;
+        }
     }
 #ifdef DEBUG_DUMP
     fwrite(data,1,*data_size,ctx->f2);
 #endif
-    return buf_size;
+    return count ? count*frame_size : buf_size;
 }
 
 #ifdef CONFIG_ENCODERS
@@ -193,7 +247,7 @@ AVCodec g729a_encoder = {
     sizeof(G729Context),
     ff_g729a_encoder_init,
     ff_g729a_encode_frame,
-    ff_g729a_close,
+    ff_g729a_encoder_close,
 };
 #endif //CONFIG_ENCODERS
 
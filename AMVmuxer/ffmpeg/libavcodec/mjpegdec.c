@@ -38,6 +38,11 @@
 #include "mjpeg.h"
 #include "mjpegdec.h"
 #include "jpeglsdec.h"
+#include "simple_idct.h"
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
 
 
 static int build_vlc(VLC *vlc, const uint8_t *bits_table, const uint8_t *val_table,
@@ -73,6 +78,46 @@ static void build_basic_mjpeg_vlc(MJpegDecodeContext * s) {
               ff_mjpeg_val_ac_chrominance, 251, 0, 1);
 }
 
+static VLC static_vlcs[2][2];
+
+static void build_static_mjpeg_vlc(void)
+{
+    build_vlc(&static_vlcs[0][0], ff_mjpeg_bits_dc_luminance,
+              ff_mjpeg_val_dc_luminance, 12, 1, 0);
+    build_vlc(&static_vlcs[0][1], ff_mjpeg_bits_dc_chrominance,
+              ff_mjpeg_val_dc_chrominance, 12, 1, 0);
+    build_vlc(&static_vlcs[1][0], ff_mjpeg_bits_ac_luminance,
+              ff_mjpeg_val_ac_luminance, 251, 1, 1);
+    build_vlc(&static_vlcs[1][1], ff_mjpeg_bits_ac_chrominance,
+              ff_mjpeg_val_ac_chrominance, 251, 1, 1);
+}
+
+/**
+ * Uses basic tables built once and shared by all decoder instances.
+ * They are replaced by private copies before any DHT is applied.
+ */
+static void init_static_mjpeg_vlc(MJpegDecodeContext * s) {
+    int i, j;
+#ifdef HAVE_PTHREADS
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+    pthread_once(&once, build_static_mjpeg_vlc);
+#else
+    /* callers serialize avcodec_open() */
+    static int done = 0;
+
+    if (!done) {
+        build_static_mjpeg_vlc();
+        done = 1;
+    }
+#endif
+
+    for(i=0;i<2;i++)
+        for(j=0;j<2;j++)
+            s->vlcs[i][j] = static_vlcs[i][j];
+    s->static_vlcs = 1;
+}
+
 int ff_mjpeg_decode_init(AVCodecContext *avctx)
 {
     MJpegDecodeContext *s = avctx->priv_data;
@@ -86,7 +131,11 @@ int ff_mjpeg_decode_init(AVCodecContext *avctx)
     s->first_picture = 1;
     s->org_height = avctx->coded_height;
 
-    build_basic_mjpeg_vlc(s);
+    /* AMV always uses basic tables */
+    if (avctx->codec_id == CODEC_ID_AMV)
+        init_static_mjpeg_vlc(s);
+    else
+        build_basic_mjpeg_vlc(s);
 
     if (avctx->flags & CODEC_FLAG_EXTERN_HUFF)
     {
@@ -153,6 +202,12 @@ int ff_mjpeg_decode_dht(MJpegDecodeContext *s)
 
     len = get_bits(&s->gb, 16) - 2;
 
+    if (s->static_vlcs) {
+        memset(s->vlcs, 0, sizeof(s->vlcs));
+        build_basic_mjpeg_vlc(s);
+        s->static_vlcs = 0;
+    }
+
     while (len > 0) {
         if (len < 17)
             return -1;
@@ -372,11 +427,14 @@ static inline int mjpeg_decode_dc(MJpegDecodeContext *s, int dc_index)
         return 0;
 }
 
-/* decode block and dequantize */
+/**
+ * decode block and dequantize
+ * @return scan position of last coded coefficient, -1 on error
+ */
 static int decode_block(MJpegDecodeContext *s, DCTELEM *block,
                         int component, int dc_index, int ac_index, int16_t *quant_matrix)
 {
-    int code, i, j, level, val;
+    int code, i, j, level, val, last = 0;
 
     /* DC coef */
     val = mjpeg_decode_dc(s, dc_index);
@@ -415,6 +473,7 @@ static int decode_block(MJpegDecodeContext *s, DCTELEM *block,
                 if(i == 63){
                     j = s->scantable.permutated[63];
                     block[j] = level * quant_matrix[j];
+                    last = 63;
                     break;
                 }
                 av_log(s->avctx, AV_LOG_ERROR, "error count: %d\n", i);
@@ -422,11 +481,12 @@ static int decode_block(MJpegDecodeContext *s, DCTELEM *block,
             }
             j = s->scantable.permutated[i];
             block[j] = level * quant_matrix[j];
+            last = i;
         }
     }
     CLOSE_READER(re, &s->gb)}
 
-    return 0;
+    return last;
 }
 
 /* decode block and dequantize - progressive JPEG version */
@@ -657,22 +717,61 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor, int point
     return 0;
 }
 
+/**
+ * checks whether idct_put is one of the simple idct implementations, whose
+ * output the C DC-only and 4x4 reduced idcts reproduce.
+ */
+static int is_simple_idct(void (*idct_put)(uint8_t *dest, int line_size, DCTELEM *block))
+{
+#ifdef HAVE_MMX
+    if(idct_put == ff_simple_idct_put_mmx)
+        return 1;
+#endif
+    return idct_put == simple_idct_put;
+}
+
+/**
+ * moves the first 10 coefficients in zigzag order from their permuted
+ * positions to natural order, so that they lie in the top left 4x4 corner.
+ * Coefficient 0 is never permuted, so the DC-only case needs no fixup.
+ */
+static void unpermute_4x4(DCTELEM *block, const uint8_t *permutated)
+{
+    DCTELEM tmp[10];
+    int i;
+
+    for(i=0; i<10; i++){
+        tmp[i] = block[permutated[i]];
+        block[permutated[i]] = 0;
+    }
+    for(i=0; i<10; i++)
+        block[ff_zigzag_direct[i]] = tmp[i];
+}
+
 static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int ss, int se, int Ah, int Al){
     int i, mb_x, mb_y;
     int EOBRUN = 0;
     uint8_t* data[MAX_COMPONENTS];
     int linesize[MAX_COMPONENTS];
+    /* blocks with few coefficients get reduced idct */
+    const int sparse = !s->progressive && is_simple_idct(s->dsp.idct_put);
 
     if(Ah) return 0; /* TODO decode refinement planes too */
 
+    /* in baseline mode only coded coefficients are cleared after each block */
+    if(!s->progressive)
+        memset(s->block, 0, sizeof(s->block));
+
     for(i=0; i < nb_components; i++) {
         int c = s->comp_index[i];
         data[c] = s->picture.data[c];
         linesize[c]=s->linesize[c];
         if(s->avctx->codec->id==CODEC_ID_AMV) {
             //picture should be flipped upside-down for this codec
+            //first coded line is the last one of picture (scaled down by lowres)
+            int lines = s->v_scount[i] * (8 * s->mb_height -((s->height/s->v_max)&7));
             assert(!(s->avctx->flags & CODEC_FLAG_EMU_EDGE));
-            data[c] += (linesize[c] * (s->v_scount[i] * (8 * s->mb_height -((s->height/s->v_max)&7)) - 1 ));
+            data[c] += (linesize[c] * (-((-lines) >> s->avctx->lowres) - 1));
             linesize[c] *= -1;
         }
     }
@@ -684,7 +783,7 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int ss, i
 
             for(i=0;i<nb_components;i++) {
                 uint8_t *ptr;
-                int n, h, v, x, y, c, j;
+                int n, h, v, x, y, c, j, last = 63;
                 n = s->nb_blocks[i];
                 c = s->comp_index[i];
                 h = s->h_scount[i];
@@ -692,10 +791,11 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int ss, i
                 x = 0;
                 y = 0;
                 for(j=0;j<n;j++) {
-                    memset(s->block, 0, sizeof(s->block));
-                    if (!s->progressive && decode_block(s, s->block, i,
+                    if (s->progressive)
+                        memset(s->block, 0, sizeof(s->block));
+                    if (!s->progressive && (last = decode_block(s, s->block, i,
                                      s->dc_index[i], s->ac_index[i],
-                                     s->quant_matrixes[ s->quant_index[c] ]) < 0) {
+                                     s->quant_matrixes[ s->quant_index[c] ])) < 0) {
                         av_log(s->avctx, AV_LOG_ERROR, "error y=%d x=%d\n", mb_y, mb_x);
                         return -1;
                     }
@@ -712,10 +812,21 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int ss, i
                     if (s->interlaced && s->bottom_field)
                         ptr += linesize[c] >> 1;
 //av_log(NULL, AV_LOG_DEBUG, "%d %d %d %d %d %d %d %d \n", mb_x, mb_y, x, y, c, s->bottom_field, (v * mb_y + y) * 8, (h * mb_x + x) * 8);
-                    if(!s->progressive)
-                        s->dsp.idct_put(ptr, linesize[c], s->block);
-                    else
+                    if(s->progressive)
                         s->dsp.idct_add(ptr, linesize[c], s->block);
+                    else if(sparse && last == 0){
+                        simple_idct_put_dc(ptr, linesize[c], s->block);
+                        s->block[0] = 0;
+                    }else if(sparse && last < 10){
+                        if(s->dsp.idct_permutation_type != FF_NO_IDCT_PERM)
+                            unpermute_4x4(s->block, s->scantable.permutated);
+                        simple_idct_put_4x4(ptr, linesize[c], s->block);
+                        /* row pass of the 4x4 IDCT leaves data in the first four rows only */
+                        memset(&s->block[0], 0, 32*sizeof(*s->block));
+                    }else{
+                        s->dsp.idct_put(ptr, linesize[c], s->block);
+                        memset(s->block, 0, sizeof(s->block));
+                    }
                     if (++x == h) {
                         x = 0;
                         y++;
@@ -1346,9 +1457,11 @@ int ff_mjpeg_decode_end(AVCodecContext *avctx)
     av_free(s->buffer);
     av_free(s->qscale_table);
 
-    for(i=0;i<2;i++) {
-        for(j=0;j<4;j++)
-            free_vlc(&s->vlcs[i][j]);
+    if (!s->static_vlcs) {
+        for(i=0;i<2;i++) {
+            for(j=0;j<4;j++)
+                free_vlc(&s->vlcs[i][j]);
+        }
     }
     return 0;
 }
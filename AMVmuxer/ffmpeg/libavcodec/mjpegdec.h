@@ -46,6 +46,7 @@ typedef struct MJpegDecodeContext {
 
     int16_t quant_matrixes[4][64];
     VLC vlcs[2][4];
+    int static_vlcs;    ///< vlcs are shared static tables, must not be freed
     int qscale[4];      ///< quantizer scale calculated from quant_matrixes
 
     int org_height;  /* size given at codec init */
@@ -39,6 +39,10 @@
 #include "mjpeg.h"
 #include "mjpegenc.h"
 
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 /* use two quantizer tables (one for luminance and one for chrominance) */
 /* not yet working */
 #undef TWOMATRIXES
@@ -54,6 +58,7 @@ int ff_mjpeg_encode_init(MpegEncContext *s)
 
     s->min_qcoeff=-1023;
     s->max_qcoeff= 1023;
+    s->mjpeg_escape_rate= 1<<12; // conservative guess until the first frame is written
 
     /* build all the huffman tables */
     ff_mjpeg_build_huffman_codes(m->huff_size_dc_luminance,
@@ -313,6 +318,7 @@ static void escape_FF(MpegEncContext *s, int start)
     for(; i<size; i++){
         if(buf[i]==0xFF) ff_count++;
     }
+    s->mjpeg_escape_rate= size ? ((int64_t)ff_count<<16) / size : 0;
 
     if(ff_count==0) return;
 
@@ -449,26 +455,430 @@ void ff_mjpeg_encode_mb(MpegEncContext *s, DCTELEM block[6][64])
     }
 }
 
-// maximum over s->mjpeg_vsample[i]
-#define V_MAX 2
-int amv_encode_picture(AVCodecContext *avctx,
-                       unsigned char *buf, int buf_size, void *data)
+#define AMV_DROP_CLASSES (10*63) ///< magnitude classes (av_log2 of 1..1023) times AC scan positions
+
+/**
+ * Returns the class of an AC coefficient, coefficients of lower classes are
+ * dropped first: small magnitudes before large ones, and high frequencies
+ * before low ones within the same magnitude.
+ */
+static inline int amv_drop_class(int level, int i)
+{
+    return av_log2(level)*63 + 63 - i;
+}
+
+/**
+ * Counts the bits ff_mjpeg_encode_mb() would write for the quantized frame
+ * in coded_blocks.
+ * @param saved if not NULL, receives the bits of the coefficient codes of
+ *              each drop class
+ */
+static int amv_frame_bits(MpegEncContext *s, int saved[AMV_DROP_CLASSES])
+{
+    MJpegContext *m = s->mjpeg_ctx;
+    const uint8_t *perm = s->intra_scantable.permutated;
+    int blocks = s->chroma_format == CHROMA_420 ? 6 : 8;
+    int last_dc[3], bits = 0, mb_xy, n, i;
+
+    for(i=0; i<3; i++)
+        last_dc[i] = 128 << s->intra_dc_precision;
+    if(saved)
+        memset(saved, 0, AMV_DROP_CLASSES * sizeof(int));
+
+    for(mb_xy=0; mb_xy < s->mb_num; mb_xy++) {
+        /* the order of the chroma blocks does not matter, each component
+           is predicted from its own blocks only */
+        for(n=0; n<blocks; n++) {
+            DCTELEM *block = s->coded_blocks[mb_xy][n];
+            int last_index = s->coded_block_last_index[mb_xy][n];
+            int component = n < 4 ? 0 : (n&1) + 1;
+            uint8_t *huff_size_dc = n < 4 ? m->huff_size_dc_luminance : m->huff_size_dc_chrominance;
+            uint8_t *huff_size_ac = n < 4 ? m->huff_size_ac_luminance : m->huff_size_ac_chrominance;
+            int val, nbits, run = 0;
+
+            val = FFABS(block[0] - last_dc[component]);
+            last_dc[component] = block[0];
+            nbits = val ? av_log2_16bit(val) + 1 : 0;
+            bits += huff_size_dc[nbits] + nbits;
+
+            for(i=1; i<=last_index; i++) {
+                int level = block[perm[i]], code_bits;
+
+                if(!level) {
+                    run++;
+                    continue;
+                }
+                level = FFABS(level);
+                nbits = av_log2(level) + 1;
+                code_bits = (run >> 4) * huff_size_ac[0xf0] + huff_size_ac[((run & 15) << 4) | nbits] + nbits;
+                bits += code_bits;
+                if(saved)
+                    saved[amv_drop_class(level, i)] += code_bits;
+                run = 0;
+            }
+            if(last_index < 63 || run != 0)
+                bits += huff_size_ac[0];
+        }
+    }
+    return bits;
+}
+
+/**
+ * Drops all AC coefficients of classes up to drop from coded_blocks.
+ */
+static void amv_drop_coefficients(MpegEncContext *s, int drop)
+{
+    const uint8_t *perm = s->intra_scantable.permutated;
+    int blocks = s->chroma_format == CHROMA_420 ? 6 : 8;
+    int mb_xy, n, i;
+
+    for(mb_xy=0; mb_xy < s->mb_num; mb_xy++) {
+        for(n=0; n<blocks; n++) {
+            DCTELEM *block = s->coded_blocks[mb_xy][n];
+            int *last_index = &s->coded_block_last_index[mb_xy][n];
+
+            for(i=1; i<=*last_index; i++) {
+                int level = block[perm[i]];
+                if(level && amv_drop_class(FFABS(level), i) <= drop)
+                    block[perm[i]] = 0;
+            }
+            while(*last_index > 0 && !block[perm[*last_index]])
+                (*last_index)--;
+        }
+    }
+}
+
+/**
+ * Drops AC coefficients from the quantized AMV frame in coded_blocks until
+ * its entropy coded size, including escaped 0xFF bytes, is at most max_bits.
+ * AMV decoders assume fixed quantization tables, so this is the only way to
+ * make a frame smaller. The escapes can not be known before the frame is
+ * written, they are predicted from the share of 0xFF bytes in the previous
+ * frame with some headroom. The bits saved by dropping each class are estimated
+ * from the codes of its coefficients, which are collected in the same pass
+ * as the size of the frame. The classes needed to cover the excess are then
+ * dropped at once, the size is only counted again (nothing is encoded) and
+ * more classes are dropped if merged zero runs made the estimate too small.
+ */
+void ff_amv_limit_frame_size(MpegEncContext *s, int max_bits)
+{
+    int saved[AMV_DROP_CLASSES];
+    int bits, excess, drop = -1;
+    int escape_rate = s->mjpeg_escape_rate + (s->mjpeg_escape_rate >> 2) + (1 << 8);
+
+    max_bits = ((int64_t)max_bits << 16) / ((1 << 16) + escape_rate);
+    bits = amv_frame_bits(s, saved);
+    while(bits > max_bits && drop < AMV_DROP_CLASSES - 1) {
+        excess = bits - max_bits;
+        do {
+            excess -= saved[++drop];
+        } while(excess > 0 && drop < AMV_DROP_CLASSES - 1);
+
+        amv_drop_coefficients(s, drop);
+        bits = amv_frame_bits(s, saved);
+    }
+}
+
+#define AMV_SIZE_BINS 10
+
+/**
+ * Distribution of the sizes of coded AMV frames, reported when the encoder
+ * is closed if AVCodecContext.max_frame_size is set.
+ */
+typedef struct AMVSizeStats {
+    int frames;
+    int64_t total;
+    int min, max;
+    int count[AMV_SIZE_BINS + 1]; ///< frames per tenth of max_frame_size, the last entry counts frames over the limit
+} AMVSizeStats;
+
+static void amv_update_size_stats(AVCodecContext *avctx, AMVSizeStats *st, int size)
+{
+    int bin = (int64_t)size * AMV_SIZE_BINS / avctx->max_frame_size;
+
+    if(size > avctx->max_frame_size) {
+        av_log(avctx, AV_LOG_WARNING, "frame of %d bytes exceeds max_frame_size\n", size);
+        bin = AMV_SIZE_BINS;
+    } else if(bin == AMV_SIZE_BINS)
+        bin--;
+    st->count[bin]++;
+    if(!st->frames || size < st->min)
+        st->min = size;
+    if(size > st->max)
+        st->max = size;
+    st->total += size;
+    st->frames++;
+}
+
+static void amv_report_size_stats(AVCodecContext *avctx, AMVSizeStats *st)
+{
+    int i;
+
+    if(!st->frames)
+        return;
+    av_log(avctx, AV_LOG_INFO, "frame size: %d frames, min %d, avg %"PRId64", max %d bytes, %d over limit of %d\n",
+           st->frames, st->min, st->total / st->frames, st->max, st->count[AMV_SIZE_BINS], avctx->max_frame_size);
+    for(i=0; i<AMV_SIZE_BINS; i++)
+        av_log(avctx, AV_LOG_INFO, "frame size %3d%%-%3d%% of limit: %d\n",
+               i * 100 / AMV_SIZE_BINS, (i + 1) * 100 / AMV_SIZE_BINS, st->count[i]);
+}
+
+#ifdef HAVE_PTHREADS
+enum { AMV_FRAME_IDLE, AMV_FRAME_QUEUED, AMV_FRAME_DONE };
+
+/**
+ * One whole frame encoder instance of the AMV frame threading,
+ * with its own worker thread.
+ */
+typedef struct AMVFrameThread {
+    AVCodecContext *avctx;      ///< private context of this encoder instance
+    AVFrame picture;            ///< copy of the queued input frame
+    uint8_t *buf;               ///< bitstream of the last encoded frame
+    unsigned int buf_size;
+    int size;                   ///< size of the bitstream in buf, or -1 on error
+    int state;                  ///< AMV_FRAME_*, protected by AMVFrameThreadContext.lock
+    pthread_cond_t cond;        ///< signals changes of state
+    pthread_t worker;
+    struct AMVFrameThreadContext *f;
+} AMVFrameThread;
+
+/**
+ * AMV frames are intra only and coded with a fixed qscale, so every frame
+ * can be encoded by an independent MpegEncContext.
+ * The instances form a ring, each input frame is passed to the next one,
+ * whose worker starts to encode it at once. Once thread_count frames are in
+ * flight, the call waits for the oldest one and returns its packet, so the
+ * packets come out in input order with thread_count-1 frames of delay.
+ */
+typedef struct AMVFrameThreadContext {
+    AMVFrameThread *thread;
+    int count;                  ///< number of encoder instances
+    int workers;                ///< number of started worker threads
+    int next_input;             ///< instance of the next input frame
+    int next_output;            ///< instance of the oldest frame in flight
+    int in_flight;              ///< number of frames queued or encoded, not yet returned
+    int done;                   ///< workers must exit
+    int64_t frame_number;       ///< pts for input frames without one
+    pthread_mutex_t lock;
+} AMVFrameThreadContext;
+
+static void* attribute_align_arg amv_frame_worker(void *arg){
+    AMVFrameThread *t= arg;
+    AMVFrameThreadContext *f= t->f;
+
+    pthread_mutex_lock(&f->lock);
+    for(;;){
+        while(t->state != AMV_FRAME_QUEUED && !f->done)
+            pthread_cond_wait(&t->cond, &f->lock);
+        if(t->state != AMV_FRAME_QUEUED)
+            break;
+        pthread_mutex_unlock(&f->lock);
+
+        t->size= MPV_encode_picture(t->avctx, t->buf, t->buf_size, &t->picture);
+
+        pthread_mutex_lock(&f->lock);
+        t->state= AMV_FRAME_DONE;
+        pthread_cond_broadcast(&t->cond);
+    }
+    pthread_mutex_unlock(&f->lock);
+    return NULL;
+}
+#endif
+
+static int amv_encode_end(AVCodecContext *avctx);
+
+static int amv_init_size_stats(AVCodecContext *avctx)
 {
+    MpegEncContext *s = avctx->priv_data;
 
-    AVFrame* pic=data;
+    if(avctx->max_frame_size && !(s->amv_size_stats= av_mallocz(sizeof(AMVSizeStats))))
+        return -1;
+    return 0;
+}
+
+static int amv_encode_init(AVCodecContext *avctx)
+{
+#ifdef HAVE_PTHREADS
     MpegEncContext *s = avctx->priv_data;
+    AMVFrameThreadContext *f;
     int i;
+#endif
+
+    if(avctx->thread_count <= 1 || !(avctx->flags2 & CODEC_FLAG2_FRAME_THREADS)){
+        if(MPV_encode_init(avctx) < 0)
+            return -1;
+        return amv_init_size_stats(avctx);
+    }
 
-    //CODEC_FLAG_EMU_EDGE have to be cleared
-    if(s->avctx->flags & CODEC_FLAG_EMU_EDGE)
+#ifdef HAVE_PTHREADS
+    if(avctx->flags & (CODEC_FLAG_PASS1 | CODEC_FLAG_PASS2)){
+        av_log(avctx, AV_LOG_ERROR, "2 pass encoding is not supported with frame threads\n");
         return -1;
+    }
 
-    //picture should be flipped upside-down
-    for(i=0; i < 3; i++) {
-        pic->data[i] += (pic->linesize[i] * (s->mjpeg_vsample[i] * (8 * s->mb_height -((s->height/V_MAX)&7)) - 1 ));
-        pic->linesize[i] *= -1;
+    f= s->amv_frame_threads= av_mallocz(sizeof(AMVFrameThreadContext));
+    if(!f)
+        return -1;
+    pthread_mutex_init(&f->lock, NULL);
+    f->count= avctx->thread_count;
+    f->thread= av_mallocz(f->count * sizeof(*f->thread));
+    if(!f->thread)
+        goto fail;
+
+    for(i=0; i<f->count; i++){
+        AMVFrameThread *t= &f->thread[i];
+        AVCodecContext *c;
+
+        t->f= f;
+        pthread_cond_init(&t->cond, NULL);
+        c= t->avctx= av_malloc(sizeof(AVCodecContext));
+        if(!c)
+            goto fail;
+        *c= *avctx;
+        c->priv_data= av_mallocz(sizeof(MpegEncContext));
+        c->thread_count= 1;
+        c->thread_opaque= NULL;
+        c->execute= avcodec_default_execute;
+        c->coded_frame= NULL;
+        c->flags2&= ~CODEC_FLAG2_FRAME_THREADS;
+        c->extradata= NULL;
+        c->extradata_size= 0;
+        if(!c->priv_data || MPV_encode_init(c) < 0)
+            goto fail;
+        if(avpicture_alloc((AVPicture*)&t->picture, avctx->pix_fmt, avctx->width, avctx->height) < 0)
+            goto fail;
     }
-    return MPV_encode_picture(avctx,buf, buf_size, pic);
+    for(f->workers=0; f->workers<f->count; f->workers++)
+        if(pthread_create(&f->thread[f->workers].worker, NULL, amv_frame_worker, &f->thread[f->workers]))
+            goto fail;
+
+    /* MPV_encode_init() may have reduced the timebase */
+    avctx->time_base  = f->thread[0].avctx->time_base;
+    avctx->coded_frame= f->thread[0].avctx->coded_frame;
+    if(amv_init_size_stats(avctx) < 0)
+        goto fail;
+    return 0;
+fail:
+    amv_encode_end(avctx);
+    return -1;
+#else
+    av_log(avctx, AV_LOG_ERROR, "frame threads need pthreads\n");
+    return -1;
+#endif
+}
+
+static int amv_encode_picture(AVCodecContext *avctx,
+                              unsigned char *buf, int buf_size, void *data)
+{
+    MpegEncContext *s = avctx->priv_data;
+    AVFrame *pic= data;
+#ifdef HAVE_PTHREADS
+    AMVFrameThreadContext *f= s->amv_frame_threads;
+    AMVFrameThread *t;
+    int i, size;
+#endif
+
+#ifdef HAVE_PTHREADS
+    if(!f)
+#endif
+    {
+        int size= MPV_encode_picture(avctx, buf, buf_size, pic);
+        if(s->amv_size_stats && size > 0)
+            amv_update_size_stats(avctx, s->amv_size_stats, size);
+        return size;
+    }
+
+#ifdef HAVE_PTHREADS
+    if(pic){
+        /* the instance of the packet returned two calls ago is idle */
+        t= &f->thread[f->next_input];
+        assert(t->state == AMV_FRAME_IDLE);
+        av_picture_copy((AVPicture*)&t->picture, (AVPicture*)pic, avctx->pix_fmt, avctx->width, avctx->height);
+        t->picture.pts      = pic->pts != AV_NOPTS_VALUE ? pic->pts : f->frame_number;
+        t->picture.quality  = pic->quality;
+        t->picture.pict_type= pic->pict_type;
+        f->frame_number++;
+        t->buf= av_fast_realloc(t->buf, &t->buf_size, buf_size);
+        if(!t->buf)
+            return -1;
+
+        pthread_mutex_lock(&f->lock);
+        t->state= AMV_FRAME_QUEUED;
+        pthread_cond_broadcast(&t->cond);
+        pthread_mutex_unlock(&f->lock);
+        f->next_input= (f->next_input + 1) % f->count;
+        f->in_flight++;
+    }
+
+    if(f->in_flight < f->count && (pic || !f->in_flight))
+        return 0;
+
+    t= &f->thread[f->next_output];
+    pthread_mutex_lock(&f->lock);
+    while(t->state != AMV_FRAME_DONE)
+        pthread_cond_wait(&t->cond, &f->lock);
+    t->state= AMV_FRAME_IDLE;
+    pthread_mutex_unlock(&f->lock);
+    f->next_output= (f->next_output + 1) % f->count;
+    f->in_flight--;
+
+    size= t->size;
+    if(size < 0 || size > buf_size)
+        return -1;
+    memcpy(buf, t->buf, size);
+    avctx->coded_frame= t->avctx->coded_frame;
+    for(i=0; i<4; i++)
+        avctx->error[i] += avctx->coded_frame->error[i];
+    if(s->amv_size_stats)
+        amv_update_size_stats(avctx, s->amv_size_stats, size);
+    return size;
+#endif
+}
+
+static int amv_encode_end(AVCodecContext *avctx)
+{
+    MpegEncContext *s = avctx->priv_data;
+#ifdef HAVE_PTHREADS
+    AMVFrameThreadContext *f= s->amv_frame_threads;
+    int i;
+#endif
+
+    if(s->amv_size_stats){
+        amv_report_size_stats(avctx, s->amv_size_stats);
+        av_freep(&s->amv_size_stats);
+    }
+#ifdef HAVE_PTHREADS
+    if(!f)
+#endif
+        return MPV_encode_end(avctx);
+
+#ifdef HAVE_PTHREADS
+    pthread_mutex_lock(&f->lock);
+    f->done= 1;
+    for(i=0; i<f->workers; i++)
+        pthread_cond_broadcast(&f->thread[i].cond);
+    pthread_mutex_unlock(&f->lock);
+    for(i=0; i<f->workers; i++)
+        pthread_join(f->thread[i].worker, NULL);
+
+    for(i=0; f->thread && i<f->count; i++){
+        AMVFrameThread *t= &f->thread[i];
+        if(t->avctx){
+            if(t->avctx->coded_frame)
+                MPV_encode_end(t->avctx);
+            av_freep(&t->avctx->priv_data);
+            av_freep(&t->avctx);
+        }
+        avpicture_free((AVPicture*)&t->picture);
+        av_freep(&t->buf);
+        pthread_cond_destroy(&t->cond);
+    }
+    pthread_mutex_destroy(&f->lock);
+    av_freep(&f->thread);
+    av_freep(&s->amv_frame_threads);
+    avctx->coded_frame= NULL;
+    return 0;
+#endif
 }
 
 AVCodec mjpeg_encoder = {
@@ -487,8 +897,9 @@ AVCodec amv_encoder = {
     CODEC_TYPE_VIDEO,
     CODEC_ID_AMV,
     sizeof(MpegEncContext),
-    MPV_encode_init,
+    amv_encode_init,
     amv_encode_picture,
-    MPV_encode_end,
+    amv_encode_end,
+    .capabilities= CODEC_CAP_DELAY,
     .pix_fmts= (enum PixelFormat[]){PIX_FMT_YUVJ420P, PIX_FMT_YUVJ422P, -1},
 };
@@ -56,5 +56,6 @@ void ff_mjpeg_encode_stuffing(PutBitContext *pbc);
 void ff_mjpeg_encode_dc(MpegEncContext *s, int val,
                         uint8_t *huff_size, uint16_t *huff_code);
 void ff_mjpeg_encode_mb(MpegEncContext *s, DCTELEM block[6][64]);
+void ff_amv_limit_frame_size(MpegEncContext *s, int max_bits);
 
 #endif /* FFMPEG_MJPEGENC_H */
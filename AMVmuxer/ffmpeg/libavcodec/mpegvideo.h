@@ -590,6 +590,9 @@ typedef struct MpegEncContext {
     struct MJpegContext *mjpeg_ctx;
     int mjpeg_vsample[3];       ///< vertical sampling factors, default = {2, 1, 1}
     int mjpeg_hsample[3];       ///< horizontal sampling factors, default = {2, 1, 1}
+    int mjpeg_escape_rate;      ///< escaped 0xFF bytes of the last frame per 65536 bytes of scan data
+    struct AMVFrameThreadContext *amv_frame_threads; ///< whole frame encoder instances, see CODEC_FLAG2_FRAME_THREADS
+    struct AMVSizeStats *amv_size_stats; ///< distribution of coded frame sizes, see AVCodecContext.max_frame_size
 
     /* MSMPEG4 specific */
     int mv_table_index;
@@ -658,6 +661,8 @@ typedef struct MpegEncContext {
 
     DCTELEM (*block)[64]; ///< points to one of the following blocks
     DCTELEM (*blocks)[8][64]; // for HQ mode we need to keep the best block
+    DCTELEM (*coded_blocks)[8][64];   ///< quantized blocks of the whole frame, entropy coded after all slice threads finished (AMV)
+    int (*coded_block_last_index)[8]; ///< block_last_index of coded_blocks
     int (*decode_mb)(struct MpegEncContext *s, DCTELEM block[6][64]); // used by some codecs to avoid a switch()
 #define SLICE_OK         0
 #define SLICE_ERROR     -1
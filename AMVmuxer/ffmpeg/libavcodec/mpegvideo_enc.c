@@ -450,12 +450,14 @@ int MPV_encode_init(AVCodecContext *avctx)
 
     if(s->avctx->thread_count > 1 && s->codec_id != CODEC_ID_MPEG4
        && s->codec_id != CODEC_ID_MPEG1VIDEO && s->codec_id != CODEC_ID_MPEG2VIDEO
+       && s->codec_id != CODEC_ID_AMV
        && (s->codec_id != CODEC_ID_H263P || !(s->flags & CODEC_FLAG_H263P_SLICE_STRUCT))){
         av_log(avctx, AV_LOG_ERROR, "multi threaded encoding not supported by codec\n");
         return -1;
     }
 
-    if(s->avctx->thread_count > 1)
+    /* AMV has no restart markers, slice threads only do DCT and quantization */
+    if(s->avctx->thread_count > 1 && s->codec_id != CODEC_ID_AMV)
         s->rtp_mode= 1;
 
     if(!avctx->time_base.den || !avctx->time_base.num){
@@ -731,6 +733,18 @@ int MPV_encode_init(AVCodecContext *avctx)
                        s->inter_matrix, s->inter_quant_bias, avctx->qmin, 31, 0);
     }
 
+    if(avctx->max_frame_size && s->codec_id != CODEC_ID_AMV){
+        av_log(avctx, AV_LOG_ERROR, "max_frame_size is only supported for AMV\n");
+        return -1;
+    }
+
+    if(s->codec_id == CODEC_ID_AMV && (s->avctx->thread_count > 1 || s->avctx->max_frame_size)){
+        s->coded_blocks          = av_mallocz(s->mb_num * sizeof(*s->coded_blocks));
+        s->coded_block_last_index= av_mallocz(s->mb_num * sizeof(*s->coded_block_last_index));
+        if(!s->coded_blocks || !s->coded_block_last_index)
+            return -1;
+    }
+
     if(ff_rate_control_init(s) < 0)
         return -1;
 
@@ -743,6 +757,9 @@ int MPV_encode_end(AVCodecContext *avctx)
 
     ff_rate_control_uninit(s);
 
+    av_freep(&s->coded_blocks);
+    av_freep(&s->coded_block_last_index);
+
     MPV_common_end(s);
     if ((ENABLE_MJPEG_ENCODER || ENABLE_LJPEG_ENCODER) && s->out_format == FMT_MJPEG)
         ff_mjpeg_encode_close(s);
@@ -786,6 +803,16 @@ static int get_intra_count(MpegEncContext *s, uint8_t *src, uint8_t *ref, int st
 }
 
 
+/**
+ * Returns 1 if the reconstruction must not be written into the input picture.
+ * AMV reads its source rows bottom-up, so reconstructing in place would
+ * overwrite rows of macroblocks which are not coded yet.
+ */
+static int keep_input_picture(MpegEncContext *s){
+    return s->avctx->rc_buffer_size
+        || (s->codec_id == CODEC_ID_AMV && ((s->flags&CODEC_FLAG_PSNR) || s->avctx->mb_decision == FF_MB_DECISION_RD));
+}
+
 static int load_input_picture(MpegEncContext *s, AVFrame *pic_arg){
     AVFrame *pic=NULL;
     int64_t pts;
@@ -864,7 +891,7 @@ static int load_input_picture(MpegEncContext *s, AVFrame *pic_arg){
                 uint8_t *src= pic_arg->data[i];
                 uint8_t *dst= pic->data[i];
 
-                if(!s->avctx->rc_buffer_size)
+                if(!keep_input_picture(s))
                     dst +=INPLACE_OFFSET;
 
                 if(src_stride==dst_stride)
@@ -1163,7 +1190,7 @@ no_output_pic:
 
         copy_picture(&s->new_picture, s->reordered_input_picture[0]);
 
-        if(s->reordered_input_picture[0]->type == FF_BUFFER_TYPE_SHARED || s->avctx->rc_buffer_size){
+        if(s->reordered_input_picture[0]->type == FF_BUFFER_TYPE_SHARED || keep_input_picture(s)){
             // input is a shared pix, so we can't modifiy it -> alloc a new one & ensure that the shared one is reuseable
 
             int i= ff_find_unused_picture(s, 0);
@@ -1218,6 +1245,9 @@ int MPV_encode_picture(AVCodecContext *avctx,
 
         init_put_bits(&s->thread_context[i]->pb, start, end - start);
     }
+    /* the whole frame is entropy coded by the main context */
+    if(s->coded_blocks)
+        init_put_bits(&s->pb, buf, buf_size);
 
     s->picture_in_gop_number++;
 
@@ -1454,6 +1484,72 @@ static void get_vissual_weight(int16_t *weight, uint8_t *ptr, int stride){
     }
 }
 
+/**
+ * Copies one block of an AMV source plane into dst.
+ * AMV pictures are coded upside-down, row r of the coded picture is row
+ * vsample*(8*mb_height - ((height/2)&7)) - 1 - r of the input picture.
+ * The rows are kept in memory order (last coded row first), rows and
+ * columns outside of the picture are replaced by the nearest edge pixels.
+ */
+static void amv_get_block_rows(MpegEncContext *s, uint8_t *dst, int dst_stride,
+                               int plane, int x, int y, int w, int h){
+    const int stride = plane ? s->uvlinesize : s->linesize;
+    const int width  = s->width  >> (plane ? s->chroma_x_shift : 0);
+    const int height = s->height >> (plane ? s->chroma_y_shift : 0);
+    const int rows   = s->mjpeg_vsample[plane] * (8 * s->mb_height - ((s->height/2)&7));
+    const int n      = FFMIN(w, width - x);
+    int i;
+
+    for(i=h-1; i>=0; i--){
+        int src_y= av_clip(rows - 1 - FFMIN(y + i, height - 1), 0, height - 1);
+        uint8_t *src= s->new_picture.data[plane] + src_y*stride + x;
+
+        memcpy(dst + (h-1-i)*dst_stride, src, n);
+        if(n < w)
+            memset(dst + (h-1-i)*dst_stride + n, src[n-1], w - n);
+    }
+}
+
+/**
+ * Returns the 8 source rows of the first coded block row of one block of
+ * an AMV source plane, in memory order: the DCT reads them top-down and
+ * amv_flip_block() turns the coefficients upside-down. The rows of a
+ * second block row (h == 16) are the 8 rows above them. Blocks inside the
+ * picture are read in place, others are copied into buf by
+ * amv_get_block_rows().
+ * @param wrap set to the stride of the returned rows
+ */
+static uint8_t *amv_block_rows(MpegEncContext *s, uint8_t *buf, int buf_stride, int *wrap,
+                               int plane, int x, int y, int w, int h){
+    const int stride = plane ? s->uvlinesize : s->linesize;
+    const int width  = s->width  >> (plane ? s->chroma_x_shift : 0);
+    const int height = s->height >> (plane ? s->chroma_y_shift : 0);
+    const int rows   = s->mjpeg_vsample[plane] * (8 * s->mb_height - ((s->height/2)&7));
+
+    if(x + w <= width && y + h <= height && rows - 1 - y < height && rows - y - h >= 0){
+        *wrap= stride;
+        return s->new_picture.data[plane] + (rows - 8 - y)*stride + x;
+    }
+    amv_get_block_rows(s, buf, buf_stride, plane, x, y, w, h);
+    *wrap= buf_stride;
+    return buf + (h - 8)*buf_stride;
+}
+
+/**
+ * Turns the quantized coefficients of a block read in memory order into
+ * those of the upside-down block: vertically odd basis functions change
+ * their sign.
+ */
+static void amv_flip_block(MpegEncContext *s, DCTELEM *block, int last_index){
+    const uint8_t *scantable= s->intra_scantable.scantable;
+    const uint8_t *permutated= s->intra_scantable.permutated;
+    int i;
+
+    for(i=1; i<=last_index; i++)
+        if(scantable[i] & 8)
+            block[permutated[i]]= -block[permutated[i]];
+}
+
 static av_always_inline void encode_mb_internal(MpegEncContext *s, int motion_x, int motion_y, int mb_block_height, int mb_block_count)
 {
     int16_t weight[8][64];
@@ -1504,7 +1600,13 @@ static av_always_inline void encode_mb_internal(MpegEncContext *s, int motion_x,
     ptr_cb = s->new_picture.data[1] + (mb_y * mb_block_height * wrap_c) + mb_x * 8;
     ptr_cr = s->new_picture.data[2] + (mb_y * mb_block_height * wrap_c) + mb_x * 8;
 
-    if(mb_x*16+16 > s->width || mb_y*16+16 > s->height){
+    if(s->codec_id == CODEC_ID_AMV){
+        uint8_t *ebuf= s->edge_emu_buffer + 32;
+        ptr_y = amv_block_rows(s, ebuf                 , s->linesize  , &wrap_y, 0, mb_x*16, mb_y*16, 16, 16);
+        ptr_cb= amv_block_rows(s, ebuf+18*s->linesize  , s->uvlinesize, &wrap_c, 1, mb_x*8, mb_y*mb_block_height, 8, mb_block_height);
+        ptr_cr= amv_block_rows(s, ebuf+18*s->linesize+8, s->uvlinesize, &wrap_c, 2, mb_x*8, mb_y*mb_block_height, 8, mb_block_height);
+        dct_offset= -wrap_y*8;
+    }else if(mb_x*16+16 > s->width || mb_y*16+16 > s->height){
         uint8_t *ebuf= s->edge_emu_buffer + 32;
         ff_emulated_edge_mc(ebuf            , ptr_y , wrap_y,16,16,mb_x*16,mb_y*16, s->width   , s->height);
         ptr_y= ebuf;
@@ -1685,6 +1787,10 @@ static av_always_inline void encode_mb_internal(MpegEncContext *s, int motion_x,
         }
     }
 
+    if(s->codec_id == CODEC_ID_AMV)
+        for(i=0; i<mb_block_count; i++)
+            amv_flip_block(s, s->block[i], s->block_last_index[i]);
+
     if((s->flags&CODEC_FLAG_GRAY) && s->mb_intra){
         s->block_last_index[4]=
         s->block_last_index[5]= 0;
@@ -1741,7 +1847,7 @@ static av_always_inline void encode_mb_internal(MpegEncContext *s, int motion_x,
         break;
     case CODEC_ID_MJPEG:
     case CODEC_ID_AMV:
-        if (ENABLE_MJPEG_ENCODER)
+        if (ENABLE_MJPEG_ENCODER && !s->coded_blocks)
             ff_mjpeg_encode_mb(s, s->block);
         break;
     default:
@@ -2001,6 +2107,37 @@ static void write_slice_end(MpegEncContext *s){
         s->misc_bits+= get_bits_diff(s);
 }
 
+/**
+ * Squared error between the source rows of amv_get_block_rows() (size x size,
+ * in memory order) and w x h pixels of the upside-down reconstruction.
+ */
+static int amv_sse(uint8_t *src, uint8_t *dst, int w, int h, int size, int stride){
+    uint32_t *sq = ff_squareTbl + 256;
+    int acc=0;
+    int x,y;
+
+    for(y=0; y<h; y++){
+        for(x=0; x<w; x++){
+            acc+= sq[src[x + (size-1-y)*stride] - dst[x + y*stride]];
+        }
+    }
+    return acc;
+}
+
+/**
+ * Adds the squared error of the current AMV macroblock to the picture error.
+ */
+static void amv_add_mb_error(MpegEncContext *s, int w, int h){
+    uint8_t *ebuf= s->edge_emu_buffer + 32;
+
+    amv_get_block_rows(s, ebuf                 , s->linesize  , 0, s->mb_x*16, s->mb_y*16, 16, 16);
+    amv_get_block_rows(s, ebuf+18*s->linesize  , s->uvlinesize, 1, s->mb_x*8 , s->mb_y*8 ,  8,  8);
+    amv_get_block_rows(s, ebuf+18*s->linesize+8, s->uvlinesize, 2, s->mb_x*8 , s->mb_y*8 ,  8,  8);
+    s->current_picture.error[0] += amv_sse(ebuf, s->dest[0], w, h, 16, s->linesize);
+    s->current_picture.error[1] += amv_sse(ebuf+18*s->linesize  , s->dest[1], w>>1, h>>1, 8, s->uvlinesize);
+    s->current_picture.error[2] += amv_sse(ebuf+18*s->linesize+8, s->dest[2], w>>1, h>>1, 8, s->uvlinesize);
+}
+
 static int encode_thread(AVCodecContext *c, void *arg){
     MpegEncContext *s= arg;
     int mb_x, mb_y, pdif = 0;
@@ -2594,15 +2731,19 @@ static int encode_thread(AVCodecContext *c, void *arg){
                 if(s->mb_x*16 + 16 > s->width ) w= s->width - s->mb_x*16;
                 if(s->mb_y*16 + 16 > s->height) h= s->height- s->mb_y*16;
 
-                s->current_picture.error[0] += sse(
-                    s, s->new_picture.data[0] + s->mb_x*16 + s->mb_y*s->linesize*16,
-                    s->dest[0], w, h, s->linesize);
-                s->current_picture.error[1] += sse(
-                    s, s->new_picture.data[1] + s->mb_x*8  + s->mb_y*s->uvlinesize*8,
-                    s->dest[1], w>>1, h>>1, s->uvlinesize);
-                s->current_picture.error[2] += sse(
-                    s, s->new_picture    .data[2] + s->mb_x*8  + s->mb_y*s->uvlinesize*8,
-                    s->dest[2], w>>1, h>>1, s->uvlinesize);
+                if(s->codec_id == CODEC_ID_AMV){
+                    amv_add_mb_error(s, w, h);
+                }else{
+                    s->current_picture.error[0] += sse(
+                        s, s->new_picture.data[0] + s->mb_x*16 + s->mb_y*s->linesize*16,
+                        s->dest[0], w, h, s->linesize);
+                    s->current_picture.error[1] += sse(
+                        s, s->new_picture.data[1] + s->mb_x*8  + s->mb_y*s->uvlinesize*8,
+                        s->dest[1], w>>1, h>>1, s->uvlinesize);
+                    s->current_picture.error[2] += sse(
+                        s, s->new_picture    .data[2] + s->mb_x*8  + s->mb_y*s->uvlinesize*8,
+                        s->dest[2], w>>1, h>>1, s->uvlinesize);
+                }
             }
             if(s->loop_filter){
                 if(ENABLE_ANY_H263_ENCODER && s->out_format == FMT_H263)
@@ -2630,6 +2771,102 @@ static int encode_thread(AVCodecContext *c, void *arg){
     return 0;
 }
 
+/**
+ * DCT and quantization of the slice rows of an AMV frame, in memory order of
+ * the source. The blocks are kept in coded_blocks, amv_encode_coded_blocks()
+ * writes them in coded order as there are no restart markers to split the
+ * scan between threads.
+ */
+static int amv_quantize_thread(AVCodecContext *c, void *arg){
+    MpegEncContext *s= arg;
+    int mb_x, mb_y;
+
+    ff_check_alignment();
+
+    s->mb_intra= 1;
+    s->mv_dir= 0;
+    s->mv_type= MV_TYPE_16X16;
+    /* bottom coded row first, the source is read in memory order */
+    for(mb_y= s->end_mb_y - 1; mb_y >= s->start_mb_y; mb_y--) {
+        s->mb_y= mb_y;
+
+        ff_set_qscale(s, s->qscale);
+        ff_init_block_index(s);
+
+        for(mb_x=0; mb_x < s->mb_width; mb_x++) {
+            const int mb_xy= mb_y*s->mb_width + mb_x;
+
+            s->mb_x= mb_x;
+            ff_update_block_index(s);
+
+            s->block= s->coded_blocks[mb_xy];
+            encode_mb(s, 0, 0);
+            memcpy(s->coded_block_last_index[mb_xy], s->block_last_index, sizeof(s->coded_block_last_index[0]));
+        }
+    }
+    s->block= s->blocks[0];
+
+    return 0;
+}
+
+/**
+ * Reconstruction (and PSNR) of the slice rows of an AMV frame from the
+ * blocks of amv_quantize_thread(), after amv_encode_coded_blocks() wrote them,
+ * as dequantization overwrites the blocks.
+ */
+static int amv_reconstruct_thread(AVCodecContext *c, void *arg){
+    MpegEncContext *s= arg;
+    int mb_x, mb_y, i;
+
+    for(i=0; i<3; i++)
+        s->current_picture.error[i] = 0;
+
+    s->mb_intra= 1;
+    s->mv_dir= 0;
+    s->mv_type= MV_TYPE_16X16;
+    for(mb_y= s->start_mb_y; mb_y < s->end_mb_y; mb_y++) {
+        s->mb_y= mb_y;
+
+        ff_set_qscale(s, s->qscale);
+        ff_init_block_index(s);
+
+        for(mb_x=0; mb_x < s->mb_width; mb_x++) {
+            const int mb_xy= mb_y*s->mb_width + mb_x;
+
+            s->mb_x= mb_x;
+            ff_update_block_index(s);
+
+            memcpy(s->block_last_index, s->coded_block_last_index[mb_xy], sizeof(s->coded_block_last_index[0]));
+            MPV_decode_mb(s, s->coded_blocks[mb_xy]);
+
+            if(s->flags&CODEC_FLAG_PSNR)
+                amv_add_mb_error(s, FFMIN(16, s->width - mb_x*16), FFMIN(16, s->height - mb_y*16));
+        }
+    }
+
+    return 0;
+}
+
+static int amv_encode_coded_blocks(MpegEncContext *s){
+    int mb_xy, i;
+
+    for(i=0; i<3; i++)
+        s->last_dc[i] = 128 << s->intra_dc_precision;
+
+    for(mb_xy=0; mb_xy < s->mb_num; mb_xy++) {
+        if(s->pb.buf_end - s->pb.buf - (put_bits_count(&s->pb)>>3) < MAX_MB_BYTES){
+            av_log(s->avctx, AV_LOG_ERROR, "encoded frame too large\n");
+            return -1;
+        }
+        memcpy(s->block_last_index, s->coded_block_last_index[mb_xy], sizeof(s->coded_block_last_index[0]));
+        if (ENABLE_MJPEG_ENCODER)
+            ff_mjpeg_encode_mb(s, s->coded_blocks[mb_xy]);
+    }
+    write_slice_end(s);
+
+    return 0;
+}
+
 #define MERGE(field) dst->field += src->field; src->field=0
 static void merge_context_after_me(MpegEncContext *dst, MpegEncContext *src){
     MERGE(me.scene_change_score);
@@ -2663,6 +2900,9 @@ static void merge_context_after_encode(MpegEncContext *dst, MpegEncContext *src)
         }
     }
 
+    if(dst->coded_blocks)
+        return;
+
     assert(put_bits_count(&src->pb) % 8 ==0);
     assert(put_bits_count(&dst->pb) % 8 ==0);
     ff_copy_bits(&dst->pb, src->pb.buf, put_bits_count(&src->pb));
@@ -2926,7 +3166,22 @@ static int encode_picture(MpegEncContext *s, int picture_number)
     for(i=1; i<s->avctx->thread_count; i++){
         update_duplicate_context_after_me(s->thread_context[i], s);
     }
-    s->avctx->execute(s->avctx, encode_thread, (void**)&(s->thread_context[0]), NULL, s->avctx->thread_count);
+    if(s->coded_blocks){
+        s->avctx->execute(s->avctx, amv_quantize_thread, (void**)&(s->thread_context[0]), NULL, s->avctx->thread_count);
+        /* header, stuffing and EOI are not part of the scan */
+        if(ENABLE_MJPEG_ENCODER && s->avctx->max_frame_size)
+            ff_amv_limit_frame_size(s, s->avctx->max_frame_size*8 - bits - 7 - 16);
+        if(amv_encode_coded_blocks(s) < 0)
+            return -1;
+        /* MPV_decode_mb() only reconstructs intra frames for these */
+        if((s->flags&CODEC_FLAG_PSNR) || s->avctx->mb_decision == FF_MB_DECISION_RD){
+            /* the matrix of this qscale is needed for dequantization */
+            for(i=1; i<s->avctx->thread_count; i++)
+                memcpy(s->thread_context[i]->intra_matrix, s->intra_matrix, sizeof(s->intra_matrix));
+            s->avctx->execute(s->avctx, amv_reconstruct_thread, (void**)&(s->thread_context[0]), NULL, s->avctx->thread_count);
+        }
+    }else
+        s->avctx->execute(s->avctx, encode_thread, (void**)&(s->thread_context[0]), NULL, s->avctx->thread_count);
     for(i=1; i<s->avctx->thread_count; i++){
         merge_context_after_encode(s, s->thread_context[i]);
     }
@@ -397,6 +397,83 @@ void simple_idct_put(uint8_t *dest, int line_size, DCTELEM *block)
         idctSparseColPut(dest + i, line_size, block + i);
 }
 
+/* column idct for blocks with only rows 0..3 nonzero, same output as
+   idctSparseColPut */
+static inline void idctSparseCol4Put (uint8_t *dest, int line_size,
+                                      DCTELEM * col)
+{
+        int a0, a1, a2, a3, b0, b1, b2, b3;
+        uint8_t *cm = ff_cropTbl + MAX_NEG_CROP;
+
+        a0 = W4 * (col[8*0] + ((1<<(COL_SHIFT-1))/W4));
+        a1 = a0;
+        a2 = a0;
+        a3 = a0;
+
+        a0 +=  + W2*col[8*2];
+        a1 +=  + W6*col[8*2];
+        a2 +=  - W6*col[8*2];
+        a3 +=  - W2*col[8*2];
+
+        MUL16(b0, W1, col[8*1]);
+        MUL16(b1, W3, col[8*1]);
+        MUL16(b2, W5, col[8*1]);
+        MUL16(b3, W7, col[8*1]);
+
+        MAC16(b0, + W3, col[8*3]);
+        MAC16(b1, - W7, col[8*3]);
+        MAC16(b2, - W1, col[8*3]);
+        MAC16(b3, - W5, col[8*3]);
+
+        dest[0] = cm[(a0 + b0) >> COL_SHIFT];
+        dest += line_size;
+        dest[0] = cm[(a1 + b1) >> COL_SHIFT];
+        dest += line_size;
+        dest[0] = cm[(a2 + b2) >> COL_SHIFT];
+        dest += line_size;
+        dest[0] = cm[(a3 + b3) >> COL_SHIFT];
+        dest += line_size;
+        dest[0] = cm[(a3 - b3) >> COL_SHIFT];
+        dest += line_size;
+        dest[0] = cm[(a2 - b2) >> COL_SHIFT];
+        dest += line_size;
+        dest[0] = cm[(a1 - b1) >> COL_SHIFT];
+        dest += line_size;
+        dest[0] = cm[(a0 - b0) >> COL_SHIFT];
+}
+
+/**
+ * simple_idct_put() for blocks with only DC coefficient,
+ * block is not modified.
+ */
+void simple_idct_put_dc(uint8_t *dest, int line_size, DCTELEM *block)
+{
+    uint8_t *cm = ff_cropTbl + MAX_NEG_CROP;
+    DCTELEM dc = block[0] << 3;
+    int i, v;
+
+    v = cm[(W4 * (dc + ((1<<(COL_SHIFT-1))/W4))) >> COL_SHIFT];
+    for(i=0; i<8; i++){
+        memset(dest, v, 8);
+        dest += line_size;
+    }
+}
+
+/**
+ * simple_idct_put() for blocks with nonzero coefficients only in top left
+ * 4x4 corner (first 10 coefficients in zigzag order),
+ * only rows 0..3 of block are modified.
+ */
+void simple_idct_put_4x4(uint8_t *dest, int line_size, DCTELEM *block)
+{
+    int i;
+    for(i=0; i<4; i++)
+        idctRowCondDC(block + i*8);
+
+    for(i=0; i<8; i++)
+        idctSparseCol4Put(dest + i, line_size, block + i);
+}
+
 void simple_idct_add(uint8_t *dest, int line_size, DCTELEM *block)
 {
     int i;
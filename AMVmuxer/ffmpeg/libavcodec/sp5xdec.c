@@ -29,15 +29,64 @@
 #include "mjpegdec.h"
 #include "sp5x.h"
 
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#define QSCALE 5 ///< fixed quantizer of SP5X and AMV
+
+/**
+ * AMV quantization matrices for each IDCT permutation type, built on first
+ * use and shared by all AMV decoder instances.
+ */
+static struct {
+    int16_t quant_matrixes[2][64];
+    int qscale[2];
+    int done;
+} amv_quant[FF_PARTTRANS_IDCT_PERM + 1];
+
+#ifdef HAVE_PTHREADS
+static pthread_mutex_t amv_quant_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static int amv_decode_init(AVCodecContext *avctx)
+{
+    MJpegDecodeContext *s = avctx->priv_data;
+    int i, j, index, perm;
+
+    if (ff_mjpeg_decode_init(avctx) < 0)
+        return -1;
+
+    /* same as ff_mjpeg_decode_dqt() on sp5x_data_dqt */
+    perm = s->dsp.idct_permutation_type;
+#ifdef HAVE_PTHREADS
+    pthread_mutex_lock(&amv_quant_lock);
+#endif
+    if (!amv_quant[perm].done) {
+        for (index = 0; index < 2; index++) {
+            for (i = 0; i < 64; i++) {
+                j = s->scantable.permutated[i];
+                amv_quant[perm].quant_matrixes[index][j] =
+                    sp5x_quant_table[(QSCALE * 2) + index][i];
+            }
+            amv_quant[perm].qscale[index] = FFMAX(
+                amv_quant[perm].quant_matrixes[index][s->scantable.permutated[1]],
+                amv_quant[perm].quant_matrixes[index][s->scantable.permutated[8]]) >> 1;
+        }
+        amv_quant[perm].done = 1;
+    }
+#ifdef HAVE_PTHREADS
+    pthread_mutex_unlock(&amv_quant_lock);
+#endif
+    return 0;
+}
 
 static int sp5x_decode_frame(AVCodecContext *avctx,
                               void *data, int *data_size,
                               uint8_t *buf, int buf_size)
 {
-#if 0
     MJpegDecodeContext *s = avctx->priv_data;
-#endif
-    const int qscale = 5;
+    const int qscale = QSCALE;
     uint8_t *buf_ptr, *buf_end, *recoded;
     int i = 0, j = 0;
 
@@ -56,13 +105,20 @@ static int sp5x_decode_frame(AVCodecContext *avctx,
     recoded[j++] = 0xFF;
     recoded[j++] = 0xD8;
 
-    memcpy(recoded+j, &sp5x_data_dqt[0], sizeof(sp5x_data_dqt));
-    memcpy(recoded+j+5, &sp5x_quant_table[qscale * 2], 64);
-    memcpy(recoded+j+70, &sp5x_quant_table[(qscale * 2) + 1], 64);
-    j += sizeof(sp5x_data_dqt);
-
-    memcpy(recoded+j, &sp5x_data_dht[0], sizeof(sp5x_data_dht));
-    j += sizeof(sp5x_data_dht);
+    if(avctx->codec_id==CODEC_ID_AMV){
+        /* tables are not sent, basic VLCs are set up at init */
+        const int perm = s->dsp.idct_permutation_type;
+        memcpy(s->quant_matrixes, amv_quant[perm].quant_matrixes, sizeof(amv_quant[perm].quant_matrixes));
+        memcpy(s->qscale, amv_quant[perm].qscale, sizeof(amv_quant[perm].qscale));
+    }else{
+        memcpy(recoded+j, &sp5x_data_dqt[0], sizeof(sp5x_data_dqt));
+        memcpy(recoded+j+5, &sp5x_quant_table[qscale * 2], 64);
+        memcpy(recoded+j+70, &sp5x_quant_table[(qscale * 2) + 1], 64);
+        j += sizeof(sp5x_data_dqt);
+
+        memcpy(recoded+j, &sp5x_data_dht[0], sizeof(sp5x_data_dht));
+        j += sizeof(sp5x_data_dht);
+    }
 
     memcpy(recoded+j, &sp5x_data_sof[0], sizeof(sp5x_data_sof));
     AV_WB16(recoded+j+5, avctx->coded_height);
@@ -205,7 +261,7 @@ AVCodec amv_decoder = {
     CODEC_TYPE_VIDEO,
     CODEC_ID_AMV,
     sizeof(MJpegDecodeContext),
-    ff_mjpeg_decode_init,
+    amv_decode_init,
     NULL,
     ff_mjpeg_decode_end,
     sp5x_decode_frame
@@ -755,7 +755,9 @@ static const AVOption options[]={
 {"timecode_frame_start", "GOP timecode frame start number, in non drop frame format", OFFSET(timecode_frame_start), FF_OPT_TYPE_INT, 0, 0, INT_MAX, V|E},
 {"drop_frame_timecode", NULL, 0, FF_OPT_TYPE_CONST, CODEC_FLAG2_DROP_FRAME_TIMECODE, INT_MIN, INT_MAX, V|E, "flags2"},
 {"non_linear_q", "use non linear quantizer", 0, FF_OPT_TYPE_CONST, CODEC_FLAG2_NON_LINEAR_QUANT, INT_MIN, INT_MAX, V|E, "flags2"},
+{"frame_threads", "encode whole frames in parallel, adds thread_count-1 frames of delay (AMV)", 0, FF_OPT_TYPE_CONST, CODEC_FLAG2_FRAME_THREADS, INT_MIN, INT_MAX, V|E, "flags2"},
 {"request_channels", "set desired number of audio channels", OFFSET(request_channels), FF_OPT_TYPE_INT, DEFAULT, 0, INT_MAX, A|D},
+{"max_frame_size", "maximal size of coded frames in bytes, AC coefficients are dropped to fit (AMV)", OFFSET(max_frame_size), FF_OPT_TYPE_INT, DEFAULT, 0, INT_MAX/8, V|E},
 {NULL},
 };
 
@@ -22,6 +22,9 @@
 #include "riff.h"
 
 #define CHUNK_SIZE 512
+#define DATA_OFFSET 512     ///< first chunk follows 512-byte header
+#define FRAME_DURATION 8    ///< 10ms frame in 1/800s time base units
+#define FRAME_BYTES 10      ///< size of G.729 frame written by muxer
 #define RIFF_TAG MKTAG('R','I','F','F')
 #define WAVE_TAG MKTAG('W','A','V','E')
 
@@ -35,99 +38,162 @@ typedef  struct{
 typedef struct{
     int bytes_left_in_chunk;
     ACTHeader hdr;
-    offset_t data;
-    offset_t riff;
     int frames;
+    int64_t frame;              ///< index of next frame returned by demuxer
+    int header_frames;          ///< number of frames written into header by muxer
+    int chunk_size;             ///< number of bytes buffered in chunk
+    uint8_t chunk[CHUNK_SIZE];  ///< chunk being filled by muxer
 } ACTContext;
 
+/**
+ * \brief file offset of given frame (frames are never split between chunks)
+ */
+static offset_t act_frame_pos(int64_t frame, int frame_size)
+{
+    int frames_per_chunk = CHUNK_SIZE / frame_size;
+
+    return DATA_OFFSET + frame / frames_per_chunk * CHUNK_SIZE +
+                         frame % frames_per_chunk * frame_size;
+}
+
+/**
+ * \brief number of whole frames stored before given file offset
+ */
+static int64_t act_pos_frame(offset_t pos, int frame_size)
+{
+    int frames_per_chunk = CHUNK_SIZE / frame_size;
+
+    pos -= DATA_OFFSET;
+    return pos / CHUNK_SIZE * frames_per_chunk +
+           FFMIN(pos % CHUNK_SIZE / frame_size, frames_per_chunk);
+}
+
 #ifdef CONFIG_MUXERS
-static int act_write_header(AVFormatContext *s)
+/**
+ * \brief writes RIFF and ACT headers for given number of frames
+ *
+ * Sizes of RIFF chunks and duration (header at offset 256) are known
+ * from the number of frames, because chunks are always padded.
+ */
+static void act_put_header(AVFormatContext *s, int frames)
 {
-    ACTContext* ctx = s->priv_data;
     ByteIOContext *pb = &s->pb;
     AVCodecContext *enc = s->streams[0]->codec;
-    offset_t tmp;
+    int frames_per_chunk = CHUNK_SIZE / FRAME_BYTES;
+    int data_size = (frames + frames_per_chunk - 1) / frames_per_chunk * CHUNK_SIZE;
+    int duration = frames * 10; // msec
     int i;
 
-    if (enc->codec_id != CODEC_ID_G729A)
-        return -1;
-
-    ctx->riff=start_tag(pb, "RIFF");       /* magic number */
-    put_buffer(pb, "WAVE",4);
-    tmp=start_tag(pb, "fmt ");
+    put_tag(pb, "RIFF");                   /* magic number */
+    put_le32(pb, DATA_OFFSET - 8 + data_size);
+    put_tag(pb, "WAVE");
+    put_tag(pb, "fmt ");
+    put_le32(pb, 16);
     put_le16(pb, 0x01);
     put_le16(pb, 0x01);
     put_le32(pb, enc->sample_rate);
     put_le32(pb, enc->sample_rate*2);
     put_le16(pb, 2);
     put_le16(pb, 16);
-    end_tag(pb, tmp);    
-    ctx->data=start_tag(pb, "data");
-    tmp=url_ftell(pb);
-    for(i=0;i<512-tmp;i++)
+    put_tag(pb, "data");
+    put_le32(pb, DATA_OFFSET - 44 + data_size);
+
+    for(i=44; i<256; i++)
         put_byte(pb, 0);
 
+    put_byte(pb, 0x84);
+    put_le16(pb, duration % 1000); //milliseconds
+    duration/=1000;
+    put_byte(pb, duration %60); //seconds
+    duration/=60;
+    put_le32(pb, duration); //minutes
+
+    for(i=256+8; i<DATA_OFFSET; i++)
+        put_byte(pb, 0);
+}
+
+/**
+ * Header is finalized in the trailer by seeking back. For outputs which can
+ * not seek (pipes) duration of the stream may be set in advance in
+ * AVFormatContext.duration, then header is written once with it.
+ */
+static int act_write_header(AVFormatContext *s)
+{
+    ACTContext* ctx = s->priv_data;
+    AVCodecContext *enc = s->streams[0]->codec;
+
+    if (enc->codec_id != CODEC_ID_G729A)
+        return -1;
+
+    ctx->header_frames = s->duration > 0 ? av_rescale(s->duration, 100, AV_TIME_BASE) : 0;
+    act_put_header(s, ctx->header_frames);
+
     ctx->frames=0;
-    put_flush_packet(pb);
+    ctx->chunk_size=0;
+    put_flush_packet(&s->pb);
     return 0;
 }
 
+/**
+ * \brief writes buffered chunk padded with zeros
+ */
+static void act_flush_chunk(AVFormatContext *s)
+{
+    ACTContext* ctx = s->priv_data;
+
+    memset(ctx->chunk + ctx->chunk_size, 0, CHUNK_SIZE - ctx->chunk_size);
+    put_buffer(&s->pb, ctx->chunk, CHUNK_SIZE);
+    ctx->chunk_size=0;
+}
+
+/**
+ * Packet may hold any number of frames. Each frame is stored as its odd
+ * bytes followed by even ones, chunk is written when no more frames fit.
+ */
 static int act_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
     ACTContext* ctx = s->priv_data;
-    uint8_t *data=pkt->data;
+    const uint8_t *data=pkt->data;
+    uint8_t *frame;
     int i;
 
-    if(!ctx->bytes_left_in_chunk)
-        ctx->bytes_left_in_chunk=CHUNK_SIZE;
-
-    put_byte(&s->pb, data[1]);
-    put_byte(&s->pb, data[3]);
-    put_byte(&s->pb, data[5]);
-    put_byte(&s->pb, data[7]);
-    put_byte(&s->pb, data[9]);
-    put_byte(&s->pb, data[0]);
-    put_byte(&s->pb, data[2]);
-    put_byte(&s->pb, data[4]);
-    put_byte(&s->pb, data[6]);
-    put_byte(&s->pb, data[8]);
-
-    ctx->bytes_left_in_chunk-=pkt->size;
-    
-    if(ctx->bytes_left_in_chunk<pkt->size)
-        for(; ctx->bytes_left_in_chunk; ctx->bytes_left_in_chunk--)
-            put_byte(&s->pb, 0);
+    for(; data + FRAME_BYTES <= pkt->data + pkt->size; data += FRAME_BYTES)
+    {
+        frame = ctx->chunk + ctx->chunk_size;
+        for(i=0; i<FRAME_BYTES/2; i++)
+        {
+            frame[i              ] = data[2*i+1];
+            frame[FRAME_BYTES/2+i] = data[2*i  ];
+        }
+        ctx->chunk_size += FRAME_BYTES;
+        ctx->frames++;
+
+        if(ctx->chunk_size + FRAME_BYTES > CHUNK_SIZE)
+            act_flush_chunk(s);
+    }
 
     put_flush_packet(&s->pb);
-    ctx->frames++;
     return 0;
 }
+
 static int act_write_trailer(AVFormatContext *s)
 {
     ACTContext* ctx = s->priv_data;
     ByteIOContext *pb = &s->pb;
-    AVCodecContext *enc = s->streams[0]->codec;
-    int duration;
-    offset_t tmp;
+    offset_t end;
 
-    tmp=url_ftell(pb);
-    tmp%=512;
-    for(; tmp<512; tmp++)
-        put_byte(pb, 0);
+    if(ctx->chunk_size)
+        act_flush_chunk(s);
 
-    end_tag(pb, ctx->data);
-    end_tag(pb, ctx->riff);
-    duration=av_rescale(ctx->frames, 1000*enc->frame_size, enc->sample_rate);
-av_log(s, AV_LOG_ERROR, "Duration %d\n", duration);
+    if(ctx->frames != ctx->header_frames && !url_is_streamed(pb))
+    {
+        end=url_ftell(pb);
+        url_fseek(pb, 0, SEEK_SET);
+        act_put_header(s, ctx->frames);
+        ctx->header_frames = ctx->frames;
+        url_fseek(pb, end, SEEK_SET);
+    }
 
-    url_fseek(pb, 256, SEEK_SET);
-    put_byte(pb, 0x84);
-    put_le16(pb, duration % 1000); //milliseconds
-    duration/=1000;
-    put_byte(pb, duration %60); //seconds
-    duration/=60;
-    put_le32(pb, duration); //minutes
-    
     put_flush_packet(pb);
     return 0;
 }
@@ -163,8 +229,13 @@ static int act_read_header(AVFormatContext *s,
     size=get_le32(pb);
     get_wav_header(pb, st->codec, size);
 
+    /* header fields are packed, they are read one by one */
     url_fseek(pb, 256, SEEK_SET);
-    if (get_buffer(pb, (char*)&ctx->hdr, sizeof(ctx->hdr))!=sizeof(ctx->hdr))
+    ctx->hdr.tag     = get_byte(pb);
+    ctx->hdr.msec    = get_le16(pb);
+    ctx->hdr.sec     = get_byte(pb);
+    ctx->hdr.minutes = get_le32(pb);
+    if (url_feof(pb))
         return AVERROR(EIO);
 
 
@@ -172,10 +243,23 @@ static int act_read_header(AVFormatContext *s,
     st->codec->codec_id=CODEC_ID_G729A;
     st->codec->frame_size=10;
 
-    st->duration=(ctx->hdr.minutes*60+ctx->hdr.sec)*100+ctx->hdr.msec/10;
-
     av_set_pts_info(st, 64, 1, 800);
 
+    /* the ACT muxer writes the exact duration, it is checked against the
+       file size (which also counts the zero padding of the last chunk):
+       header frames ending in the last chunk are all stored, ones past
+       the end of a truncated recording are returned zeroed (see
+       act_read_packet); headers of other writers which end earlier are
+       not trusted and the file size gives the number of frames */
+    ctx->frames = ((ctx->hdr.minutes*60 + ctx->hdr.sec)*1000 + ctx->hdr.msec) / 10;
+    if (!url_is_streamed(pb) && url_fsize(pb) > DATA_OFFSET) {
+        int64_t stored = act_pos_frame(url_fsize(pb), st->codec->frame_size);
+
+        if (ctx->frames <= stored - CHUNK_SIZE / st->codec->frame_size)
+            ctx->frames = stored;
+    }
+    st->duration = (int64_t)ctx->frames * FRAME_DURATION;
+
     if(st->codec->sample_rate!=8000 && st->codec->sample_rate!=4400)
     {
         av_log(s, AV_LOG_ERROR, "Sample rate %d is not supported\n", st->codec->sample_rate);
@@ -184,42 +268,76 @@ static int act_read_header(AVFormatContext *s,
 
 
     ctx->bytes_left_in_chunk=CHUNK_SIZE;
+    ctx->frame=0;
 
-    url_fseek(pb, 512, SEEK_SET);
+    url_fseek(pb, DATA_OFFSET, SEEK_SET);
     return 0;
 }
 
 
+/**
+ * Reads rest of current chunk as one packet.
+ *
+ * ACT stores each 10-byte frame as odd bytes of G.729 frame followed by even
+ * ones, they are swapped back in place over the whole packet.
+ *
+ * Reading stops after ctx->frames frames, so padding of the last chunk is
+ * not returned. Frames counted by the header but missing from the file
+ * (truncated recording) are returned zeroed. An all-zero frame fails the
+ * pitch parity check, so no encoder produces it, and the decoder conceals
+ * it as lost.
+ */
 static int act_read_packet(AVFormatContext *s,
                           AVPacket *pkt)
 {
     ACTContext* ctx = s->priv_data;
     ByteIOContext *pb = &s->pb;
-    uint8_t bFrame[22];
-    uint8_t *pkt_buf;
-    int i, bytes_read;
+    uint8_t tmp[22];
+    uint8_t *frame;
+    int i, frames, frames_read, lost, bytes_read;
     int frame_size=s->streams[0]->codec->frame_size;
-    
-    bytes_read = get_buffer(pb, bFrame, frame_size);
+    int half=frame_size>>1;
 
-    if(bytes_read != frame_size || av_new_packet(pkt, frame_size))
+    frames = ctx->bytes_left_in_chunk / frame_size;
+    if(ctx->frames > 0)
+        frames = FFMIN(frames, ctx->frames - ctx->frame);
+    if(frames <= 0)
         return AVERROR(EIO);
 
-    pkt_buf=(uint16_t*)pkt->data;
+    if(av_new_packet(pkt, frames * frame_size))
+        return AVERROR(ENOMEM);
 
-    pkt_buf[1]=bFrame[0];
-    pkt_buf[3]=bFrame[1];
-    pkt_buf[5]=bFrame[2];
-    pkt_buf[7]=bFrame[3];
-    pkt_buf[9]=bFrame[4];
-    pkt_buf[0]=bFrame[5];
-    pkt_buf[2]=bFrame[6];
-    pkt_buf[4]=bFrame[7];
-    pkt_buf[6]=bFrame[8];
-    pkt_buf[8]=bFrame[9];
+    bytes_read = get_buffer(pb, pkt->data, frames * frame_size);
+    frames_read = FFMAX(bytes_read, 0) / frame_size;
+    lost = 0;
+    if(frames_read < frames && ctx->frames > 0)
+    {
+        lost = frames - frames_read;
+        memset(pkt->data + frames_read * frame_size, 0, lost * frame_size);
+    }
+    frames = frames_read + lost;
+    if(!frames)
+    {
+        av_free_packet(pkt);
+        return AVERROR(EIO);
+    }
+    pkt->size = frames * frame_size;
 
-    ctx->bytes_left_in_chunk -= frame_size;
+    for(frame=pkt->data; frame<pkt->data+frames_read*frame_size; frame+=frame_size)
+    {
+        memcpy(tmp, frame, frame_size);
+        for(i=0; i<half; i++)
+        {
+            frame[2*i+1] = tmp[i];
+            frame[2*i  ] = tmp[half+i];
+        }
+    }
+
+    pkt->pts = ctx->frame * FRAME_DURATION;
+    pkt->duration = frames * FRAME_DURATION;
+    ctx->frame += frames;
 
+    ctx->bytes_left_in_chunk -= FFMAX(bytes_read, frames * frame_size);
     if(ctx->bytes_left_in_chunk < frame_size)
     {
         url_fskip(pb, ctx->bytes_left_in_chunk);
@@ -228,6 +346,38 @@ static int act_read_packet(AVFormatContext *s,
 
     return 0;
 }
+/**
+ * Seeks to frame by arithmetic: frames have fixed size and each chunk holds
+ * the same number of them.
+ */
+static int act_read_seek(AVFormatContext *s,
+                         int stream_index, int64_t timestamp, int flags)
+{
+    ACTContext* ctx = s->priv_data;
+    AVStream *st = s->streams[0];
+    int frame_size = st->codec->frame_size;
+    int64_t frame;
+    offset_t pos;
+
+    if (timestamp < 0)
+        timestamp = 0;
+    if (flags & AVSEEK_FLAG_BACKWARD)
+        frame = timestamp / FRAME_DURATION;
+    else
+        frame = (timestamp + FRAME_DURATION - 1) / FRAME_DURATION;
+    if (ctx->frames > 0)
+        frame = FFMIN(frame, ctx->frames);
+
+    pos = act_frame_pos(frame, frame_size);
+    if (url_fseek(&s->pb, pos, SEEK_SET) < 0)
+        return -1;
+
+    ctx->bytes_left_in_chunk = CHUNK_SIZE - (pos - DATA_OFFSET) % CHUNK_SIZE;
+    ctx->frame = frame;
+    st->cur_dts = frame * FRAME_DURATION;
+    return 0;
+}
+
 #ifdef CONFIG_MUXERS
 AVOutputFormat act_muxer = {
     "act",
@@ -249,5 +399,7 @@ AVInputFormat act_demuxer = {
     sizeof(ACTContext),
     act_probe,
     act_read_header,
-    act_read_packet
+    act_read_packet,
+    NULL,
+    act_read_seek,
 };
@@ -33,11 +33,20 @@
 typedef struct {
     offset_t riff_start, movi_list, odml_list;
     offset_t frames_hdr_all, frames_hdr_strm[MAX_STREAMS];
-    offset_t hours, minutes, seconds;
+    offset_t duration_hdr, byterate_hdr, buffer_hdr_all, buffer_hdr_strm[MAX_STREAMS];
     int audio_strm_length[MAX_STREAMS];
     int riff_id;
     int packet_count[MAX_STREAMS];
     int last_stream_index;
+    int64_t total_bytes;    ///< size of all chunks with their headers
+    int max_chunk;          ///< size of the largest chunk of all streams
+    int max_chunk_strm[MAX_STREAMS];
+    int64_t audio_chunks;   ///< number of audio chunks passed to the muxer
+    int header_frames;      ///< number of frames written into the header of streamed output, 0 if unknown
+    int dropped;            ///< packets of streamed output beyond header_frames
+    AVPacket last_frame;    ///< last video frame of streamed output, repeated to pad it
+    uint8_t *last_frame_buf; ///< copy of the last frame if its data was not owned by the packet
+    unsigned int last_frame_alloc;
 } AMVContext;
 
 static offset_t avi_start_new_riff(AMVContext *avi, ByteIOContext *pb,
@@ -69,6 +78,44 @@ static char* avi_stream2fourcc(char* tag, int index, enum CodecType type)
     return tag;
 }
 
+/**
+ * Returns the number of sample pairs (bytes of ADPCM data) of the audio
+ * chunks of the first n video frames.
+ * Each video frame has one audio chunk with the samples of its duration.
+ * Chunks hold whole bytes (two samples), the end of every chunk is the
+ * exact end of its frame rounded down to an even sample, so the rounding
+ * error does not accumulate.
+ */
+static int64_t amv_audio_pairs(AVFormatContext *s, int64_t n)
+{
+    int64_t b = (int64_t)s->streams[1]->codec->sample_rate * s->streams[0]->codec->time_base.num;
+    int64_t c = 2 * (int64_t)s->streams[0]->codec->time_base.den;
+
+    return av_rescale_rnd(n, b, c, AV_ROUND_DOWN);
+}
+
+/**
+ * Returns the number of samples of audio chunk n.
+ */
+static int amv_audio_chunk_samples(AVFormatContext *s, int64_t n)
+{
+    return 2 * (amv_audio_pairs(s, n + 1) - amv_audio_pairs(s, n));
+}
+
+/**
+ * Writes duration of nb_frames video frames, in seconds, minutes and hours.
+ */
+static void amv_put_duration(AVFormatContext *s, int nb_frames)
+{
+    ByteIOContext *pb = &s->pb;
+    AVRational time_base = s->streams[0]->codec->time_base;
+    int seconds = av_rescale(nb_frames, time_base.num, time_base.den);
+
+    put_byte(pb, seconds % 60);
+    put_byte(pb, seconds / 60 % 60);
+    put_le16(pb, seconds / 3600);
+}
+
 static int avi_write_counters(AVFormatContext* s, int riff_id)
 {
     ByteIOContext *pb = &s->pb;
@@ -90,29 +137,40 @@ static int avi_write_counters(AVFormatContext* s, int riff_id)
         }
         if(stream->codec_type == CODEC_TYPE_VIDEO)
             nb_frames = FFMAX(nb_frames, avi->packet_count[n]);
+        if(avi->buffer_hdr_strm[n]) {
+            url_fseek(pb, avi->buffer_hdr_strm[n], SEEK_SET);
+            put_le32(pb, avi->max_chunk_strm[n]);
+        }
     }
     if(riff_id == 1) {
         assert(avi->frames_hdr_all);
         url_fseek(pb, avi->frames_hdr_all, SEEK_SET);
         put_le32(pb, nb_frames);
-        
-        // HACK !
-        int duration_seconds = nb_frames/s->streams[0]->codec->time_base.den;
-        assert(avi->seconds);
-        url_fseek(pb, avi->seconds, SEEK_SET);
-        put_byte(pb,duration_seconds%60);
-        assert(avi->minutes);
-        url_fseek(pb, avi->minutes, SEEK_SET);
-        put_byte(pb,duration_seconds/60);
-        assert(avi->hours);
-        url_fseek(pb, avi->hours, SEEK_SET);
-        put_le16(pb,duration_seconds/3600);
+
+        if(nb_frames) {
+            AVRational time_base = s->streams[0]->codec->time_base;
+            url_fseek(pb, avi->byterate_hdr, SEEK_SET);
+            put_le32(pb, av_rescale(avi->total_bytes, time_base.den, (int64_t)nb_frames * time_base.num));
+        }
+        url_fseek(pb, avi->buffer_hdr_all, SEEK_SET);
+        put_le32(pb, avi->max_chunk);
+
+        assert(avi->duration_hdr);
+        url_fseek(pb, avi->duration_hdr, SEEK_SET);
+        amv_put_duration(s, nb_frames);
     }
     url_fseek(pb, file_size, SEEK_SET);
 
     return 0;
 }
 
+/**
+ * Counts and duration in the header are filled in the trailer by seeking
+ * back. For outputs which can not seek (pipes) the number of frames may be
+ * set in advance in nb_frames of the video stream or in
+ * AVFormatContext.duration, then the header is written once with it and
+ * the output is cut or padded to this length in the trailer.
+ */
 static int avi_write_header(AVFormatContext *s)
 {
     AMVContext *avi = s->priv_data;
@@ -141,13 +199,25 @@ static int avi_write_header(AVFormatContext *s)
     }
 
     nb_frames = 0;
+    if (url_is_streamed(pb)) {
+        AVRational time_base = s->streams[0]->codec->time_base;
+
+        if (s->streams[0]->nb_frames > 0)
+            nb_frames = s->streams[0]->nb_frames;
+        else if (s->duration > 0)
+            nb_frames = av_rescale(s->duration, time_base.den, (int64_t)AV_TIME_BASE * time_base.num);
+        else
+            av_log(s, AV_LOG_WARNING, "number of frames is unknown, header of streamed output will be incomplete\n");
+    }
+    avi->header_frames = nb_frames;
 
     if(video_enc){
         put_le32(pb, (uint32_t)(INT64_C(1000000) * video_enc->time_base.num / video_enc->time_base.den));
     } else {
         put_le32(pb, 0);
     }
-    put_le32(pb, bitrate / 8); /* XXX: not quite exact */
+    avi->byterate_hdr = url_ftell(pb);
+    put_le32(pb, bitrate / 8); /* exact rate is filled later if seekable */
     put_le32(pb, 0); /* padding */
     if (url_is_streamed(pb))
         put_le32(pb, AMVF_TRUSTCKTYPE | AMVF_ISINTERLEAVED); /* flags */
@@ -157,7 +227,8 @@ static int avi_write_header(AVFormatContext *s)
     put_le32(pb, nb_frames); /* nb frames, filled later */
     put_le32(pb, 0); /* initial frame */
     put_le32(pb, s->nb_streams); /* nb streams */
-    put_le32(pb, 1024 * 1024); /* suggested buffer size */
+    avi->buffer_hdr_all = url_ftell(pb);
+    put_le32(pb, 1024 * 1024); /* suggested buffer size, largest chunk is filled later if seekable */
     if(video_enc){
         put_le32(pb, video_enc->width);
         put_le32(pb, video_enc->height);
@@ -170,12 +241,8 @@ static int avi_write_header(AVFormatContext *s)
     put_le32(pb, 1); // This is always 1 in a real AMV
     put_le32(pb, 0); /* reserved */
     
-    avi->seconds = url_ftell(pb); /* remember this offset to fill later */
-    put_byte(pb,0);
-    avi->minutes = url_ftell(pb); /* remember this offset to fill later */
-    put_byte(pb,0);
-    avi->hours = url_ftell(pb); /* remember this offset to fill later */
-    put_le16(pb, 0);     // duration minutes (filled in later)
+    avi->duration_hdr = url_ftell(pb); /* remember this offset to fill later */
+    amv_put_duration(s, nb_frames);
 
     /* stream list */
     for(i=0;i<n;i++) {
@@ -213,13 +280,14 @@ static int avi_write_header(AVFormatContext *s)
 
         put_le32(pb, 0); /* start */
         avi->frames_hdr_strm[i] = url_ftell(pb); /* remember this offset to fill later */
-        if (url_is_streamed(pb))
+        if (url_is_streamed(pb) && !nb_frames)
             put_le32(pb, AMV_MAX_RIFF_SIZE); /* FIXME: this may be broken, but who cares */
         else
-            put_le32(pb, 0); /* length, XXX: filled later */
+            put_le32(pb, nb_frames); /* length (one chunk per frame), filled later if seekable */
 
-        /* suggested buffer size */ //FIXME set at the end to largest chunk
+        /* suggested buffer size, largest chunk is filled later if seekable */
         if(stream->codec_type == CODEC_TYPE_VIDEO) {
+            avi->buffer_hdr_strm[i] = url_ftell(pb);
             put_le32(pb, 1024 * 1024);
             put_le32(pb, -1); /* quality */
         } else if(stream->codec_type == CODEC_TYPE_AUDIO) {
@@ -269,20 +337,37 @@ static int avi_write_header(AVFormatContext *s)
 
     put_flush_packet(pb);
 
-    /*
-     HACK!!!
-     Set correct frame_size for audio stream
-    */
-    if(s->nb_streams > 1 && s->streams[1]->codec->codec_type == CODEC_TYPE_AUDIO) {
-	    s->streams[1]->codec->frame_size=av_rescale(
-		    s->streams[1]->codec->sample_rate,
-		    s->streams[0]->codec->time_base.num,
-		    s->streams[0]->codec->time_base.den);
-    }
+    /* the audio encoder codes exactly frame_size samples into each chunk,
+       request the first one, the others are requested as chunks arrive */
+    avi->audio_chunks = 0;
+    if(s->nb_streams > 1 && s->streams[1]->codec->codec_type == CODEC_TYPE_AUDIO)
+        s->streams[1]->codec->frame_size= amv_audio_chunk_samples(s, 0);
 
     return 0;
 }
 
+/**
+ * Remembers the last video frame of streamed output. A packet owning its
+ * data is taken over, only data in a buffer of the caller is copied.
+ */
+static int amv_keep_last_frame(AMVContext *avi, AVPacket *pkt)
+{
+    av_free_packet(&avi->last_frame);
+    if(pkt->destruct == av_destruct_packet || pkt->destruct == av_destruct_packet_headroom){
+        avi->last_frame= *pkt;
+        pkt->destruct= NULL; // freed with last_frame
+    }else{
+        avi->last_frame_buf= av_fast_realloc(avi->last_frame_buf, &avi->last_frame_alloc, pkt->size);
+        if(!avi->last_frame_buf)
+            return -1;
+        memcpy(avi->last_frame_buf, pkt->data, pkt->size);
+        av_init_packet(&avi->last_frame);
+        avi->last_frame.destruct= NULL;
+        avi->last_frame.data= avi->last_frame_buf;
+        avi->last_frame.size= pkt->size;
+    }
+    return 0;
+}
 
 static int avi_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
@@ -294,6 +379,14 @@ static int avi_write_packet(AVFormatContext *s, AVPacket *pkt)
     AVCodecContext *enc= s->streams[stream_index]->codec;
     int size= pkt->size;
 
+    if(avi->header_frames && avi->packet_count[stream_index] >= avi->header_frames){
+        avi->dropped++;
+        return 0;
+    }
+    if(avi->header_frames && enc->codec_type == CODEC_TYPE_VIDEO && size &&
+       pkt->data != avi->last_frame.data && amv_keep_last_frame(avi, pkt) < 0)
+        return -1;
+
 //    av_log(s, AV_LOG_DEBUG, "%"PRId64" %d %d\n", pkt->dts, avi->packet_count[stream_index], stream_index);
     while(enc->block_align==0 && pkt->dts != AV_NOPTS_VALUE && pkt->dts > avi->packet_count[stream_index]){
         AVPacket empty_packet;
@@ -304,6 +397,11 @@ static int avi_write_packet(AVFormatContext *s, AVPacket *pkt)
         empty_packet.stream_index= stream_index;
         avi_write_packet(s, &empty_packet);
 //        av_log(s, AV_LOG_DEBUG, "dup %"PRId64" %d\n", pkt->dts, avi->packet_count[stream_index]);
+        /* the gap filled all frames of the header, nothing is left for this packet */
+        if(avi->header_frames && avi->packet_count[stream_index] >= avi->header_frames){
+            avi->dropped++;
+            return 0;
+        }
     }
     avi->packet_count[stream_index]++;
 
@@ -313,10 +411,20 @@ static int avi_write_packet(AVFormatContext *s, AVPacket *pkt)
     if (enc->codec_type == CODEC_TYPE_AUDIO) {
        avi->audio_strm_length[stream_index] += size;
     }
-
-    put_buffer(pb, tag, 4);
-    put_le32(pb, size);
-    put_buffer(pb, pkt->data, size);
+    avi->total_bytes += 8 + size;
+    avi->max_chunk = FFMAX(avi->max_chunk, size);
+    avi->max_chunk_strm[stream_index] = FFMAX(avi->max_chunk_strm[stream_index], size);
+
+    if(pkt->flags & PKT_FLAG_HEADROOM){
+        /* chunk header in front of the payload, written without a copy */
+        memcpy(pkt->data - 8, tag, 4);
+        AV_WL32(pkt->data - 4, size);
+        put_buffer_direct(pb, pkt->data - 8, size + 8);
+    }else{
+        put_buffer(pb, tag, 4);
+        put_le32(pb, size);
+        put_buffer(pb, pkt->data, size);
+    }
     //Data in AMV files are not aligned by 2 bytes
 //    if (size & 1) put_byte(pb, 0);
 
@@ -324,6 +432,50 @@ static int avi_write_packet(AVFormatContext *s, AVPacket *pkt)
     return 0;
 }
 
+/**
+ * Pads streamed output to the number of frames written into its header,
+ * with copies of the last video frame and silent audio chunks.
+ */
+static int amv_pad_streams(AVFormatContext *s)
+{
+    AMVContext *avi = s->priv_data;
+    int audio = s->nb_streams > 1 && s->streams[1]->codec->codec_type == CODEC_TYPE_AUDIO;
+    uint8_t *silence;
+    AVPacket pkt;
+    int samples;
+
+    if(avi->dropped)
+        av_log(s, AV_LOG_WARNING, "%d packets after the %d frames of the header were dropped\n",
+               avi->dropped, avi->header_frames);
+    while(avi->packet_count[0] < avi->header_frames ||
+          (audio && avi->packet_count[1] < avi->header_frames)){
+        if(avi->packet_count[0] < avi->header_frames){
+            av_init_packet(&pkt);
+            pkt.stream_index= 0;
+            pkt.data= avi->last_frame.data;
+            pkt.size= avi->last_frame.size;
+            pkt.flags|= PKT_FLAG_KEY;
+            avi_write_packet(s, &pkt);
+        }
+        if(audio && avi->packet_count[1] < avi->header_frames){
+            /* predictor and step index 0, zero nibbles decode to zeros */
+            samples= amv_audio_chunk_samples(s, avi->packet_count[1]);
+            silence= av_mallocz(8 + samples/2);
+            if(!silence)
+                return -1;
+            AV_WL32(silence + 4, samples);
+            av_init_packet(&pkt);
+            pkt.stream_index= 1;
+            pkt.data= silence;
+            pkt.size= 8 + samples/2;
+            pkt.flags|= PKT_FLAG_KEY;
+            avi_write_packet(s, &pkt);
+            av_free(silence);
+        }
+    }
+    return 0;
+}
+
 static int avi_write_trailer(AVFormatContext *s)
 {
     AMVContext *avi = s->priv_data;
@@ -336,8 +488,14 @@ static int avi_write_trailer(AVFormatContext *s)
             put_tag(pb, "AMV_END_");	// Added by Tom from AMV compatibility
             end_tag(pb, avi->riff_start);
         }
+        avi_write_counters(s, avi->riff_id);
+    }else{
+        /* header can not be fixed, make the stream match it */
+        res = amv_pad_streams(s);
+        put_tag(pb, "AMV_END_");
     }
-    avi_write_counters(s, avi->riff_id);
+    av_free_packet(&avi->last_frame);
+    av_freep(&avi->last_frame_buf);
     put_flush_packet(pb);
 
     return res;
@@ -351,7 +509,7 @@ static void amv_queue_packet(AVPacket *pkt, AVPacketList** ppktl){
 
 //        assert(pkt->destruct != av_destruct_packet); //FIXME
 
-    if(pkt->destruct == av_destruct_packet)
+    if(pkt->destruct == av_destruct_packet || pkt->destruct == av_destruct_packet_headroom)
         pkt->destruct= NULL; // non shared -> must keep original from being freed
     else
         av_dup_packet(&pktl->pkt);  //shared -> must dup
@@ -380,6 +538,23 @@ static int amv_interleave_packet(struct AVFormatContext *s, AVPacket *out, AVPac
     AVPacketList *pktl;
     AMVContext* amv=s->priv_data;
 
+    /* the packet is passed right after it was encoded, so the encoder
+       codes the next chunk with the samples of the next video frame */
+    if(pkt && s->streams[pkt->stream_index]->codec->codec_type == CODEC_TYPE_AUDIO)
+        s->streams[pkt->stream_index]->codec->frame_size= amv_audio_chunk_samples(s, ++amv->audio_chunks);
+
+    /* if the queue only holds packets waiting for another stream, this
+       packet is the next one to write: pass it on without queueing (and
+       copying) it */
+    for(pktl= s->packet_buffer; pktl; pktl= pktl->next)
+        if(pktl->pkt.stream_index!=amv->last_stream_index)
+            break;
+    if(pkt && !pktl && pkt->stream_index!=amv->last_stream_index){
+        *out= *pkt;
+        pkt->destruct= NULL; // out owns the data (if the caller did)
+        amv->last_stream_index=out->stream_index;
+        return 1;
+    }
     if(pkt)
         amv_queue_packet(pkt,&s->packet_buffer);
 
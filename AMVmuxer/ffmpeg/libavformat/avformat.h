@@ -48,6 +48,12 @@ typedef struct AVPacket {
     int64_t pos;                            ///< byte position in stream, -1 if unknown
 } AVPacket;
 #define PKT_FLAG_KEY   0x0001
+/**
+ * PKT_HEADROOM bytes before data belong to the packet, a muxer may write
+ * its chunk header there and pass header and payload out with one write.
+ */
+#define PKT_FLAG_HEADROOM 0x0002
+#define PKT_HEADROOM   8
 
 void av_destruct_packet_nofree(AVPacket *pkt);
 
@@ -56,6 +62,12 @@ void av_destruct_packet_nofree(AVPacket *pkt);
  */
 void av_destruct_packet(AVPacket *pkt);
 
+/**
+ * Destructor of packets with PKT_FLAG_HEADROOM, whose buffer was allocated
+ * with av_malloc() at data - PKT_HEADROOM.
+ */
+void av_destruct_packet_headroom(AVPacket *pkt);
+
 /**
  * Initialize optional fields of a packet to default values.
  *
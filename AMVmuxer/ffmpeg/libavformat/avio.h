@@ -139,6 +139,11 @@ int init_put_byte(ByteIOContext *s,
 
 void put_byte(ByteIOContext *s, int b);
 void put_buffer(ByteIOContext *s, const unsigned char *buf, int size);
+/**
+ * Writes buf to the protocol without copying it into the buffer of s,
+ * after the bytes already buffered.
+ */
+void put_buffer_direct(ByteIOContext *s, unsigned char *buf, int size);
 void put_le64(ByteIOContext *s, uint64_t val);
 void put_be64(ByteIOContext *s, uint64_t val);
 void put_le32(ByteIOContext *s, unsigned int val);
@@ -101,6 +101,21 @@ void put_buffer(ByteIOContext *s, const unsigned char *buf, int size)
     }
 }
 
+void put_buffer_direct(ByteIOContext *s, unsigned char *buf, int size)
+{
+    if (!s->write_packet || s->update_checksum || s->max_packet_size) {
+        put_buffer(s, buf, size);
+        return;
+    }
+    flush_buffer(s);
+    if (!s->error) {
+        int ret = s->write_packet(s->opaque, buf, size);
+        if (ret < 0)
+            s->error = ret;
+    }
+    s->pos += size;
+}
+
 void put_flush_packet(ByteIOContext *s)
 {
     flush_buffer(s);
@@ -130,6 +145,8 @@ offset_t url_fseek(ByteIOContext *s, offset_t offset, int whence)
               offset1 >= 0 && offset1 < (s->buf_end - s->buffer) + (1<<16)){
         while(s->pos < offset && !s->eof_reached)
             fill_buffer(s);
+        if (s->pos < offset)
+            return AVERROR(EPIPE); /* data ended, do not point past it */
         s->buf_ptr = s->buf_end + offset - s->pos;
     } else {
         offset_t res = AVERROR(EPIPE);
@@ -179,6 +179,12 @@ void av_destruct_packet(AVPacket *pkt)
     pkt->data = NULL; pkt->size = 0;
 }
 
+void av_destruct_packet_headroom(AVPacket *pkt)
+{
+    av_free(pkt->data - PKT_HEADROOM);
+    pkt->data = NULL; pkt->size = 0;
+}
+
 void av_init_packet(AVPacket *pkt)
 {
     pkt->pts   = AV_NOPTS_VALUE;
@@ -227,7 +233,8 @@ int av_get_packet(ByteIOContext *s, AVPacket *pkt, int size)
 
 int av_dup_packet(AVPacket *pkt)
 {
-    if (pkt->destruct != av_destruct_packet) {
+    if (pkt->destruct != av_destruct_packet &&
+        pkt->destruct != av_destruct_packet_headroom) {
         uint8_t *data;
         /* we duplicate the packet and don't forget to put the padding
            again */
@@ -241,6 +248,7 @@ int av_dup_packet(AVPacket *pkt)
         memset(data + pkt->size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
         pkt->data = data;
         pkt->destruct = av_destruct_packet;
+        pkt->flags &= ~PKT_FLAG_HEADROOM;
     }
     return 0;
 }
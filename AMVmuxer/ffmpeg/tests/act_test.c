@@ -0,0 +1,205 @@
+/*
+ * ACT muxer/demuxer checks
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "avformat.h"
+
+#undef exit
+#undef printf
+#undef fprintf
+
+#define FRAMES 1000
+#define FRAME_BYTES 10
+#define FRAME_SAMPLES 80
+
+/**
+ * Writes FRAMES G.729 frames into an ACT file.
+ */
+static int mux_act(const char *filename)
+{
+    AVFormatContext *oc;
+    AVStream *st;
+    AVPacket pkt;
+    uint8_t frame[FRAME_BYTES];
+    int i, j;
+
+    oc = av_alloc_format_context();
+    oc->oformat = guess_format("act", NULL, NULL);
+    st = av_new_stream(oc, 0);
+    if (!oc->oformat || !st)
+        return -1;
+    st->codec->codec_type = CODEC_TYPE_AUDIO;
+    st->codec->codec_id = CODEC_ID_G729A;
+    st->codec->sample_rate = 8000;
+    st->codec->channels = 1;
+    st->codec->time_base = (AVRational){1, 8000};
+    if (av_set_parameters(oc, NULL) < 0 ||
+        url_fopen(&oc->pb, filename, URL_WRONLY) < 0)
+        return -1;
+
+    av_write_header(oc);
+    for (i = 0; i < FRAMES; i++) {
+        /* any frame but an all-zero one, which marks a lost frame */
+        for (j = 0; j < FRAME_BYTES; j++)
+            frame[j] = i * 7 + j * 31 + 1;
+        av_init_packet(&pkt);
+        pkt.stream_index = 0;
+        pkt.data = frame;
+        pkt.size = FRAME_BYTES;
+        pkt.pts = pkt.dts = i * FRAME_SAMPLES;
+        av_write_frame(oc, &pkt);
+    }
+    av_write_trailer(oc);
+    url_fclose(&oc->pb);
+    av_free(st->codec);
+    av_free(st);
+    av_free(oc);
+    return 0;
+}
+
+/**
+ * Demuxes and decodes an ACT file, from a pipe if piped is set.
+ * \param duration set to the duration of the stream in frames
+ * \return number of decoded frames, or -1 on error
+ */
+static int decode_act(const char *filename, int piped, int *duration)
+{
+    AVFormatContext *ic;
+    AVCodecContext *c;
+    AVCodec *codec;
+    AVPacket pkt;
+    int16_t samples[AVCODEC_MAX_AUDIO_FRAME_SIZE / 2];
+    int fd, stdin_fd = -1, size, len, ret, decoded = 0;
+    uint8_t *buf;
+
+    if (piped) {
+        stdin_fd = dup(0);
+        fd = open(filename, O_RDONLY);
+        if (fd < 0 || dup2(fd, 0) < 0)
+            return -1;
+        close(fd);
+        filename = "pipe:";
+    }
+    if (av_open_input_file(&ic, filename, av_find_input_format("act"), 0, NULL) < 0)
+        return -1;
+    *duration = ic->streams[0]->duration / 8;
+    c = ic->streams[0]->codec;
+    codec = avcodec_find_decoder(c->codec_id);
+    if (!codec || avcodec_open(c, codec) < 0)
+        return -1;
+
+    while (av_read_frame(ic, &pkt) >= 0) {
+        buf = pkt.data;
+        len = pkt.size;
+        while (len > 0) {
+            size = sizeof(samples);
+            ret = avcodec_decode_audio2(c, samples, &size, buf, len);
+            if (ret <= 0)
+                break;
+            decoded += size / 2;
+            buf += ret;
+            len -= ret;
+        }
+        av_free_packet(&pkt);
+    }
+    avcodec_close(c);
+    av_close_input_file(ic);
+    if (piped) {
+        dup2(stdin_fd, 0);
+        close(stdin_fd);
+    }
+    return decoded / FRAME_SAMPLES;
+}
+
+/**
+ * Seeks past the end of an ACT file.
+ * \return number of the frame read next, or -1 on error
+ */
+static int seek_past_end(const char *filename)
+{
+    AVFormatContext *ic;
+    AVPacket pkt;
+    int frame = -1;
+
+    if (av_open_input_file(&ic, filename, NULL, 0, NULL) < 0)
+        return -1;
+    if (av_seek_frame(ic, 0, 2 * FRAMES * 8, AVSEEK_FLAG_BACKWARD) >= 0) {
+        /* nothing is left to read after a clamped seek */
+        if (av_read_frame(ic, &pkt) >= 0)
+            av_free_packet(&pkt);
+        else
+            frame = ic->streams[0]->cur_dts / 8;
+    }
+    av_close_input_file(ic);
+    return frame;
+}
+
+static int check(const char *name, const char *filename, int piped)
+{
+    int duration, frames = decode_act(filename, piped, &duration);
+
+    printf("act: %s: %d frames, duration %d\n", name, frames, duration);
+    return frames != FRAMES || duration != FRAMES;
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename;
+    int n, ret = 0;
+
+    av_register_all();
+
+    if (argc != 2) {
+        printf("usage: %s scratch_file\n", argv[0]);
+        exit(1);
+    }
+    filename = argv[1];
+
+    /* the ACT formats depend on libg729a */
+    if (!guess_format("act", NULL, NULL) || !av_find_input_format("act")) {
+        printf("act: skipped, not configured\n");
+        return 0;
+    }
+    if (mux_act(filename) < 0) {
+        printf("act: can not write %s\n", filename);
+        exit(1);
+    }
+
+    /* zero padding of the last chunk is not counted */
+    ret |= check("file", filename, 0);
+    ret |= check("pipe", filename, 1);
+    n = seek_past_end(filename);
+    printf("act: seek past end: frame %d\n", n);
+    ret |= n != FRAMES;
+
+    /* frames missing from a truncated file are concealed up to the
+       duration of the header */
+    if (truncate(filename, 512 + 9 * 512 + 100) < 0)
+        exit(1);
+    ret |= check("truncated file", filename, 0);
+    ret |= check("truncated pipe", filename, 1);
+
+    unlink(filename);
+    printf("act: %s\n", ret ? "FAILED" : "OK");
+    return ret;
+}
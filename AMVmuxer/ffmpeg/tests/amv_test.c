@@ -0,0 +1,129 @@
+/*
+ * AMV muxer checks
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "avformat.h"
+
+#undef exit
+#undef printf
+#undef fprintf
+
+#define HEADER_FRAMES 5
+
+static const uint8_t jpeg_frame[] = { 0xFF, 0xD8, 0x00, 0x00, 0xFF, 0xD9 };
+
+/**
+ * Muxes video packets with the given dts into streamed output of
+ * HEADER_FRAMES frames (written into the file through the pipe protocol)
+ * and returns the number of video chunks in it, or -1 on error.
+ */
+static int mux_streamed(const char *filename, const int64_t *dts, int nb_packets)
+{
+    AVFormatContext *oc;
+    AVStream *st;
+    AVPacket pkt;
+    uint8_t buf[4096], *p;
+    int fd, stdout_fd, i, n, chunks = 0;
+
+    oc = av_alloc_format_context();
+    oc->oformat = guess_format("amv", NULL, NULL);
+    st = av_new_stream(oc, 0);
+    if (!oc->oformat || !st)
+        return -1;
+    st->codec->codec_type = CODEC_TYPE_VIDEO;
+    st->codec->codec_id = CODEC_ID_AMV;
+    st->codec->width = 16;
+    st->codec->height = 16;
+    st->codec->time_base = (AVRational){1, 25};
+    st->nb_frames = HEADER_FRAMES;
+    if (av_set_parameters(oc, NULL) < 0)
+        return -1;
+
+    /* the pipe protocol marks output as streamed, point it at the file */
+    fflush(stdout);
+    stdout_fd = dup(1);
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || dup2(fd, 1) < 0)
+        return -1;
+    close(fd);
+    if (url_fopen(&oc->pb, "pipe:", URL_WRONLY) < 0)
+        return -1;
+
+    av_write_header(oc);
+    for (i = 0; i < nb_packets; i++) {
+        av_init_packet(&pkt);
+        pkt.stream_index = 0;
+        pkt.data = (uint8_t*)jpeg_frame;
+        pkt.size = sizeof(jpeg_frame);
+        pkt.pts = pkt.dts = dts[i];
+        pkt.flags |= PKT_FLAG_KEY;
+        av_write_frame(oc, &pkt);
+    }
+    av_write_trailer(oc);
+    url_fclose(&oc->pb);
+    av_free(st->codec);
+    av_free(st);
+    av_free(oc);
+    dup2(stdout_fd, 1);
+    close(stdout_fd);
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    n = read(fd, buf, sizeof(buf));
+    close(fd);
+    for (p = buf; p + 4 <= buf + n; p++)
+        if (!memcmp(p, "00dc", 4))
+            chunks++;
+    return chunks;
+}
+
+int main(int argc, char **argv)
+{
+    static const int64_t gap[] = { 0, 1, 9 };
+    static const int64_t gap_in_header[] = { 0, 3 };
+    const char *filename;
+    int chunks, ret = 0;
+
+    av_register_all();
+
+    if (argc != 2) {
+        printf("usage: %s scratch_file\n", argv[0]);
+        exit(1);
+    }
+    filename = argv[1];
+
+    /* dts gap running past the frame count of the header */
+    chunks = mux_streamed(filename, gap, 3);
+    printf("amv: gap past header: %d video chunks\n", chunks);
+    ret |= chunks != HEADER_FRAMES;
+
+    /* gap inside it, then padded with the last frame */
+    chunks = mux_streamed(filename, gap_in_header, 2);
+    printf("amv: gap in header: %d video chunks\n", chunks);
+    ret |= chunks != HEADER_FRAMES;
+
+    unlink(filename);
+    printf("amv: %s\n", ret ? "FAILED" : "OK");
+    return ret;
+}
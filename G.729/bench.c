@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <g729a.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+#include <math.h>
+
+/*
+  Decoder and encoder throughput benchmark.
+
+  Decodes the same amount of frames for many independent channels, once
+  with g729a_decode_frame per channel and once with g729a_decode_frames
+  for all channels at once, then encodes the same amount of frames, and
+  reports how many channels one core can process in real time (one frame
+  is 10ms of speech).
+
+  Packet loss mode encodes synthetic speech once, then decodes it with
+  frames dropped by loss pattern injector (random losses and bursts of
+  given mean length, Gilbert model) and reports decode speed and SNR of
+  concealed output against clean decode.
+
+  usage: bench [channels [frames]]
+*/
+
+#define SERIAL_SIZE 82
+#define FRAME_SIZE  80
+#define PATTERNS    64
+#define LOSS_FRAMES 16000
+
+static int16_t patterns[PATTERNS][SERIAL_SIZE];
+static int16_t speech[PATTERNS][FRAME_SIZE];
+
+static void make_patterns(void)
+{
+    static const double formant[3] = {700, 1200, 2500};
+    double y[3][3] = {{0}};
+    double phase = 0, v;
+    uint32_t seed = 1;
+    int i, j, k;
+
+    for(i=0; i<PATTERNS; i++)
+    {
+        patterns[i][0] = 0x6b21;
+        patterns[i][1] = 0x0050;
+        for(j=2; j<SERIAL_SIZE; j++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            patterns[i][j] = seed >> 31 ? 0x81 : 0x7f;
+        }
+    }
+
+    // voiced speech: pulse train filtered by three formant resonators
+    for(i=0; i<PATTERNS; i++)
+        for(j=0; j<FRAME_SIZE; j++)
+        {
+            phase += (110 + 50 * sin(2 * M_PI * (i * FRAME_SIZE + j) / 16000)) / 8000;
+            v = phase >= 1;
+            phase -= v;
+            for(k=0; k<3; k++)
+            {
+                v += 2 * 0.95 * cos(2 * M_PI * formant[k] / 8000) * y[k][1] - 0.95 * 0.95 * y[k][2];
+                y[k][2] = y[k][1];
+                y[k][1] = v;
+            }
+            speech[i][j] = v * 60;
+        }
+}
+
+static double run(int channels, int frames, int batched, uint32_t *crc)
+{
+    void **ctx = calloc(channels, sizeof(void*));
+    int16_t **in = calloc(channels, sizeof(int16_t*));
+    int16_t **out = calloc(channels, sizeof(int16_t*));
+    clock_t start;
+    double elapsed;
+    int i, c, n;
+
+    for(c=0; c<channels; c++)
+    {
+        ctx[c] = g729a_decoder_init();
+        out[c] = calloc(FRAME_SIZE, sizeof(int16_t));
+    }
+
+    *crc = 2166136261U;
+    start = clock();
+    for(i=0; i<frames; i++)
+    {
+        for(c=0; c<channels; c++)
+            in[c] = patterns[(i + c) % PATTERNS];
+
+        if(batched)
+            g729a_decode_frames(ctx, channels, in, SERIAL_SIZE, out, FRAME_SIZE);
+        else
+            for(c=0; c<channels; c++)
+                g729a_decode_frame(ctx[c], in[c], SERIAL_SIZE, out[c], FRAME_SIZE);
+
+        for(c=0; c<channels; c++)
+            for(n=0; n<FRAME_SIZE; n++)
+                *crc = (*crc ^ (uint16_t)out[c][n]) * 16777619;
+    }
+    elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    for(c=0; c<channels; c++)
+    {
+        g729a_decoder_uninit(ctx[c]);
+        free(out[c]);
+    }
+    free(ctx);
+    free(in);
+    free(out);
+
+    return elapsed;
+}
+
+/**
+ * Loss pattern injector: two-state (Gilbert) model, frames are lost
+ * in bad state. Mean burst length 1 gives independent random losses.
+ */
+typedef struct
+{
+    uint32_t seed;
+    double p_loss;      ///< probability of good -> bad transition
+    double p_recover;   ///< probability of bad -> good transition
+    int bad;            ///< current state
+} LossInjector;
+
+static void loss_init(LossInjector *li, double rate, double burst)
+{
+    li->seed      = 12345;
+    li->p_recover = rate >= 1 ? 0 : 1 / burst;
+    li->p_loss    = rate >= 1 ? 1 : rate / (burst * (1 - rate));
+    li->bad       = 0;
+}
+
+/**
+ * \return 1 if next frame is lost
+ */
+static int loss_next(LossInjector *li)
+{
+    double r;
+
+    li->seed = li->seed * 1664525 + 1013904223;
+    r = (li->seed >> 8) / 16777216.0;
+    li->bad = li->bad ? r >= li->p_recover : r < li->p_loss;
+    return li->bad;
+}
+
+/**
+ * \brief decodes stream with frames dropped by injector
+ * \param rate loss rate (0 - no losses)
+ * \param burst mean length of loss burst (in frames)
+ * \param out [out] decoded speech
+ * \param lost [out] number of lost frames
+ * \return decoding time
+ */
+static double run_lossy(int16_t (*serial)[SERIAL_SIZE], double rate, double burst, int16_t *out, int *lost)
+{
+    LossInjector li;
+    void *ctx = g729a_decoder_init();
+    clock_t start;
+    double elapsed;
+    int i;
+
+    loss_init(&li, rate, burst);
+    *lost = 0;
+    start = clock();
+    for(i=0; i<LOSS_FRAMES; i++)
+    {
+        if(rate > 0 && loss_next(&li))
+        {
+            g729a_decode_lost_frame(ctx, out + i*FRAME_SIZE, FRAME_SIZE);
+            (*lost)++;
+        }
+        else
+            g729a_decode_frame(ctx, serial[i], SERIAL_SIZE, out + i*FRAME_SIZE, FRAME_SIZE);
+    }
+    elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    g729a_decoder_uninit(ctx);
+    return elapsed;
+}
+
+static void run_loss(void)
+{
+    static const struct
+    {
+        double rate, burst;
+    } modes[] =
+    {
+        {0.01, 1}, {0.05, 1}, {0.10, 1},
+        {0.05, 4}, {0.10, 4}, {1.00, 1},
+    };
+    int16_t (*serial)[SERIAL_SIZE] = calloc(LOSS_FRAMES, sizeof(*serial));
+    int16_t *clean = calloc(LOSS_FRAMES, FRAME_SIZE * sizeof(int16_t));
+    int16_t *lossy = calloc(LOSS_FRAMES, FRAME_SIZE * sizeof(int16_t));
+    void *enc = g729a_encoder_init();
+    double t_clean, t, signal, noise;
+    int i, n, lost;
+
+    for(i=0; i<LOSS_FRAMES; i++)
+        g729a_encode_frame(enc, speech[i % PATTERNS], FRAME_SIZE, serial[i], SERIAL_SIZE);
+    g729a_encoder_uninit(enc);
+
+    t_clean = run_lossy(serial, 0, 1, clean, &lost);
+    printf("loss  0.0%%, burst 1.0: %8.0f frames/s\n", LOSS_FRAMES / t_clean);
+
+    for(i=0; i<sizeof(modes)/sizeof(modes[0]); i++)
+    {
+        t = run_lossy(serial, modes[i].rate, modes[i].burst, lossy, &lost);
+
+        signal = noise = 0;
+        for(n=0; n<LOSS_FRAMES*FRAME_SIZE; n++)
+        {
+            signal += clean[n] * (double)clean[n];
+            noise  += (clean[n] - lossy[n]) * (double)(clean[n] - lossy[n]);
+        }
+        printf("loss %4.1f%%, burst %.1f: %8.0f frames/s (%.2fx clean), %5.1f%% lost, SNR %5.1f dB vs clean\n",
+               100 * modes[i].rate, modes[i].burst, LOSS_FRAMES / t, t / t_clean,
+               100.0 * lost / LOSS_FRAMES, 10 * log10(signal / (noise + 1)));
+    }
+
+    free(serial);
+    free(clean);
+    free(lossy);
+}
+
+static double run_encoder(int channels, int frames, uint32_t *crc)
+{
+    void **ctx = calloc(channels, sizeof(void*));
+    int16_t serial[SERIAL_SIZE];
+    clock_t start;
+    double elapsed;
+    int i, c, n;
+
+    for(c=0; c<channels; c++)
+        ctx[c] = g729a_encoder_init();
+
+    *crc = 2166136261U;
+    start = clock();
+    for(i=0; i<frames; i++)
+    {
+        for(c=0; c<channels; c++)
+        {
+            g729a_encode_frame(ctx[c], speech[(i + c) % PATTERNS], FRAME_SIZE, serial, SERIAL_SIZE);
+
+            for(n=0; n<SERIAL_SIZE; n++)
+                *crc = (*crc ^ (uint16_t)serial[n]) * 16777619;
+        }
+    }
+    elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    for(c=0; c<channels; c++)
+        g729a_encoder_uninit(ctx[c]);
+    free(ctx);
+
+    return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    int channels = argc > 1 ? atoi(argv[1]) : 256;
+    int frames   = argc > 2 ? atoi(argv[2]) : 500;
+    uint32_t crc_single, crc_batch, crc_enc;
+    double t_single, t_batch, t_enc;
+
+    make_patterns();
+
+    t_single = run(channels, frames, 0, &crc_single);
+    t_batch  = run(channels, frames, 1, &crc_batch);
+    t_enc    = run_encoder(channels, frames, &crc_enc);
+
+    printf("channels: %d, frames per channel: %d\n", channels, frames);
+    printf("single : %8.0f frames/s, %6.1f channels realtime per core\n",
+           channels * frames / t_single, channels * frames * 0.01 / t_single);
+    printf("batched: %8.0f frames/s, %6.1f channels realtime per core\n",
+           channels * frames / t_batch, channels * frames * 0.01 / t_batch);
+    printf("encoder: %8.0f frames/s, %6.1f channels realtime per core\n",
+           channels * frames / t_enc, channels * frames * 0.01 / t_enc);
+
+    run_loss();
+
+    if(crc_single != crc_batch)
+    {
+        printf("batched output differs from single-channel output\n");
+        return 1;
+    }
+    return 0;
+}
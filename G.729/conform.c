@@ -0,0 +1,171 @@
+#include <stdlib.h>
+#include <g729a.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+  Conformance and performance test of native decoder.
+
+  Decodes each given bitstream (ITU serial format, e.g. *.BIT test vectors
+  from ITU's G.729 Annex A package) with ITU's reference code and with
+  native decoder, compares their output and measures decoding speed of
+  both. Random frames are used when no file is given.
+
+  Native decoder is linked together with reference library, its entry
+  points are renamed into native_g729a_* (see Makefile).
+
+  Output has one result per line, as space separated key=value pairs:
+
+  vector=<name> frames=<n> bitexact=<0|1> max_dev=<n> diff_samples=<n>
+  bench=<name> impl=<itu|native> frames=<n> fps=<n> channels=<n>
+
+  (fps is frames decoded per second, channels is number of channels decoded
+  in real time by one core)
+
+  usage: conform [-m max_dev] [file.bit ...]
+  exit code is 1 when deviation of any vector exceeds max_dev (if given)
+*/
+
+#define SERIAL_SIZE 82
+#define FRAME_SIZE  80
+#define BENCH_FRAMES 100000 // minimal number of frames decoded by benchmark
+
+void* native_g729a_decoder_init(void);
+int native_g729a_decode_frame(void *context, short* ibuf, int ibuflen, short* obuf, int obuflen);
+void native_g729a_decoder_uninit(void* context);
+
+static const struct
+{
+    const char *name;
+    void* (*init)(void);
+    int (*decode)(void *context, short* ibuf, int ibuflen, short* obuf, int obuflen);
+    void (*uninit)(void* context);
+} impl[2] =
+{
+    { "itu",    g729a_decoder_init,        g729a_decode_frame,        g729a_decoder_uninit        },
+    { "native", native_g729a_decoder_init, native_g729a_decode_frame, native_g729a_decoder_uninit },
+};
+
+static void decode(int k, int16_t *serial, int frames, int16_t *out)
+{
+    void *ctx = impl[k].init();
+    int i;
+
+    for(i=0; i<frames; i++)
+        impl[k].decode(ctx, serial + i*SERIAL_SIZE, SERIAL_SIZE, out + i*FRAME_SIZE, FRAME_SIZE);
+    impl[k].uninit(ctx);
+}
+
+static void bench(const char *name, int k, int16_t *serial, int frames, int16_t *out)
+{
+    clock_t start;
+    double elapsed;
+    int total = 0;
+
+    start = clock();
+    do
+    {
+        decode(k, serial, frames, out);
+        total += frames;
+    } while(total < BENCH_FRAMES);
+    elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("bench=%s impl=%s frames=%d fps=%.0f channels=%.1f\n", name, impl[k].name,
+           total, total / elapsed, total * 0.01 / elapsed);
+}
+
+/**
+ * \brief compares output of both decoders
+ * \return maximal deviation
+ */
+static int compare(const char *name, int16_t *serial, int frames)
+{
+    int16_t *ref = malloc(frames * FRAME_SIZE * sizeof(int16_t));
+    int16_t *out = malloc(frames * FRAME_SIZE * sizeof(int16_t));
+    int i, dev, max_dev = 0, diff = 0;
+
+    decode(0, serial, frames, ref);
+    decode(1, serial, frames, out);
+
+    for(i=0; i<frames*FRAME_SIZE; i++)
+    {
+        dev = abs(ref[i] - out[i]);
+        if(dev)
+            diff++;
+        if(dev > max_dev)
+            max_dev = dev;
+    }
+    printf("vector=%s frames=%d bitexact=%d max_dev=%d diff_samples=%d\n",
+           name, frames, !diff, max_dev, diff);
+
+    bench(name, 0, serial, frames, ref);
+    bench(name, 1, serial, frames, out);
+
+    free(ref);
+    free(out);
+    return max_dev;
+}
+
+static int16_t *load(const char *filename, int *frames)
+{
+    int16_t *serial;
+    FILE *f;
+
+    if(!(f = fopen(filename, "rb")))
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    *frames = ftell(f) / (SERIAL_SIZE * sizeof(int16_t));
+    fseek(f, 0, SEEK_SET);
+    serial = malloc(*frames * SERIAL_SIZE * sizeof(int16_t) + 1);
+    *frames = fread(serial, SERIAL_SIZE * sizeof(int16_t), *frames, f);
+    fclose(f);
+    return serial;
+}
+
+int main(int argc, char **argv)
+{
+    int16_t *serial;
+    const char *name;
+    int max_dev = -1, failed = 0;
+    int frames, i, j;
+    uint32_t seed = 1;
+
+    i = 1;
+    if(argc > 2 && !strcmp(argv[1], "-m"))
+    {
+        max_dev = atoi(argv[2]);
+        i = 3;
+    }
+
+    if(i == argc)
+    {
+        name = "random";
+        frames = 1000;
+        serial = malloc(frames * SERIAL_SIZE * sizeof(int16_t));
+        for(j=0; j<frames*SERIAL_SIZE; j++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            serial[j] = j % SERIAL_SIZE == 0 ? 0x6b21 :
+                        j % SERIAL_SIZE == 1 ? 0x0050 : seed >> 31 ? 0x81 : 0x7f;
+        }
+        if(compare(name, serial, frames) > max_dev && max_dev >= 0)
+            failed = 1;
+        free(serial);
+    }
+
+    for(; i<argc; i++)
+    {
+        name = strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i];
+        if(!(serial = load(argv[i], &frames)))
+        {
+            fprintf(stderr, "%s: can not open\n", argv[i]);
+            return 1;
+        }
+        if(compare(name, serial, frames) > max_dev && max_dev >= 0)
+            failed = 1;
+        free(serial);
+    }
+    return failed;
+}
@@ -1,16 +1,33 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "typedef.h"
 #include "basic_op.h"
 #include "ld8a.h"
 
+/*
+  ITU's reference code keeps all codec state in global and static variables
+  (basic operators even share the Overflow flag between encoder and
+  decoder). So only one encoder and one decoder may be open at a time: init
+  returns NULL while the previous one is not uninitialized. Calls are not
+  reentrant and must not run concurrently, not even an encoder call with a
+  decoder call. Use native library ("make native") for several instances
+  or for calls from several threads.
+*/
+
  Word16 bad_lsf;        /* bad LSF indicator   */
 
+static char encoder_open, decoder_open;  ///< handles of the only instances
+
 void* g729a_encoder_init()
 {
+  if(encoder_open)
+    return NULL;
+  encoder_open = 1;
+
   Init_Pre_Process();
   Init_Coder_ld8a();
-  return NULL;
+  return &encoder_open;
 }
 
 int g729a_encode_frame(void * context, Word16* data, int ibuflen, Word16* serial, int obuflen)
@@ -25,23 +42,35 @@ int g729a_encode_frame(void * context, Word16* data, int ibuflen, Word16* serial
     Coder_ld8a(prm);
 
     prm2bits_ld8k( prm, serial);
+
     return SERIAL_SIZE;
 }
 
 void g729a_encoder_uninit(void* context)
 {
+  if(context)
+    encoder_open = 0;
 }
 
 void* g729a_decoder_init()
 {
+  if(decoder_open)
+    return NULL;
+  decoder_open = 1;
+
   bad_lsf = 0;          /* Initialize bad LSF indicator */
   Init_Decod_ld8a();
   Init_Post_Filter();
   Init_Post_Process();
-  return NULL;
+  return &decoder_open;
 }
 
-int g729a_decode_frame(void* context, Word16* serial, int ibuflen, Word16* obuf, int obuflen){
+/**
+ * \brief decodes one frame with state of reference decoder
+ * \param serial frame in ITU serial format, NULL for missing frame
+ */
+static int decode_frame(Word16* serial, Word16* obuf)
+{
   Word16  parm[PRM_SIZE+1];             /* Synthesis parameters        */
   Word16  Az_dec[MP1*2];                /* Decoded Az for post-filter  */
   Word16  T2[2];                        /* Pitch lag for 2 subframes   */
@@ -52,11 +81,19 @@ int g729a_decode_frame(void* context, Word16* serial, int ibuflen, Word16* obuf,
     for (i=0; i<M; i++) synth_buf[i] = 0;
     synth = synth_buf + M;
 
-    parm[0] = 0;           /* No frame erasure */
-    for (i=2; i < SERIAL_SIZE; i++)
-      if (serial[i] == 0 ) parm[0] = 1; /* frame erased     */
+    if (serial == NULL)
+    {
+      for (i=0; i < PRM_SIZE+1; i++) parm[i] = 0;
+      parm[0] = 1;         /* frame missing    */
+    }
+    else
+    {
+      parm[0] = 0;           /* No frame erasure */
+      for (i=2; i < SERIAL_SIZE; i++)
+        if (serial[i] == 0 ) parm[0] = 1; /* frame erased     */
 
-    bits2prm_ld8k( &serial[2], &parm[1]);
+      bits2prm_ld8k( &serial[2], &parm[1]);
+    }
 
     parm[4] = Check_Parity_Pitch(parm[3], parm[4]);
 
@@ -70,6 +107,31 @@ int g729a_decode_frame(void* context, Word16* serial, int ibuflen, Word16* obuf,
     return L_FRAME;
 }
 
+int g729a_decode_frame(void* context, Word16* serial, int ibuflen, Word16* obuf, int obuflen){
+    return decode_frame(serial, obuf);
+}
+
+int g729a_decode_lost_frame(void* context, Word16* obuf, int obuflen)
+{
+    return decode_frame(NULL, obuf);
+}
+
+/**
+ * \brief decodes one frame for each context
+ * \note all contexts are the only decoder here, so frames are decoded one
+ *       after another as consecutive frames of one stream
+ */
+int g729a_decode_frames(void** contexts, int count, Word16** serial, int ibuflen, Word16** obufs, int obuflen)
+{
+  int i, ret = 0;
+
+  for(i=0; i<count; i++)
+    ret = decode_frame(serial[i], obufs[i]);
+  return ret;
+}
+
 void g729a_decoder_uninit(void* context)
 {
+  if(context)
+    decoder_open = 0;
 }
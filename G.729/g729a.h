@@ -4,6 +4,8 @@
 
 void* g729a_encoder_init(void);
 int g729a_decode_frame(void *context, short* ibuf, int ibuflen, short* obuf, int obuflen);
+int g729a_decode_frames(void **contexts, int count, short** ibufs, int ibuflen, short** obufs, int obuflen);
+int g729a_decode_lost_frame(void *context, short* obuf, int obuflen);
 void g729a_encoder_uninit(void* context);
 
 void* g729a_decoder_init(void);
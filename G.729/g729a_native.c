@@ -1,5 +1,5 @@
 /*
- * G.729 Annex A decoder
+ * G.729 Annex A decoder and encoder
  * Copyright (c) 2007 Vladimir Voroshilov
  *
  * This file is part of FFmpeg.
@@ -47,6 +47,12 @@ speech  : PASS
 tame    : PASS
 test    : PASS
 
+Encoder follows reduced complexity algorithms of Annex A. LP analysis,
+quantizers and searches use the same basic operators (saturation, rounding
+and order of operations) as reference encoder does, so its bitstream is
+expected to match reference one. Unverified until test_dsp is run on ITU test
+vectors with input speech.
+
 Naming conventions:
 
 Routines:
@@ -75,6 +81,10 @@ Q<n>      : Means "value * (1<<n)" (i.e. fixed-point value with 2^n base)
 #include "bitstream.h"
 #endif
 
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 
 /*
 -------------------------------------------------------------------------------
@@ -748,7 +758,7 @@ int l_div(int num, int denom, uint8_t base)
  *
  * \note array must be at least length+offset long!
  */
-static int sum_of_squares(const int16_t* speech, int cycles, int offset, int shift)
+static int sum_of_squares_c(const int16_t* speech, int cycles, int offset, int shift)
 {
     int n;
     int sum = 0;
@@ -773,6 +783,246 @@ static int16_t g729_round(int value)
     return (value + 0x8000) >> 16;
 }
 
+/*
+-------------------------------------------------------------------------------
+          DSP routines
+------------------------------------------------------------------------------
+*/
+
+/**
+ * \brief A(z) filter kernel (reference version)
+ * \param lp (Q12) filter coefficients
+ * \param speech (Q0) input signal, preceded by 10 samples of previous data
+ * \param residual [out] (Q0) filtered signal
+ * \param subframe_size length of subframe
+ */
+static void residual_c(const int16_t* lp, const int16_t* speech, int16_t* residual, int subframe_size)
+{
+    int i, n, sum;
+
+    for(n=0; n<subframe_size; n++)
+    {
+        sum = speech[n] << 12;
+        for(i=0; i<10; i++)
+            sum += lp[i] * speech[n-i-1];
+        sum = av_clip(sum, SHRT_MIN << 12, SHRT_MAX << 12);
+        residual[n] = g729_round(sum << 4);
+    }
+}
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+
+#define G729_CPU_SSE2 0x0001
+#define G729_CPU_AVX2 0x0002
+
+static int g729_cpu_flags(void)
+{
+    int flags = 0;
+
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse2"))
+        flags |= G729_CPU_SSE2;
+    if(__builtin_cpu_supports("avx2"))
+        flags |= G729_CPU_AVX2;
+    return flags;
+}
+
+__attribute__((target("sse2")))
+static inline int hsum_epi32_sse2(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1,0,3,2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2,3,0,1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+__attribute__((target("sse2")))
+static int sum_of_squares_sse2(const int16_t* speech, int cycles, int offset, int shift)
+{
+    __m128i sum = _mm_setzero_si128();
+    __m128i cnt = _mm_cvtsi32_si128(shift);
+    int n, res;
+
+    for(n=0; n+8<=cycles; n+=8)
+    {
+        __m128i a = _mm_sra_epi16(_mm_loadu_si128((const __m128i*)(speech + n)), cnt);
+        __m128i b = _mm_sra_epi16(_mm_loadu_si128((const __m128i*)(speech + n + offset)), cnt);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(a, b));
+    }
+
+    res = hsum_epi32_sse2(sum);
+    for(; n<cycles; n++)
+       res += (speech[n] >> shift) * (speech[n + offset] >> shift);
+
+    return res;
+}
+
+/*
+  Eight outputs of A(z) filter at once: pairs of taps (i, i+1) are interleaved
+  and multiplied by pmaddwd. Result of g729_round(av_clip(sum, SHRT_MIN << 12,
+  SHRT_MAX << 12) << 4) is the same as av_clip_int16(((sum >> 11) + 1) >> 1),
+  which does not overflow and maps to a saturating pack.
+*/
+__attribute__((target("sse2"), always_inline))
+static inline void residual8_sse2(const __m128i *coef, const int16_t* speech, int16_t* residual)
+{
+    __m128i x   = _mm_loadu_si128((const __m128i*)speech);
+    __m128i lo  = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), x), 4);
+    __m128i hi  = _mm_srai_epi32(_mm_unpackhi_epi16(_mm_setzero_si128(), x), 4);
+    __m128i one = _mm_set1_epi32(1);
+    int i;
+
+    for(i=0; i<5; i++)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(speech - 2*i - 1));
+        __m128i b = _mm_loadu_si128((const __m128i*)(speech - 2*i - 2));
+        lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), coef[i]));
+        hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), coef[i]));
+    }
+    lo = _mm_srai_epi32(_mm_add_epi32(_mm_srai_epi32(lo, 11), one), 1);
+    hi = _mm_srai_epi32(_mm_add_epi32(_mm_srai_epi32(hi, 11), one), 1);
+    _mm_storeu_si128((__m128i*)residual, _mm_packs_epi32(lo, hi));
+}
+
+__attribute__((target("sse2")))
+static void residual_sse2(const int16_t* lp, const int16_t* speech, int16_t* residual, int subframe_size)
+{
+    __m128i coef[5];
+    int i, n;
+
+    for(i=0; i<5; i++)
+        coef[i] = _mm_set1_epi32((lp[2*i+1] << 16) | (uint16_t)lp[2*i]);
+
+    for(n=0; n+8<=subframe_size; n+=8)
+        residual8_sse2(coef, speech + n, residual + n);
+
+    residual_c(lp, speech + n, residual + n, subframe_size - n);
+}
+
+__attribute__((target("avx2")))
+static int sum_of_squares_avx2(const int16_t* speech, int cycles, int offset, int shift)
+{
+    __m256i sum = _mm256_setzero_si256();
+    __m128i cnt = _mm_cvtsi32_si128(shift);
+    __m128i sum128;
+    int n, res;
+
+    for(n=0; n+16<=cycles; n+=16)
+    {
+        __m256i a = _mm256_sra_epi16(_mm256_loadu_si256((const __m256i*)(speech + n)), cnt);
+        __m256i b = _mm256_sra_epi16(_mm256_loadu_si256((const __m256i*)(speech + n + offset)), cnt);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(a, b));
+    }
+    if(n+8<=cycles)
+    {
+        __m128i a = _mm_sra_epi16(_mm_loadu_si128((const __m128i*)(speech + n)), cnt);
+        __m128i b = _mm_sra_epi16(_mm_loadu_si128((const __m128i*)(speech + n + offset)), cnt);
+        sum = _mm256_add_epi32(sum, _mm256_zextsi128_si256(_mm_madd_epi16(a, b)));
+        n += 8;
+    }
+
+    sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_SHUFFLE(1,0,3,2)));
+    sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_SHUFFLE(2,3,0,1)));
+    res = _mm_cvtsi128_si32(sum128);
+
+    for(; n<cycles; n++)
+       res += (speech[n] >> shift) * (speech[n + offset] >> shift);
+
+    return res;
+}
+
+/**
+ * Same as residual_sse2, but sixteen outputs at once. Unpack and pack
+ * instructions work within 128-bit lanes, so outputs stay in order.
+ */
+__attribute__((target("avx2")))
+static void residual_avx2(const int16_t* lp, const int16_t* speech, int16_t* residual, int subframe_size)
+{
+    __m256i coef[5];
+    __m128i coef128[5];
+    __m256i one = _mm256_set1_epi32(1);
+    int i, n;
+
+    for(i=0; i<5; i++)
+        coef[i] = _mm256_set1_epi32((lp[2*i+1] << 16) | (uint16_t)lp[2*i]);
+
+    for(n=0; n+16<=subframe_size; n+=16)
+    {
+        __m256i x  = _mm256_loadu_si256((const __m256i*)(speech + n));
+        __m256i lo = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), x), 4);
+        __m256i hi = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), x), 4);
+
+        for(i=0; i<5; i++)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(speech + n - 2*i - 1));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(speech + n - 2*i - 2));
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), coef[i]));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), coef[i]));
+        }
+        lo = _mm256_srai_epi32(_mm256_add_epi32(_mm256_srai_epi32(lo, 11), one), 1);
+        hi = _mm256_srai_epi32(_mm256_add_epi32(_mm256_srai_epi32(hi, 11), one), 1);
+        _mm256_storeu_si256((__m256i*)(residual + n), _mm256_packs_epi32(lo, hi));
+    }
+
+    for(i=0; i<5; i++)
+        coef128[i] = _mm256_castsi256_si128(coef[i]);
+
+    for(; n+8<=subframe_size; n+=8)
+        residual8_sse2(coef128, speech + n, residual + n);
+
+    _mm256_zeroupper();
+    residual_c(lp, speech + n, residual + n, subframe_size - n);
+}
+#endif /* x86 */
+
+/**
+ * DSP routines, selected by g729_dsp_init according to CPU capabilities
+ */
+static struct
+{
+    int  (*sum_of_squares)(const int16_t* speech, int cycles, int offset, int shift);
+    void (*residual)(const int16_t* lp, const int16_t* speech, int16_t* residual, int subframe_size);
+} g729_dsp = { sum_of_squares_c, residual_c };
+
+/**
+ * \brief selects DSP routines
+ * \param cpu_flags mask of CPU extensions allowed to use
+ */
+static void g729_dsp_init(int cpu_flags)
+{
+    g729_dsp.sum_of_squares = sum_of_squares_c;
+    g729_dsp.residual       = residual_c;
+
+#ifdef HAVE_X86_SIMD
+    cpu_flags &= g729_cpu_flags();
+    if(cpu_flags & G729_CPU_SSE2)
+    {
+        g729_dsp.sum_of_squares = sum_of_squares_sse2;
+        g729_dsp.residual       = residual_sse2;
+    }
+    if(cpu_flags & G729_CPU_AVX2)
+    {
+        g729_dsp.sum_of_squares = sum_of_squares_avx2;
+        g729_dsp.residual       = residual_avx2;
+    }
+#endif
+}
+
+/**
+ * \brief selects the best DSP routines supported by CPU (run once)
+ */
+static void g729_dsp_init_all(void)
+{
+    g729_dsp_init(~0);
+}
+
+static int sum_of_squares(const int16_t* speech, int cycles, int offset, int shift)
+{
+    return g729_dsp.sum_of_squares(speech, cycles, offset, shift);
+}
+
 /**
  * \brief pseudo random number generator
  */
@@ -911,22 +1161,18 @@ static void g729_update_gain_erasure(int16_t *pred_energ_q)
 }
 
 /**
- * \brief Decoding of the adaptive codebook gain (4.1.5 and 3.9.1)
- * \param ctx private data structure
- * \param ga_cb_index GA gain codebook index (stage 2)
- * \param gb_cb_index GB gain codebook (stage 2)
+ * \brief Prediction of the fixed-codebook gain from past quantized energies (3.9.1)
  * \param fc_v (Q13) fixed-codebook vector
- * \param pred_energ_q [in/out] (Q10) past quantized energies
+ * \param pred_energ_q (Q10) past quantized energies
  * \param subframe_size length of subframe
+ * \param exp [out] integer part of predicted gain's logarithm (base 2)
  *
- * \return (Q1) quantized adaptive-codebook gain (gain code)
+ * \return (Q15) fractional part of predicted gain
  */
-static int16_t g729_get_gain_code(int ga_cb_index, int gb_cb_index, const int16_t* fc_v, int16_t* pred_energ_q, int subframe_size)
+static int g729_predict_gain_code(const int16_t* fc_v, const int16_t* pred_energ_q, int subframe_size, int* exp)
 {
     int i;
-    int cb1_sum; // Q12
     int energy;
-    int exp;
 
     /* 3.9.1, Equation 66 */
     energy = sum_of_squares(fc_v, subframe_size, 0, 0);
@@ -969,8 +1215,49 @@ static int16_t g729_get_gain_code(int ga_cb_index, int gb_cb_index, const int16_
       due to recent change of energy_int's integer part.
       This is done to avoid overflow. Result fits into 16-bit.
     */
-    exp = (energy >> 15);             // integer part (exponent)
-    energy = l_pow2(energy & 0x7fff) & 0x7fff; // Only fraction part of Q15
+    *exp = (energy >> 15);            // integer part (exponent)
+    return l_pow2(energy & 0x7fff) & 0x7fff; // Only fraction part of Q15
+}
+
+/**
+ * \brief Applies correction factor of GA and GB codebooks to predicted gain (3.9.1)
+ * \param energy (Q15) fractional part of predicted gain
+ * \param exp integer part of predicted gain's logarithm (base 2)
+ * \param cb1_sum (Q13) correction factor (sum of GA and GB codebook entries)
+ *
+ * \return (Q1) quantized fixed-codebook gain (gain code)
+ */
+static int16_t g729_scale_gain_code(int energy, int exp, int cb1_sum)
+{
+    energy *= cb1_sum >> 1; // energy*2^14 in Q12
+
+    // energy*2^14 in Q12 -> energy*2^exp in Q1
+    if(25 - exp > 0)
+        energy >>= 25-exp;
+    else
+        energy <<= exp-25;
+
+    return energy;
+}
+
+/**
+ * \brief Decoding of the adaptive codebook gain (4.1.5 and 3.9.1)
+ * \param ga_cb_index GA gain codebook index (stage 2)
+ * \param gb_cb_index GB gain codebook (stage 2)
+ * \param fc_v (Q13) fixed-codebook vector
+ * \param pred_energ_q [in/out] (Q10) past quantized energies
+ * \param subframe_size length of subframe
+ *
+ * \return (Q1) quantized adaptive-codebook gain (gain code)
+ */
+static int16_t g729_get_gain_code(int ga_cb_index, int gb_cb_index, const int16_t* fc_v, int16_t* pred_energ_q, int subframe_size)
+{
+    int i;
+    int cb1_sum; // Q13
+    int energy;
+    int exp;
+
+    energy = g729_predict_gain_code(fc_v, pred_energ_q, subframe_size, &exp);
 
     // shift prediction error vector
     for(i=3; i>0; i--)
@@ -984,15 +1271,8 @@ static int16_t g729_get_gain_code(int ga_cb_index, int gb_cb_index, const int16_
       24660 = 10/log2(10) in Q13
     */
     pred_energ_q[0] = (24660 * ((l_log2(cb1_sum) >> 2) - (13 << 13))) >> 15;
-    energy *= cb1_sum >> 1; // energy*2^14 in Q12
-
-    // energy*2^14 in Q12 -> energy*2^exp in Q1
-    if(25 - exp > 0)
-        energy >>= 25-exp;
-    else
-        energy <<= exp-25;
 
-    return energy;
+    return g729_scale_gain_code(energy, exp, cb1_sum);
 }
 
 /**
@@ -1059,6 +1339,24 @@ static int g729_lp_synthesis_filter(const int16_t* lp, const int16_t *in, int16_
     return 0;
 }
 
+/**
+ * \brief Target gain of adaptive gain control (4.2.4)
+ * \param gain_before (Q0) gain of speech before applying postfilters
+ * \param gain_after  (Q0) gain of speech after applying postfilters (non-zero)
+ *
+ * \return (Q12) sqrt(gain_before/gain_after)
+ */
+static int g729a_agc_gain(int gain_before, int gain_after)
+{
+    int gain; // Q12
+
+    if(!gain_before)
+        return 0;
+
+    gain = l_div(gain_after, gain_before, 12); // Q12
+    return l_inv_sqrt(gain) >> 11; // Q23 -> Q12
+}
+
 /**
  * \brief Adaptive gain control (4.2.4)
  * \param gain_before (Q0) gain of speech before applying postfilters
@@ -1077,13 +1375,7 @@ static int16_t g729a_adaptive_gain_control(int gain_before, int gain_after, int1
     if(!gain_after)
         return gain_prev;
 
-    if(gain_before)
-    {
-        gain = l_div(gain_after, gain_before, 12); // Q12
-        gain = l_inv_sqrt(gain) >> 11; // Q23 -> Q12
-    }
-    else
-        gain = 0;
+    gain = g729a_agc_gain(gain_before, gain_after);
 
     for(n=0; n<subframe_size; n++)
     {
@@ -1191,6 +1483,22 @@ static void g729a_long_term_filter(int intT1, const int16_t* residual, int16_t *
                             residual[n + PITCH_MAX - intT0] * glgp_inv_glgp) >> 15;
 }
 
+/**
+ * \brief gain of tilt compensation filter (A.4.2.3, Equation A.14)
+ * \param rh0 (Q12) autocorrelation of impulse response with delay 0
+ * \param rh1 (Q12) autocorrelation of impulse response with delay 1
+ *
+ * \return (Q12) filter gain
+ */
+static int g729a_tilt_gain(int rh0, int rh1)
+{
+    rh1 = rh1 * GAMMA_T >> 15; // Q12 * Q15 = Q27 -> Q12
+
+    if(rh1>0)
+        return -l_div(rh1, rh0, 12); // l_div accepts only positive parameters
+    return 0;
+}
+
 /**
  * \brief compensates the tilt in the short-term postfilter (4.2.3)
  * \param ctx private data structure
@@ -1230,13 +1538,7 @@ static void g729a_tilt_compensation(G729A_Context *ctx, const int16_t *lp_gn, co
     /* A.4.2.3, Equation A.14, calcuate rh(1)  */
     rh1 = sum_of_squares(hf_buf+10, 22-1, 1, 0) >> 12; // Q24 -> Q12
 
-    rh1 = rh1 * GAMMA_T >> 15; // Q12 * Q15 = Q27 -> Q12
-
-    /* A.4.2.3, Equation A.14 */
-    if(rh1>0)
-        gt = -l_div(rh1, rh0, 12); // l_div accepts only positive parameters
-    else
-        gt = 0;
+    gt = g729a_tilt_gain(rh0, rh1);
 
     /* A.4.2.3. Equation A.13, apply filter to signal */
     tmp=res_pst[ctx->subframe_size-1];
@@ -1258,7 +1560,7 @@ static void g729a_tilt_compensation(G729A_Context *ctx, const int16_t *lp_gn, co
  */
 static void g729_residual(int16_t* lp, const int16_t* speech, int16_t* residual, int subframe_size, int16_t* pos_filter_data)
 {
-    int i, n, sum;
+    int i;
     int16_t tmp_speech_buf[MAX_SUBFRAME_SIZE+10];
     int16_t *tmp_speech=tmp_speech_buf+10;
 
@@ -1273,14 +1575,7 @@ static void g729_residual(int16_t* lp, const int16_t* speech, int16_t* residual,
       4.2.1, Equation 79 Residual signal calculation
       ( filtering through A(z/GAMMA_N) , one half of short-term filter)
     */
-    for(n=0; n<subframe_size; n++)
-    {
-        sum = tmp_speech[n] << 12;
-        for(i=0; i<10; i++)
-            sum += lp[i] * tmp_speech[n-i-1];
-        sum = av_clip(sum, SHRT_MIN << 12, SHRT_MAX << 12);
-        residual[n+PITCH_MAX] = g729_round(sum << 4);
-    }
+    g729_dsp.residual(lp, tmp_speech, residual + PITCH_MAX, subframe_size);
 
     // Save data to use it in the next subframe
     for(i=0; i<10; i++)
@@ -1288,27 +1583,20 @@ static void g729_residual(int16_t* lp, const int16_t* speech, int16_t* residual,
 }
 
 /**
- * \brief Signal postfiltering (4.2, with A.4.2 simplification)
+ * \brief First half of signal postfiltering: residual, long-term postfilter and tilt compensation
  * \param ctx private data structure
  * \param lp (Q12) LP filter coefficients
  * \param pitch_delay_int integer part of the pitch delay
- * \param speech [in/out] (Q0) signal buffer
+ * \param speech (Q0) signal buffer
+ * \param lp_gd [out] (Q12) coefficients of A(z/GAMMA_D) filter
+ * \param residual_filt [out] (Q0) filtered residual signal
  *
- * Filtering has the following  stages:
- *   Long-term postfilter (4.2.1)
- *   Short-term postfilter (4.2.2).
- *   Tilt-compensation (4.2.3)
- *   Adaptive gain control (4.2.4)
- *
- * \note This routine is G.729 Annex A specific.
+ * \return (Q0) gain of unfiltered signal for using in AGC
  */
-static void g729a_postfilter(G729A_Context *ctx, const int16_t *lp, int pitch_delay_int, int16_t *speech)
+static int g729a_postfilter_residual(G729A_Context *ctx, const int16_t *lp, int pitch_delay_int, const int16_t *speech, int16_t *lp_gd, int16_t *residual_filt)
 {
-    int16_t residual_filt_buf[MAX_SUBFRAME_SIZE+10];
-    int16_t* residual_filt=residual_filt_buf+10;
     int16_t lp_gn[10]; // Q12
-    int16_t lp_gd[10]; // Q12
-    int gain_before, gain_after;
+    int gain_before;
 
     /* Calculate A(z/GAMMA_N) filter coefficients */
     g729a_weighted_filter(lp, GAMMA_N, lp_gn);
@@ -1330,6 +1618,33 @@ static void g729a_postfilter(G729A_Context *ctx, const int16_t *lp, int pitch_de
     /* short-term filter tilt compensation (A.4.2.3) */
     g729a_tilt_compensation(ctx, lp_gn, lp_gd, residual_filt);
 
+    return gain_before;
+}
+
+/**
+ * \brief Signal postfiltering (4.2, with A.4.2 simplification)
+ * \param ctx private data structure
+ * \param lp (Q12) LP filter coefficients
+ * \param pitch_delay_int integer part of the pitch delay
+ * \param speech [in/out] (Q0) signal buffer
+ *
+ * Filtering has the following  stages:
+ *   Long-term postfilter (4.2.1)
+ *   Short-term postfilter (4.2.2).
+ *   Tilt-compensation (4.2.3)
+ *   Adaptive gain control (4.2.4)
+ *
+ * \note This routine is G.729 Annex A specific.
+ */
+static void g729a_postfilter(G729A_Context *ctx, const int16_t *lp, int pitch_delay_int, int16_t *speech)
+{
+    int16_t residual_filt_buf[MAX_SUBFRAME_SIZE+10];
+    int16_t* residual_filt=residual_filt_buf+10;
+    int16_t lp_gd[10]; // Q12
+    int gain_before, gain_after;
+
+    gain_before = g729a_postfilter_residual(ctx, lp, pitch_delay_int, speech, lp_gd, residual_filt);
+
     /* Apply second half of short-term postfilter: 1/A(z/GAMMA_D)*/
     g729_lp_synthesis_filter(lp_gd, residual_filt, speech, ctx->res_filter_data, ctx->subframe_size, 0);
 
@@ -1591,15 +1906,31 @@ static void g729_lp_decode(const int16_t* lsp_2nd, int16_t* lsp_prev, int16_t* l
 */
 
 /**
- * \brief G.729A decoder initialization
- * \param avctx private data structure
+ * \brief initialization of decoder state (shared by decoder and encoder)
+ * \param avctx codec context
+ * \param ctx decoder state to initialize
  * \return 0 if success, non-zero otherwise
  */
-static int ff_g729a_decoder_init(AVCodecContext * avctx)
+static int g729a_context_init(AVCodecContext * avctx, G729A_Context* ctx)
 {
-    G729A_Context* ctx=avctx->priv_data;
+#ifdef HAVE_PTHREADS
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+#else
+    /* callers serialize avcodec_open() */
+    static int done = 0;
+#endif
     int i,k;
 
+#ifdef HAVE_PTHREADS
+    pthread_once(&once, g729_dsp_init_all);
+#else
+    if(!done)
+    {
+        g729_dsp_init_all();
+        done = 1;
+    }
+#endif
+
     if(avctx->sample_rate==8000)
         ctx->format=0;
 #ifdef G729_SUPPORT_4400
@@ -1646,12 +1977,19 @@ static int ff_g729a_decoder_init(AVCodecContext * avctx)
     for(i=0; i<10; i++)
         ctx->lsp_prev[i]=lsp_init[i];
 
+    /* LSF restored when first frames are erased, same as in reference decoder */
+    for(i=0; i<10; i++)
+        ctx->lsf_prev[i]=lq_init[i];
+
     for(k=1; k<MA_NP; k++)
         for(i=0; i<10; i++)
             ctx->lq_prev[k][i]=ctx->lq_prev[0][i];
 
     ctx->exc = &ctx->exc_base[PITCH_MAX+INTERPOL_LEN];
 
+    /* pitch delay of previous subframe (used on first frame erasure), same as in reference decoder */
+    ctx->pitch_delay_int_prev = 60;
+
     /* random seed initialization (4.4.4) */
     ctx->rand_value = 21845;
 
@@ -1664,24 +2002,26 @@ static int ff_g729a_decoder_init(AVCodecContext * avctx)
 }
 
 /**
- * \brief decode one G.729 frame into PCM samples
+ * \brief G.729A decoder initialization
+ * \param avctx private data structure
+ * \return 0 if success, non-zero otherwise
+ */
+static int ff_g729a_decoder_init(AVCodecContext * avctx)
+{
+    return g729a_context_init(avctx, avctx->priv_data);
+}
+
+/**
+ * \brief decodes LP filter coefficients of both subframes (3.2.4 - 3.2.6)
  * \param ctx private data structure
- * \param out_frame array for output PCM samples
- * \param out_frame_size maximum number of elements in output array
  * \param parm decoded parameters of the codec
  * \param frame_erasure frame erasure flag
- *
- * \return 2 * subframe_size
+ * \param lp [out] (Q12) LP filter coefficients of both subframes
  */
-static int  g729a_decode_frame_internal(G729A_Context* ctx, int16_t* out_frame, int out_frame_size, G729_parameters *parm, int frame_erasure)
+static void g729a_decode_lp_frame(G729A_Context* ctx, const G729_parameters *parm, int frame_erasure, int16_t *lp)
 {
-    int16_t lp[20];              // Q12
     int16_t lsp[10];             // Q15
     int16_t lsf[10];             // Q13
-    int pitch_delay_3x;          // pitch delay, multiplied by 3
-    int pitch_delay_int;         // pitch delay, integer part
-    int16_t fc[MAX_SUBFRAME_SIZE]; // fixed codebooc vector
-    int i, j;
 
     ctx->data_error = frame_erasure;
 
@@ -1701,115 +2041,197 @@ static int  g729a_decode_frame_internal(G729A_Context* ctx, int16_t* out_frame,
     g729_lsf2lsp(lsf, lsp);
 
     g729_lp_decode(lsp, ctx->lsp_prev, lp);
+}
 
-    for(i=0; i<2; i++)
-    {
+/**
+ * \brief decodes codebook vectors and gains of one subframe (4.1.3 - 4.1.5)
+ * \param ctx private data structure
+ * \param parm [in/out] decoded parameters of the codec
+ * \param i index of subframe within the frame
+ * \param fc [out] (Q13) fixed codebook vector
+ *
+ * Adaptive codebook vector is stored into excitation buffer, gains into
+ * ctx->gain_pitch and ctx->gain_code.
+ *
+ * \return integer part of the pitch delay
+ */
+static int g729a_decode_codebooks(G729A_Context* ctx, G729_parameters *parm, int i, int16_t *fc)
+{
+    int pitch_delay_3x;          // pitch delay, multiplied by 3
+    int pitch_delay_int;         // pitch delay, integer part
 
-        if(!i)
-        {
-            // Decoding of the adaptive-codebook vector delay for first subframe (4.1.3)
-            if(ctx->bad_pitch || ctx->data_error)
-                pitch_delay_3x = 3 * ctx->pitch_delay_int_prev + 1;
-            else
-            {
-                if(parm->ac_index[i] >= 197)
-                    pitch_delay_3x = 3 * parm->ac_index[i] - 335;
-                else
-                    pitch_delay_3x = parm->ac_index[i] + 59;
-            }
-        }
+    if(!i)
+    {
+        // Decoding of the adaptive-codebook vector delay for first subframe (4.1.3)
+        if(ctx->bad_pitch || ctx->data_error)
+            pitch_delay_3x = 3 * ctx->pitch_delay_int_prev + 1;
         else
         {
-            // Decoding of the adaptive-codebook vector delay for second subframe (4.1.3)
-            if(ctx->data_error)
-                pitch_delay_3x = 3 * ctx->pitch_delay_int_prev + 1;
+            if(parm->ac_index[i] >= 197)
+                pitch_delay_3x = 3 * parm->ac_index[i] - 335;
             else
-                pitch_delay_3x = parm->ac_index[i] +
-                        3 * av_clip(ctx->pitch_delay_int_prev-5, PITCH_MIN, PITCH_MAX-9) - 1;
+                pitch_delay_3x = parm->ac_index[i] + 59;
         }
-        pitch_delay_int = pitch_delay_3x / 3;
+    }
+    else
+    {
+        // Decoding of the adaptive-codebook vector delay for second subframe (4.1.3)
+        if(ctx->data_error)
+            pitch_delay_3x = 3 * ctx->pitch_delay_int_prev + 1;
+        else
+            pitch_delay_3x = parm->ac_index[i] +
+                    3 * av_clip(ctx->pitch_delay_int_prev-5, PITCH_MIN, PITCH_MAX-9) - 1;
+    }
+    pitch_delay_int = pitch_delay_3x / 3;
 
-        g729_decode_ac_vector(pitch_delay_int, (pitch_delay_3x%3)-1,
-                ctx->exc + i*ctx->subframe_size, ctx->subframe_size);
+    g729_decode_ac_vector(pitch_delay_int, (pitch_delay_3x%3)-1,
+            ctx->exc + i*ctx->subframe_size, ctx->subframe_size);
 
-        if(ctx->data_error)
-        {
-            ctx->rand_value = g729_random(ctx->rand_value);
-            parm->fc_indexes[i]   = ctx->rand_value & 0x1fff;
-            ctx->rand_value = g729_random(ctx->rand_value);
-            parm->pulses_signs[i] = ctx->rand_value & 0x000f;
-        }
+    if(ctx->data_error)
+    {
+        ctx->rand_value = g729_random(ctx->rand_value);
+        parm->fc_indexes[i]   = ctx->rand_value & 0x1fff;
+        ctx->rand_value = g729_random(ctx->rand_value);
+        parm->pulses_signs[i] = ctx->rand_value & 0x000f;
+    }
+
+    if(g729_decode_fc_vector(parm->fc_indexes[i],
+            formats[ctx->format].fc_index_bits,
+            parm->pulses_signs[i],
+            fc,
+            ctx->subframe_size))
+        ctx->data_error = 1;
+
+    g729_fix_fc_vector(pitch_delay_int, ctx->pitch_sharp, fc, ctx->subframe_size);
+    if(ctx->data_error)
+    {
+        /*
+            Decoding of the adaptive and fixed codebook gains
+            from previous subframe (4.4.2)
+        */
 
-        if(g729_decode_fc_vector(parm->fc_indexes[i],
-                formats[ctx->format].fc_index_bits,
-                parm->pulses_signs[i],
+        /* 4.4.2, Equation 94 */
+        ctx->gain_pitch = FFMIN((29491 * ctx->gain_pitch) >> 15, 29491); // 0.9 (Q15)
+
+        /* 4.4.2, Equation 93 */
+        ctx->gain_code  = (8028 * ctx->gain_code) >> 13; // 0.98 in Q13
+
+        g729_update_gain_erasure(ctx->pred_energ_q);
+    }
+    else
+    {
+        // Decoding of the fixed codebook gain (4.1.5 and 3.9.1)
+        ctx->gain_pitch = cb_GA[parm->ga_cb_index[i]][0] + cb_GB[parm->gb_cb_index[i]][0];
+
+        ctx->gain_code = g729_get_gain_code(parm->ga_cb_index[i],
+                parm->gb_cb_index[i],
                 fc,
-                ctx->subframe_size))
-            ctx->data_error = 1;
+                ctx->pred_energ_q,
+                ctx->subframe_size);
+    }
 
-        g729_fix_fc_vector(pitch_delay_int, ctx->pitch_sharp, fc, ctx->subframe_size);
-        if(ctx->data_error)
-        {
-            /*
-                Decoding of the adaptive and fixed codebook gains
-                from previous subframe (4.4.2)
-            */
+    /* save pitch sharpening for next subframe */
+    ctx->pitch_sharp = av_clip(ctx->gain_pitch, SHARP_MIN, SHARP_MAX);
 
-            /* 4.4.2, Equation 94 */
-            ctx->gain_pitch = FFMIN((29491 * ctx->gain_pitch) >> 15, 29491); // 0.9 (Q15)
+    return pitch_delay_int;
+}
 
-            /* 4.4.2, Equation 93 */
-            ctx->gain_code  = (8028 * ctx->gain_code) >> 13; // 0.98 in Q13
+/**
+ * \brief decodes excitation signal of one subframe (4.1.3 - 4.1.5)
+ * \param ctx private data structure
+ * \param parm [in/out] decoded parameters of the codec
+ * \param i index of subframe within the frame
+ *
+ * \return integer part of the pitch delay
+ */
+static int g729a_decode_excitation(G729A_Context* ctx, G729_parameters *parm, int i)
+{
+    int16_t fc[MAX_SUBFRAME_SIZE]; // fixed codebooc vector
+    int pitch_delay_int;
 
-            g729_update_gain_erasure(ctx->pred_energ_q);
-        }
-        else
-        {
-            // Decoding of the fixed codebook gain (4.1.5 and 3.9.1)
-            ctx->gain_pitch = cb_GA[parm->ga_cb_index[i]][0] + cb_GB[parm->gb_cb_index[i]][0];
-
-            ctx->gain_code = g729_get_gain_code(parm->ga_cb_index[i],
-                    parm->gb_cb_index[i],
-                    fc,
-                    ctx->pred_energ_q,
-                    ctx->subframe_size);
-        }
+    pitch_delay_int = g729a_decode_codebooks(ctx, parm, i, fc);
 
-        /* save pitch sharpening for next subframe */
-        ctx->pitch_sharp = av_clip(ctx->gain_pitch, SHARP_MIN, SHARP_MAX);
+    g729_mem_update(fc, ctx->gain_pitch, ctx->gain_code, ctx->exc + i*ctx->subframe_size, ctx->subframe_size);
 
-        g729_mem_update(fc, ctx->gain_pitch, ctx->gain_code, ctx->exc + i*ctx->subframe_size, ctx->subframe_size);
+    return pitch_delay_int;
+}
 
-        /* 4.1.6, Equation 77  */
-        if(g729_lp_synthesis_filter(lp+i*10, 
+/**
+ * \brief synthesizes speech of one subframe from excitation signal (4.1.6)
+ * \param ctx private data structure
+ * \param lp (Q12) LP filter coefficients of the subframe
+ * \param out [out] (Q0) reconstructed speech
+ * \param i index of subframe within the frame
+ */
+static void g729a_synthesis(G729A_Context* ctx, const int16_t *lp, int16_t *out, int i)
+{
+    int j;
+
+    /* 4.1.6, Equation 77  */
+    if(g729_lp_synthesis_filter(lp,
+            ctx->exc  + i*ctx->subframe_size,
+            out,
+            ctx->syn_filter_data,
+            ctx->subframe_size,
+            1))
+    {
+        //Overflow occured, downscale excitation signal...
+        for(j=0; j<2*MAX_SUBFRAME_SIZE+PITCH_MAX+INTERPOL_LEN; j++)
+            ctx->exc_base[j] >>= 2;
+
+        //... and call the same routine again
+        g729_lp_synthesis_filter(lp,
                 ctx->exc  + i*ctx->subframe_size,
-                out_frame + i*ctx->subframe_size,
+                out,
                 ctx->syn_filter_data,
                 ctx->subframe_size,
-                1))
-        {
-            //Overflow occured, downscale excitation signal...
-            for(j=0; j<2*MAX_SUBFRAME_SIZE+PITCH_MAX+INTERPOL_LEN; j++)
-                ctx->exc_base[j] >>= 2;
-
-            //... and call the same routine again
-            g729_lp_synthesis_filter(lp+i*10, 
-                    ctx->exc  + i*ctx->subframe_size,
-                    out_frame + i*ctx->subframe_size,
-                    ctx->syn_filter_data,
-                    ctx->subframe_size,
-                    0);
-        }
+                0);
+    }
+}
+
+/**
+ * \brief saves pitch delay of decoded subframe for the next one
+ * \param ctx private data structure
+ * \param pitch_delay_int integer part of the pitch delay
+ */
+static void g729a_update_pitch_delay(G729A_Context* ctx, int pitch_delay_int)
+{
+    if(ctx->data_error)
+        ctx->pitch_delay_int_prev = FFMIN(ctx->pitch_delay_int_prev + 1, PITCH_MAX);
+    else
+        ctx->pitch_delay_int_prev = pitch_delay_int;
+
+    ctx->subframe_idx++;
+}
+
+/**
+ * \brief decode one G.729 frame into PCM samples
+ * \param ctx private data structure
+ * \param out_frame array for output PCM samples
+ * \param out_frame_size maximum number of elements in output array
+ * \param parm decoded parameters of the codec
+ * \param frame_erasure frame erasure flag
+ *
+ * \return 2 * subframe_size
+ */
+static int  g729a_decode_frame_internal(G729A_Context* ctx, int16_t* out_frame, int out_frame_size, G729_parameters *parm, int frame_erasure)
+{
+    int16_t lp[20];              // Q12
+    int pitch_delay_int;         // pitch delay, integer part
+    int i;
+
+    g729a_decode_lp_frame(ctx, parm, frame_erasure, lp);
+
+    for(i=0; i<2; i++)
+    {
+        pitch_delay_int = g729a_decode_excitation(ctx, parm, i);
+
+        g729a_synthesis(ctx, lp+i*10, out_frame + i*ctx->subframe_size, i);
 
         /* 4.2 */
         g729a_postfilter(ctx, lp+i*10, pitch_delay_int, out_frame + i*ctx->subframe_size);
 
-        if(ctx->data_error)
-            ctx->pitch_delay_int_prev = FFMIN(ctx->pitch_delay_int_prev + 1, PITCH_MAX);
-        else
-            ctx->pitch_delay_int_prev = pitch_delay_int;
-
-        ctx->subframe_idx++;
+        g729a_update_pitch_delay(ctx, pitch_delay_int);
     }
 
     //Save signal for using in next frame
@@ -1822,106 +2244,3006 @@ static int  g729a_decode_frame_internal(G729A_Context* ctx, int16_t* out_frame,
 }
 
 /**
- * \brief decodes one G.729 frame (10 bytes long) into parameters vector
+ * \brief conceals one missing frame (no payload received)
  * \param ctx private data structure
- * \param buf 10 bytes of decoder parameters
- * \param buf_size size of input buffer
- * \param parm [out] decoded parameters of the codec
+ * \param out_frame array for output PCM samples
+ * \param out_frame_size maximum number of elements in output array
  *
- * \return 1 if frame erasure detected, 0 - otherwise
+ * Same as decoding erased frame: LSF, pitch delay and gains are extrapolated
+ * from previous frame, fixed-codebook vector is random.
+ *
+ * \return 2 * subframe_size
  */
-static int g729_bytes2parm(G729A_Context *ctx, const uint8_t *buf, int buf_size, G729_parameters *parm)
+static int g729a_conceal_frame(G729A_Context* ctx, int16_t* out_frame, int out_frame_size)
 {
-    GetBitContext gb;
-    int i, frame_nonzero;
-
-    init_get_bits(&gb, buf, buf_size);
+    G729_parameters parm;
 
-    frame_nonzero = 0;
-    for(i=0; i<buf_size; i++)
-        frame_nonzero |= get_bits(&gb, 8);//FIXME: Testing code, replace with buf[i]
+    memset(&parm, 0, sizeof(parm));
+    return g729a_decode_frame_internal(ctx, out_frame, out_frame_size, &parm, 1);
+}
 
-    if(!frame_nonzero)
-        return 1;
+/*
+-------------------------------------------------------------------------------
+          Batched decoding of independent channels
+------------------------------------------------------------------------------
+*/
 
-    init_get_bits(&gb, buf, buf_size);
+/**
+ * Number of channels decoded together by g729a_decode_frames_internal
+ */
+#define BATCH_SIZE 32
 
-    parm->ma_predictor     = get_bits(&gb, L0_BITS);        //L0
-    parm->quantizer_1st    = get_bits(&gb, L1_BITS);        //L1
-    parm->quantizer_2nd_lo = get_bits(&gb, L2_BITS);        //L2
-    parm->quantizer_2nd_hi = get_bits(&gb, L3_BITS);        //L3
+/**
+ * Working set of the batched decoder in structure-of-arrays layout.
+ *
+ * Element [n][c] holds n-th sample (or coefficient) of channel c, thus
+ * per-sample recursions of filters run over all channels in the innermost
+ * loop. Channel state is loaded from G729A_Context before each stage and
+ * stored back after it.
+ */
+typedef struct
+{
+    int count;                                      ///< number of channels in batch
+    int16_t lp[10][BATCH_SIZE];                     ///< (Q12) filter coefficients
+    int16_t in[MAX_SUBFRAME_SIZE][BATCH_SIZE];      ///< (Q0) filter input signal
+    int16_t data[MAX_SUBFRAME_SIZE+10][BATCH_SIZE]; ///< (Q0) previous filter data followed by filtered signal
+    int overflow[BATCH_SIZE];                       ///< overflow occured in synthesis filter
+    int16_t fc[MAX_SUBFRAME_SIZE][BATCH_SIZE];      ///< (Q13) fixed codebook vector
+    int16_t gain_pitch[BATCH_SIZE];                 ///< (Q14) adaptive codebook gain
+    int16_t gain_code[BATCH_SIZE];                  ///< (Q1) fixed codebook gain
+    int16_t lp_gn[10][BATCH_SIZE];                  ///< (Q12) A(z/GAMMA_N) filter coefficients
+    int16_t pf_speech[MAX_SUBFRAME_SIZE+10][BATCH_SIZE]; ///< (Q0) previous speech followed by speech to postfilter
+    int gain_before[BATCH_SIZE];                    ///< (Q0) gain of speech before postfilter
+    int gain_after[BATCH_SIZE];                     ///< (Q0) gain of speech after postfilter
+    int gain[BATCH_SIZE];                           ///< (Q12) AGC target gain
+    int16_t gain_coeff[BATCH_SIZE];                 ///< (Q12) AGC gain coefficient
+    int16_t speech[2*MAX_SUBFRAME_SIZE][BATCH_SIZE];///< (Q0) reconstructed speech for high-pass filter
+    int hpf_f[3][BATCH_SIZE];
+    int16_t hpf_z[3][BATCH_SIZE];
+} G729A_Batch;
+
+static void batch_load(int16_t (*dst)[BATCH_SIZE], int c, const int16_t *src, int length)
+{
+    int n;
 
-    parm->ac_index[0]      = get_bits(&gb, P1_BITS);        //P1
-    parm->parity           = get_bits(&gb, P0_BITS);        //P0 (parity)
-    parm->fc_indexes[0]    = get_bits(&gb, FC_BITS(ctx));   //C1
-    parm->pulses_signs[0]  = get_bits(&gb, FC_PULSE_COUNT); //S1
-    parm->ga_cb_index[0]   = get_bits(&gb, GA_BITS);        //GA1
-    parm->gb_cb_index[0]   = get_bits(&gb, GB_BITS);        //GB1
+    for(n=0; n<length; n++)
+        dst[n][c] = src[n];
+}
 
-    parm->ac_index[1]      = get_bits(&gb, P2_BITS);        //P2
-    parm->fc_indexes[1]    = get_bits(&gb, FC_BITS(ctx));   //C2
-    parm->pulses_signs[1]  = get_bits(&gb, FC_PULSE_COUNT); //S2
-    parm->ga_cb_index[1]   = get_bits(&gb, GA_BITS);        //GA2
-    parm->gb_cb_index[1]   = get_bits(&gb, GB_BITS);        //GB2
+static void batch_store(int16_t *dst, int16_t (*src)[BATCH_SIZE], int c, int length)
+{
+    int n;
 
-    return 0;
+    for(n=0; n<length; n++)
+        dst[n] = src[n][c];
 }
 
+/**
+ * \brief LP synthesis filter over all channels of batch
+ * \param b batch working set: lp, in and first 10 rows of data are used as input
+ * \param subframe_size length of subframe
+ *
+ * Does the same as g729_lp_synthesis_filter with exit_on_overflow=0 for each
+ * channel and sets overflow flag of channels where g729_lp_synthesis_filter
+ * with exit_on_overflow=1 would fail.
+ */
+static void g729_lp_synthesis_filter_batch(G729A_Batch *b, int subframe_size)
+{
+    int i, n, c;
+    int sum;
 
-static int ff_g729a_decode_frame(AVCodecContext *avctx,
-                             void *data, int *data_size,
-                             const uint8_t *buf, int buf_size)
+    for(n=0; n<subframe_size; n++)
+    {
+        for(c=0; c<b->count; c++)
+        {
+            sum = b->in[n][c] << 12;
+            for(i=0; i<10; i++)
+                sum -= b->lp[i][c] * b->data[n+9-i][c];
+            sum >>= 12;
+            b->overflow[c] |= sum > SHRT_MAX || sum < SHRT_MIN;
+            b->data[n+10][c] = av_clip_int16(sum);
+        }
+    }
+}
+
+/**
+ * \brief memory update (3.10) over all channels of batch
+ * \param b batch working set: adaptive codebook vector in in is replaced by excitation
+ * \param subframe_size length of subframe
+ */
+static void g729_mem_update_batch(G729A_Batch *b, int subframe_size)
 {
-    G729_parameters parm;
-    G729A_Context *ctx=avctx->priv_data;
-    int  in_frame_size = formats[ctx->format]. input_frame_size;
-    int out_frame_size = formats[ctx->format].output_frame_size;
-    int frame_erasure;
+    int n, c;
+    int sum;
 
-    if (buf_size<in_frame_size)
-        return AVERROR(EIO);
+    for(n=0; n<subframe_size; n++)
+    {
+        for(c=0; c<b->count; c++)
+        {
+            sum = b->in[n][c] * b->gain_pitch[c] + b->fc[n][c] * b->gain_code[c];
+            sum = av_clip(sum, SHRT_MIN << 14, SHRT_MAX << 14);
+            b->in[n][c] = g729_round(sum << 2);
+        }
+    }
+}
 
-    frame_erasure = g729_bytes2parm(ctx, buf, in_frame_size, &parm);
+/**
+ * \brief gain of speech before postfilter and residual signal (4.2.1)
+ *        over all channels of batch
+ * \param b batch working set: speech is taken from pf_speech, filter
+ *          coefficients from lp_gn, residual is stored into in
+ * \param subframe_size length of subframe
+ */
+static void g729_residual_batch(G729A_Batch *b, int subframe_size)
+{
+    int i, n, c;
+    int sum[BATCH_SIZE];
 
-    *data_size = g729a_decode_frame_internal(ctx, (int16_t*)data, out_frame_size, &parm, frame_erasure);
+    for(c=0; c<b->count; c++)
+        b->gain_before[c] = 0;
 
-    return in_frame_size;
+    for(n=0; n<subframe_size; n++)
+    {
+        for(c=0; c<b->count; c++)
+        {
+            b->gain_before[c] += (b->pf_speech[n+10][c] >> 4) * (b->pf_speech[n+10][c] >> 4);
+            sum[c] = b->pf_speech[n+10][c] << 12;
+        }
+        for(i=0; i<10; i++)
+            for(c=0; c<b->count; c++)
+                sum[c] += b->lp_gn[i][c] * b->pf_speech[n+9-i][c];
+        for(c=0; c<b->count; c++)
+            b->in[n][c] = g729_round(av_clip(sum[c], SHRT_MIN << 12, SHRT_MAX << 12) << 4);
+    }
 }
 
-AVCodec g729a_decoder =
+/**
+ * \brief tilt compensation (4.2.3) over all channels of batch
+ * \param ctx private data structures of channels
+ * \param b batch working set: filter coefficients are taken from lp_gn and
+ *          lp (A(z/GAMMA_D)), residual signal in in is filtered in place
+ * \param subframe_size length of subframe
+ */
+static void g729a_tilt_compensation_batch(G729A_Context **ctx, G729A_Batch *b, int subframe_size)
 {
-    "g729a",
-    CODEC_TYPE_AUDIO,
-    CODEC_ID_G729A,
-    sizeof(G729A_Context),
-    ff_g729a_decoder_init,
-    NULL,
-    NULL,
-    ff_g729a_decode_frame,
-};
+    int16_t hf[11+22][BATCH_SIZE]; // Q12 A(Z/GAMMA_N)/A(z/GAMMA_D) filter impulse response
+    int sum[BATCH_SIZE];
+    int rh0[BATCH_SIZE], rh1[BATCH_SIZE];
+    int gt, tmp;
+    int i, n, c;
+
+    memset(hf, 0, sizeof(hf));
+    for(c=0; c<b->count; c++)
+        hf[10][c] = 4096; //1.0 in Q12
+    for(i=0; i<10; i++)
+        memcpy(hf[i+11], b->lp_gn[i], b->count * sizeof(int16_t));
 
-#ifdef G729A_NATIVE
-/* debugging  stubs */
-void* g729a_decoder_init()
-{
-    AVCodecContext *avctx=av_mallocz(sizeof(AVCodecContext));
-    avctx->priv_data=av_mallocz(sizeof(G729A_Context));
-    avctx->sample_rate=8000;
-    avctx->channels=1;
-    ff_g729a_decoder_init(avctx);
-    return avctx;
+    /* Apply 1/A(z/GAMMA_D) filter to hf */
+    for(n=0; n<22; n++)
+    {
+        for(c=0; c<b->count; c++)
+            sum[c] = hf[n+10][c];
+        for(i=0; i<10; i++)
+            for(c=0; c<b->count; c++)
+                sum[c] -= (b->lp[i][c] * hf[n+10-i-1][c]) >> 12;
+        for(c=0; c<b->count; c++)
+            hf[n+10][c] = sum[c];
+    }
+
+    /* A.4.2.3, Equation A.14, rh(0) and rh(1) */
+    for(c=0; c<b->count; c++)
+        rh0[c] = rh1[c] = 0;
+    for(n=0; n<22; n++)
+        for(c=0; c<b->count; c++)
+            rh0[c] += hf[n+10][c] * hf[n+10][c];
+    for(n=0; n<22-1; n++)
+        for(c=0; c<b->count; c++)
+            rh1[c] += hf[n+10][c] * hf[n+11][c];
+
+    /* A.4.2.3. Equation A.13, apply filter to signal */
+    for(c=0; c<b->count; c++)
+    {
+        gt = g729a_tilt_gain(rh0[c] >> 12, rh1[c] >> 12); // Q24 -> Q12
+
+        tmp = b->in[subframe_size-1][c];
+        for(n=subframe_size-1; n>=1; n--)
+            b->in[n][c] += (gt * b->in[n-1][c]) >> 12;
+        b->in[0][c] += (gt * ctx[c]->ht_prev_data) >> 12;
+        ctx[c]->ht_prev_data = tmp;
+    }
 }
-int g729a_decoder_uninit(void* ctx)
+
+/**
+ * \brief adaptive gain control (4.2.4) over all channels of batch
+ * \param b batch working set: filtered speech is taken from data
+ * \param subframe_size length of subframe
+ */
+static void g729a_adaptive_gain_control_batch(G729A_Batch *b, int subframe_size)
 {
-  return 0;
+    int n, c;
+    int16_t gain_prev;
+
+    for(c=0; c<b->count; c++)
+        b->gain_after[c] = 0;
+
+    for(n=0; n<subframe_size; n++)
+        for(c=0; c<b->count; c++)
+            b->gain_after[c] += (b->data[n+10][c] >> 4) * (b->data[n+10][c] >> 4);
+
+    for(c=0; c<b->count; c++)
+        b->gain[c] = b->gain_after[c] ? g729a_agc_gain(b->gain_before[c], b->gain_after[c]) : 0;
+
+    for(n=0; n<subframe_size; n++)
+    {
+        for(c=0; c<b->count; c++)
+        {
+            // 0.9 * ctx->gain_coeff + 0.1 * gain
+            gain_prev = (29491 * b->gain_coeff[c] + 3276 * b->gain[c]) >> 15;
+            if(b->gain_after[c])
+            {
+                b->gain_coeff[c] = gain_prev;
+                b->data[n+10][c] = (b->data[n+10][c] * gain_prev) >> 12;
+            }
+        }
+    }
 }
-int  g729a_decode_frame(AVCodecContext* avctx, int16_t* serial, int serial_size, int16_t* out_frame, int out_frame_size)
+
+/**
+ * \brief high-pass filtering and upscaling (4.2.5) over all channels of batch
+ * \param b batch working set: speech is filtered in place
+ * \param length size of input data
+ */
+static void g729_high_pass_filter_batch(G729A_Batch *b, int length)
 {
-    G729_parameters parm;
-    int frame_erasure;
+    int n, c;
+    int f;
 
-    frame_erasure = g729_bytes2parm(avctx->priv_data, (uint8_t*)serial, 82, &parm);
+    for(n=0; n<length; n++)
+    {
+        for(c=0; c<b->count; c++)
+        {
+            b->hpf_z[2][c] = b->hpf_z[1][c];
+            b->hpf_z[1][c] = b->hpf_z[0][c];
+            b->hpf_z[0][c] = b->speech[n][c];
 
-    return g729a_decode_frame_internal(avctx->priv_data, out_frame, out_frame_size, &parm, frame_erasure);
+            f = mul_24_15(b->hpf_f[1][c], 15836)
+                + mul_24_15(b->hpf_f[2][c], -7667)
+                + 7699 * (b->hpf_z[0][c] - 2*b->hpf_z[1][c] + b->hpf_z[2][c]);
+            f <<= 2; // Q13 -> Q15
+
+            b->speech[n][c] = av_clip_int16(f >> 14); // 2*f_0 in 15
+
+            b->hpf_f[2][c] = b->hpf_f[1][c];
+            b->hpf_f[1][c] = f;
+            b->hpf_f[0][c] = f;
+        }
+    }
 }
-#endif /* G729A_NATIVE */
+
+/**
+ * \brief decode one G.729 frame for each of up to BATCH_SIZE channels
+ * \param ctx private data structures of channels (all using the same format)
+ * \param count number of channels
+ * \param out_frame arrays for output PCM samples, one per channel
+ * \param parm decoded parameters of the codec, one per channel
+ * \param frame_erasure frame erasure flags, one per channel
+ *
+ * Produces exactly the same output as g729a_decode_frame_internal called for
+ * each channel in turn, but runs the per-sample stages (memory update, LP
+ * synthesis, residual and tilt compensation of postfilter, second half of
+ * short-term postfilter, AGC and high-pass filter) across channels.
+ *
+ * Stages left per channel depend on channel specific delays: adaptive
+ * codebook interpolation reads excitation at the pitch delay of the channel
+ * (and feeds back into itself for delays shorter than subframe), long-term
+ * postfilter searches correlations around it. Gain decoding is a few scalar
+ * operations per subframe. They use the per-channel DSP routines, which are
+ * vectorized over samples instead.
+ */
+static void g729a_decode_frames_internal(G729A_Context** ctx, int count, int16_t** out_frame, G729_parameters *parm, const int *frame_erasure)
+{
+    G729A_Batch b;
+    int16_t lp[BATCH_SIZE][20];  // Q12
+    int pitch_delay_int[BATCH_SIZE];
+    int16_t residual_filt[MAX_SUBFRAME_SIZE];
+    int16_t fc[MAX_SUBFRAME_SIZE];
+    int16_t lp_w[10];            // Q12
+    int subframe_size = ctx[0]->subframe_size;
+    int i, c, k;
+
+    assert(count > 0 && count <= BATCH_SIZE);
+
+    b.count = count;
+
+    for(c=0; c<count; c++)
+    {
+        assert(ctx[c]->subframe_size == subframe_size);
+        g729a_decode_lp_frame(ctx[c], parm + c, frame_erasure[c], lp[c]);
+    }
+
+    for(i=0; i<2; i++)
+    {
+        for(c=0; c<count; c++)
+        {
+            pitch_delay_int[c] = g729a_decode_codebooks(ctx[c], parm + c, i, fc);
+
+            batch_load(b.fc,   c, fc, subframe_size);
+            batch_load(b.in,   c, ctx[c]->exc + i*subframe_size, subframe_size);
+            b.gain_pitch[c] = ctx[c]->gain_pitch;
+            b.gain_code[c]  = ctx[c]->gain_code;
+        }
+
+        /* 3.10 */
+        g729_mem_update_batch(&b, subframe_size);
+
+        for(c=0; c<count; c++)
+        {
+            batch_store(ctx[c]->exc + i*subframe_size, b.in, c, subframe_size);
+
+            batch_load(b.lp,   c, lp[c] + i*10, 10);
+            batch_load(b.data, c, ctx[c]->syn_filter_data, 10);
+            b.overflow[c] = 0;
+        }
+
+        /* 4.1.6, Equation 77  */
+        g729_lp_synthesis_filter_batch(&b, subframe_size);
+
+        for(k=0; k<subframe_size; k++)
+            memcpy(b.pf_speech[k + 10], b.data[k + 10], count * sizeof(int16_t));
+
+        for(c=0; c<count; c++)
+        {
+            if(b.overflow[c])
+            {
+                g729a_synthesis(ctx[c], lp[c] + i*10, out_frame[c] + i*subframe_size, i);
+                batch_load(b.pf_speech + 10, c, out_frame[c] + i*subframe_size, subframe_size);
+            }
+            else
+                batch_store(ctx[c]->syn_filter_data, b.data + subframe_size, c, 10);
+
+            /* 4.2 */
+            batch_load(b.pf_speech, c, ctx[c]->pos_filter_data, 10);
+            g729a_weighted_filter(lp[c] + i*10, GAMMA_N, lp_w);
+            batch_load(b.lp_gn, c, lp_w, 10);
+            g729a_weighted_filter(lp[c] + i*10, GAMMA_D, lp_w);
+            batch_load(b.lp, c, lp_w, 10);
+        }
+
+        /* Residual signal calculation (one-half of short-term postfilter) */
+        g729_residual_batch(&b, subframe_size);
+
+        for(c=0; c<count; c++)
+        {
+            batch_store(ctx[c]->pos_filter_data, b.pf_speech + subframe_size, c, 10);
+            batch_store(ctx[c]->residual + PITCH_MAX, b.in, c, subframe_size);
+
+            /* long-term filter (A.4.2.1) */
+            g729a_long_term_filter(pitch_delay_int[c], ctx[c]->residual, residual_filt, subframe_size);
+            memmove(ctx[c]->residual, ctx[c]->residual + subframe_size, PITCH_MAX*sizeof(int16_t));
+
+            batch_load(b.in,   c, residual_filt, subframe_size);
+            batch_load(b.data, c, ctx[c]->res_filter_data, 10);
+            b.gain_coeff[c] = ctx[c]->gain_coeff;
+
+            g729a_update_pitch_delay(ctx[c], pitch_delay_int[c]);
+        }
+
+        /* short-term filter tilt compensation (A.4.2.3) */
+        g729a_tilt_compensation_batch(ctx, &b, subframe_size);
+
+        /* Apply second half of short-term postfilter: 1/A(z/GAMMA_D)*/
+        g729_lp_synthesis_filter_batch(&b, subframe_size);
+
+        for(c=0; c<count; c++)
+            batch_store(ctx[c]->res_filter_data, b.data + subframe_size, c, 10);
+
+        /* adaptive gain control (A.4.2.4) */
+        g729a_adaptive_gain_control_batch(&b, subframe_size);
+
+        for(c=0; c<count; c++)
+            ctx[c]->gain_coeff = b.gain_coeff[c];
+        for(k=0; k<subframe_size; k++)
+            memcpy(b.speech[i*subframe_size + k], b.data[k + 10], count * sizeof(int16_t));
+    }
+
+    for(c=0; c<count; c++)
+    {
+        //Save signal for using in next frame
+        memmove(ctx[c]->exc_base, ctx[c]->exc_base + 2*subframe_size, (PITCH_MAX+INTERPOL_LEN)*sizeof(int16_t));
+
+        for(k=0; k<3; k++)
+        {
+            b.hpf_f[k][c] = ctx[c]->hpf_f[k];
+            b.hpf_z[k][c] = ctx[c]->hpf_z[k];
+        }
+    }
+
+    //Postprocessing
+    g729_high_pass_filter_batch(&b, 2 * subframe_size);
+
+    for(c=0; c<count; c++)
+    {
+        batch_store(out_frame[c], b.speech, c, 2 * subframe_size);
+
+        for(k=0; k<3; k++)
+        {
+            ctx[c]->hpf_f[k] = b.hpf_f[k][c];
+            ctx[c]->hpf_z[k] = b.hpf_z[k][c];
+        }
+    }
+}
+
+/**
+ * \brief extracts next field of packed frame
+ * \param hi first 64 bits of frame
+ * \param lo last 64 bits of frame
+ * \param frame_bits size of frame in bits
+ * \param pos [in/out] position of field in frame, advanced past it
+ * \param bits size of field in bits
+ *
+ * Field is taken from whichever word holds it completely. With constant
+ * frame layout it reduces to single shift and mask.
+ */
+static inline int g729_get_field(uint64_t hi, uint64_t lo, int frame_bits, int *pos, int bits)
+{
+    int end = *pos += bits;
+
+    if(end <= 64)
+        return (hi >> (64 - end)) & ((1 << bits) - 1);
+    return (lo >> (frame_bits - end)) & ((1 << bits) - 1);
+}
+
+/**
+ * \brief unpacks fields of frame into parameters vector
+ * \param hi first 64 bits of frame
+ * \param lo last 64 bits of frame
+ * \param frame_bits size of frame in bits
+ * \param fc_bits size of fixed-codebook index in bits
+ * \param parm [out] decoded parameters of the codec
+ */
+static inline void g729_unpack_frame(uint64_t hi, uint64_t lo, int frame_bits, int fc_bits, G729_parameters *parm)
+{
+    int pos = 0;
+
+    parm->ma_predictor     = g729_get_field(hi, lo, frame_bits, &pos, L0_BITS);        //L0
+    parm->quantizer_1st    = g729_get_field(hi, lo, frame_bits, &pos, L1_BITS);        //L1
+    parm->quantizer_2nd_lo = g729_get_field(hi, lo, frame_bits, &pos, L2_BITS);        //L2
+    parm->quantizer_2nd_hi = g729_get_field(hi, lo, frame_bits, &pos, L3_BITS);        //L3
+
+    parm->ac_index[0]      = g729_get_field(hi, lo, frame_bits, &pos, P1_BITS);        //P1
+    parm->parity           = g729_get_field(hi, lo, frame_bits, &pos, P0_BITS);        //P0 (parity)
+    parm->fc_indexes[0]    = g729_get_field(hi, lo, frame_bits, &pos, fc_bits);        //C1
+    parm->pulses_signs[0]  = g729_get_field(hi, lo, frame_bits, &pos, FC_PULSE_COUNT); //S1
+    parm->ga_cb_index[0]   = g729_get_field(hi, lo, frame_bits, &pos, GA_BITS);        //GA1
+    parm->gb_cb_index[0]   = g729_get_field(hi, lo, frame_bits, &pos, GB_BITS);        //GB1
+
+    parm->ac_index[1]      = g729_get_field(hi, lo, frame_bits, &pos, P2_BITS);        //P2
+    parm->fc_indexes[1]    = g729_get_field(hi, lo, frame_bits, &pos, fc_bits);        //C2
+    parm->pulses_signs[1]  = g729_get_field(hi, lo, frame_bits, &pos, FC_PULSE_COUNT); //S2
+    parm->ga_cb_index[1]   = g729_get_field(hi, lo, frame_bits, &pos, GA_BITS);        //GA2
+    parm->gb_cb_index[1]   = g729_get_field(hi, lo, frame_bits, &pos, GB_BITS);        //GB2
+}
+
+/**
+ * \brief decodes one G.729 frame (10 bytes long) into parameters vector
+ * \param ctx private data structure
+ * \param buf 10 bytes of decoder parameters
+ * \param buf_size size of input buffer
+ * \param parm [out] decoded parameters of the codec
+ *
+ * Frame is loaded as two big-endian words (first 64 and last 64 bits of
+ * frame, overlapping) in single pass.
+ *
+ * \return 1 if frame erasure detected, 0 - otherwise
+ */
+static int g729_bytes2parm(G729A_Context *ctx, const uint8_t *buf, int buf_size, G729_parameters *parm)
+{
+    int frame_size = formats[ctx->format].input_frame_size;
+    uint64_t hi, lo;
+    int i;
+
+    hi = (uint64_t)AV_RB32(buf) << 32 | (uint32_t)AV_RB32(buf + 4);
+
+    if(frame_size == 10)
+    {
+        lo = hi << 16 | AV_RB16(buf + 8);
+        if(!(hi | lo))
+            return 1;
+        g729_unpack_frame(hi, lo, 80, 3*FC_PULSE_COUNT+1, parm);
+        return 0;
+    }
+
+    lo = hi;
+    for(i=8; i<frame_size; i++)
+        lo = lo << 8 | buf[i];
+    if(!(hi | lo))
+        return 1;
+    g729_unpack_frame(hi, lo, 8*frame_size, FC_BITS(ctx), parm);
+    return 0;
+}
+
+/**
+ * \brief decodes consecutive G.729 frames (e.g. whole ACT chunk) into parameters vectors
+ * \param ctx private data structure
+ * \param buf frames of decoder parameters
+ * \param frames number of frames in buffer
+ * \param parm [out] decoded parameters of the codec, one per frame
+ * \param frame_erasure [out] frame erasure flags, one per frame
+ */
+static void g729_bytes2parms(G729A_Context *ctx, const uint8_t *buf, int frames, G729_parameters *parm, int *frame_erasure)
+{
+    int in_frame_size = formats[ctx->format].input_frame_size;
+    int i;
+
+    for(i=0; i<frames; i++)
+        frame_erasure[i] = g729_bytes2parm(ctx, buf + i*in_frame_size, in_frame_size, parm + i);
+}
+
+/**
+ * Number of frames unpacked from packet at once (ACT chunk holds 51 frames)
+ */
+#define PACKET_FRAMES 64
+
+/**
+ * \brief decodes all whole frames of packet
+ *
+ * Packet may hold any number of frames (as many as fit into output buffer
+ * are decoded).
+ */
+static int ff_g729a_decode_frame(AVCodecContext *avctx,
+                             void *data, int *data_size,
+                             const uint8_t *buf, int buf_size)
+{
+    G729_parameters parm[PACKET_FRAMES];
+    int frame_erasure[PACKET_FRAMES];
+    G729A_Context *ctx=avctx->priv_data;
+    int  in_frame_size = formats[ctx->format]. input_frame_size;
+    int out_frame_size = formats[ctx->format].output_frame_size;
+    int16_t *out = data;
+    int frames, i, j, n;
+
+    frames = FFMIN(buf_size / in_frame_size, *data_size / out_frame_size);
+    if (frames < 1)
+        return AVERROR(EIO);
+
+    for(i=0; i<frames; i+=n)
+    {
+        n = FFMIN(frames - i, PACKET_FRAMES);
+        g729_bytes2parms(ctx, buf + i*in_frame_size, n, parm, frame_erasure);
+        for(j=0; j<n; j++)
+            out += g729a_decode_frame_internal(ctx, out, out_frame_size, parm + j, frame_erasure[j]) / sizeof(int16_t);
+    }
+
+    *data_size = frames * out_frame_size;
+
+    return frames * in_frame_size;
+}
+
+/**
+ * \brief conceals one missing frame (e.g. lost packet or damaged chunk)
+ * \param avctx decoder context
+ * \param data array for output PCM samples
+ * \param data_size [out] size of output data (in bytes)
+ *
+ * \return 0
+ */
+int ff_g729a_decode_lost_frame(AVCodecContext *avctx, int16_t *data, int *data_size)
+{
+    G729A_Context *ctx=avctx->priv_data;
+
+    *data_size = g729a_conceal_frame(ctx, data, formats[ctx->format].output_frame_size);
+    return 0;
+}
+
+/**
+ * \brief decodes one G.729 frame for each of several independent channels
+ * \param avctx decoder contexts, one per channel (all using the same sample rate)
+ * \param count number of channels
+ * \param data arrays for output PCM samples, one per channel
+ * \param data_size [out] size of output data (in bytes) per channel
+ * \param buf input frames, one per channel
+ * \param buf_size size of each input frame
+ *
+ * \return number of bytes consumed from each input frame, negative on error
+ */
+int ff_g729a_decode_frames(AVCodecContext **avctx, int count,
+                             int16_t **data, int *data_size,
+                             const uint8_t **buf, int buf_size)
+{
+    G729_parameters parm[BATCH_SIZE];
+    int frame_erasure[BATCH_SIZE];
+    G729A_Context *ctx[BATCH_SIZE];
+    int  in_frame_size = formats[((G729A_Context*)avctx[0]->priv_data)->format]. input_frame_size;
+    int out_frame_size = formats[((G729A_Context*)avctx[0]->priv_data)->format].output_frame_size;
+    int i, c;
+
+    if (buf_size<in_frame_size)
+        return AVERROR(EIO);
+
+    for(i=0; i<count; i+=BATCH_SIZE)
+    {
+        for(c=0; c<FFMIN(count-i, BATCH_SIZE); c++)
+        {
+            ctx[c] = avctx[i+c]->priv_data;
+            frame_erasure[c] = g729_bytes2parm(ctx[c], buf[i+c], in_frame_size, parm + c);
+        }
+        g729a_decode_frames_internal(ctx, c, data + i, parm, frame_erasure);
+    }
+
+    *data_size = out_frame_size;
+
+    return in_frame_size;
+}
+
+AVCodec g729a_decoder =
+{
+    "g729a",
+    CODEC_TYPE_AUDIO,
+    CODEC_ID_G729A,
+    sizeof(G729A_Context),
+    ff_g729a_decoder_init,
+    NULL,
+    NULL,
+    ff_g729a_decode_frame,
+};
+
+/*
+-------------------------------------------------------------------------------
+          Encoder
+------------------------------------------------------------------------------
+*/
+
+#define LP_WINDOW_SIZE 240    ///< LP analysis window: 120 past, 80 current and 40 lookahead samples (3.2.1)
+#define LOOKAHEAD_SIZE 40     ///< number of lookahead samples (3.2.1)
+#define GRID_POINTS 50        ///< number of intervals in LSP root search grid (3.2.3)
+
+#define GAMMA_W 24576 //0.75 in Q15, perceptual weighting factor (A.3.3)
+#define GAMMA_WSP 22938 //0.70 in Q15, tilt of weighted speech filter (A.3.3)
+
+/* 3.7.3, gain pitch is bounded by 0 and 1.2 */
+#define GAIN_PITCH_MAX 19661 //1.2 in Q14
+
+/* Taming procedure (3.8) */
+#define GAIN_PITCH_TAMED 15564 //0.95 in Q14
+#define GAIN_PITCH_TAMED_BEST 481 //0.94 in Q9, limit of optimal gain pitch in gain codebook preselection
+#define GAIN_PITCH_TAMED_CB 16383 //0.9999 in Q14, limit of quantized gain pitch
+#define EXC_ERR_THRESHOLD 983040000 //60000 in Q14
+
+/* LSF rearrangement (3.2.4) */
+#define LSFQ_GAP1 10 //0.0012 in Q13
+#define LSFQ_GAP2  5 //0.0006 in Q13
+
+/* Number of gain codebooks' entries checked after preselection (3.9.2) */
+#define GA_CB_CANDIDATES 4
+#define GB_CB_CANDIDATES 8
+
+/**
+ * LP analysis window (3.2.1, Equation 3)
+ */
+static const int16_t lp_window[LP_WINDOW_SIZE] =
+{ /* Q15 */
+   2621,   2623,   2629,   2638,   2651,   2668,   2689,   2713,   2741,   2772,
+   2808,   2847,   2890,   2936,   2986,   3040,   3097,   3158,   3223,   3291,
+   3363,   3438,   3517,   3599,   3685,   3774,   3867,   3963,   4063,   4166,
+   4272,   4382,   4495,   4611,   4731,   4853,   4979,   5108,   5240,   5376,
+   5514,   5655,   5800,   5947,   6097,   6250,   6406,   6565,   6726,   6890,
+   7057,   7227,   7399,   7573,   7750,   7930,   8112,   8296,   8483,   8672,
+   8863,   9057,   9252,   9450,   9650,   9852,  10055,  10261,  10468,  10677,
+  10888,  11101,  11315,  11531,  11748,  11967,  12187,  12409,  12632,  12856,
+  13082,  13308,  13536,  13764,  13994,  14225,  14456,  14688,  14921,  15155,
+  15389,  15624,  15859,  16095,  16331,  16568,  16805,  17042,  17279,  17516,
+  17754,  17991,  18228,  18465,  18702,  18939,  19175,  19411,  19647,  19882,
+  20117,  20350,  20584,  20816,  21048,  21279,  21509,  21738,  21967,  22194,
+  22420,  22644,  22868,  23090,  23311,  23531,  23749,  23965,  24181,  24394,
+  24606,  24816,  25024,  25231,  25435,  25638,  25839,  26037,  26234,  26428,
+  26621,  26811,  26999,  27184,  27368,  27548,  27727,  27903,  28076,  28247,
+  28415,  28581,  28743,  28903,  29061,  29215,  29367,  29515,  29661,  29804,
+  29944,  30081,  30214,  30345,  30472,  30597,  30718,  30836,  30950,  31062,
+  31170,  31274,  31376,  31474,  31568,  31659,  31747,  31831,  31911,  31988,
+  32062,  32132,  32198,  32261,  32320,  32376,  32428,  32476,  32521,  32561,
+  32599,  32632,  32662,  32688,  32711,  32729,  32744,  32755,  32763,  32767,
+  32767,  32741,  32665,  32537,  32359,  32129,  31850,  31521,  31143,  30716,
+  30242,  29720,  29151,  28538,  27879,  27177,  26433,  25647,  24821,  23957,
+  23055,  22117,  21145,  20139,  19102,  18036,  16941,  15820,  14674,  13505,
+  12315,  11106,   9879,   8637,   7381,   6114,   4838,   3554,   2264,    971
+};
+
+/**
+ * Lag window (3.2.1, Equation 6): 60Hz bandwidth expansion and 1.0001 white
+ * noise correction in double precision format (high and low parts)
+ */
+static const int16_t lag_window_hi[10] =
+{ /* Q31 >> 16 */
+  32728, 32619, 32438, 32187, 31867, 31480, 31029, 30517, 29946, 29321
+};
+static const int16_t lag_window_lo[10] =
+{ /* (Q31 & 0xffff) >> 1 */
+  11904, 17280, 30720, 25856, 24192, 28992, 24384,  7360, 19520, 14784
+};
+
+/**
+ * Grid of LSP root search, cos(PI*j/GRID_POINTS)
+ */
+static const int16_t lsp_grid[GRID_POINTS+1] =
+{ /* Q15 */
+  32760,  32703,  32509,  32187,  31738,  31164,  30466,  29649,  28714,  27666,
+  26509,  25248,  23886,  22431,  20887,  19260,  17557,  15786,  13951,  12062,
+  10125,   8149,   6140,   4106,   2057,      0,  -2057,  -4106,  -6140,  -8149,
+ -10125, -12062, -13951, -15786, -17557, -19260, -20887, -22431, -23886, -25248,
+ -26509, -27666, -28714, -29649, -30466, -31164, -31738, -32187, -32509, -32703,
+ -32760
+};
+
+/**
+ * Slope used to compute y = acos(x)
+ *
+ * acos(base_cos[ind]+offset) = (ind+offset*slope_acos[ind])*PI/64
+ */
+static const int16_t slope_acos[64] =
+{ /* Q12 */
+ -26887,  -8812,  -5323,  -3813,  -2979,  -2444,  -2081,  -1811,
+  -1608,  -1450,  -1322,  -1219,  -1132,  -1059,   -998,   -946,
+   -901,   -861,   -827,   -797,   -772,   -750,   -730,   -713,
+   -699,   -687,   -677,   -668,   -662,   -657,   -654,   -652,
+   -652,   -654,   -657,   -662,   -668,   -677,   -687,   -699,
+   -713,   -730,   -750,   -772,   -797,   -827,   -861,   -901,
+   -946,   -998,  -1059,  -1132,  -1219,  -1322,  -1450,  -1608,
+  -1811,  -2081,  -2444,  -2979,  -3813,  -5323,  -8812, -26887
+};
+
+/**
+ * GA and GB codebooks' entries in order of increasing gain pitch (see
+ * comments of cb_GA and cb_GB), candidates of gain quantizer are taken from it
+ */
+static const uint8_t ga_cb_order[GA_CB_SIZE] = {5, 1, 4, 7, 3, 0, 6, 2};
+static const uint8_t gb_cb_order[GB_CB_SIZE] = {4, 6, 0, 2, 12, 14, 8, 10, 15, 11, 9, 13, 7, 3, 1, 5};
+
+/**
+ * Thresholds of gain codebooks preselection (3.9.2)
+ */
+static const int16_t ga_cb_threshold[GA_CB_SIZE-GA_CB_CANDIDATES] =
+{ /* Q14 */
+  10808, 12374, 19778, 32567
+};
+static const int16_t gb_cb_threshold[GB_CB_SIZE-GB_CB_CANDIDATES] =
+{ /* Q15 */
+  14087, 16188, 20274, 21321, 23525, 25232, 27873, 30542
+};
+
+/**
+ * Coefficients of lines separating gain codebooks' entries (3.9.2)
+ */
+static const int16_t gain_presel_coef[2][2] =
+{ /* Q10    Q14     Q16    Q19 */
+  {31881, 26416}, {31548, 27816}
+};
+static const int gain_presel_coef32[2][2] =
+{ /* Q26         Q30           Q32         Q35 */
+  {2089405952, 1731217536}, {2067549984, 1822990272}
+};
+#define GAIN_PRESEL_INV_COEF -17103 // Q19
+
+typedef struct
+{
+    G729A_Context dec;          ///< quantizers' state and excitation, same as in remote decoder
+    /// preprocessed speech: past, current frame and lookahead
+    int16_t speech_base[LP_WINDOW_SIZE];
+    /// past and current weighted speech (open-loop pitch analysis)
+    int16_t wsp_base[PITCH_MAX+2*MAX_SUBFRAME_SIZE];
+    int16_t wsp_filter_data[10];///< weighting filter data of weighted speech
+    int16_t err_filter_data[10];///< weighted error of previous subframe (target signal computation)
+    int16_t lp_prev[10];        ///< (Q12) LP coefficients of previous frame (used for unstable filter)
+    int16_t lsp_prev[10];       ///< (Q15) unquantized LSP coefficients of previous frame
+    int exc_err[4];             ///< (Q14) excitation error estimations of taming procedure (3.8)
+    int16_t hpf_y_hi[2];        ///< pre-processing filter output history, high parts
+    int16_t hpf_y_lo[2];        ///< pre-processing filter output history, low parts
+    int16_t hpf_x[2];           ///< pre-processing filter input history
+} G729A_EncoderContext;
+
+/*
+   Basic operators of reference fixed-point code. Encoder keeps their
+   saturation and rounding (and order of operations) to produce the same
+   bitstream as reference encoder.
+*/
+
+static inline int sat32(int64_t value)
+{
+    return value > INT_MAX ? INT_MAX : value < INT_MIN ? INT_MIN : value;
+}
+
+static inline int16_t add16(int a, int b)
+{
+    return av_clip_int16(a + b);
+}
+
+static inline int16_t sub16(int a, int b)
+{
+    return av_clip_int16(a - b);
+}
+
+/// (a*b) >> 15
+static inline int16_t mult16(int16_t a, int16_t b)
+{
+    return av_clip_int16((a * b) >> 15);
+}
+
+/// (a*b) >> 15 with rounding
+static inline int16_t mult16_r(int16_t a, int16_t b)
+{
+    return av_clip_int16((a * b + 0x4000) >> 15);
+}
+
+static inline int16_t negate16(int16_t a)
+{
+    return a == INT16_MIN ? INT16_MAX : -a;
+}
+
+static inline int16_t abs16(int16_t a)
+{
+    return a == INT16_MIN ? INT16_MAX : FFABS(a);
+}
+
+/// a << n (a >> -n for negative n)
+static inline int16_t shl16(int16_t a, int n)
+{
+    if(n < 0)
+        return a >> FFMIN(-n, 15);
+    if(n > 15)
+        return a ? (a > 0 ? INT16_MAX : INT16_MIN) : 0;
+    return av_clip_int16(a * (1 << n));
+}
+
+static inline int16_t shr16(int16_t a, int n)
+{
+    return shl16(a, -n);
+}
+
+/// number of left shifts to normalize value into [0x4000; 0x7fff] or [-0x8000; -0x4001]
+static inline int norm16(int16_t a)
+{
+    if(!a)
+        return 0;
+    if(a == -1)
+        return 15;
+    return 14 - av_log2(a < 0 ? ~a : a);
+}
+
+/// (num << 15) / denom, 0 <= num <= denom
+static inline int16_t div16(int16_t num, int16_t denom)
+{
+    if(num <= 0)
+        return 0;
+    if(num >= denom)
+        return INT16_MAX;
+    return (num << 15) / denom;
+}
+
+static inline int l_add(int a, int b)
+{
+    return sat32((int64_t)a + b);
+}
+
+static inline int l_sub(int a, int b)
+{
+    return sat32((int64_t)a - b);
+}
+
+/// 2*a*b
+static inline int l_mult(int16_t a, int16_t b)
+{
+    return a * b == 0x40000000 ? INT_MAX : 2 * (a * b);
+}
+
+static inline int l_mac(int acc, int16_t a, int16_t b)
+{
+    return l_add(acc, l_mult(a, b));
+}
+
+static inline int l_msu(int acc, int16_t a, int16_t b)
+{
+    return l_sub(acc, l_mult(a, b));
+}
+
+static inline int l_abs(int a)
+{
+    return a == INT_MIN ? INT_MAX : FFABS(a);
+}
+
+static inline int l_negate(int a)
+{
+    return a == INT_MIN ? INT_MAX : -a;
+}
+
+/// a << n (a >> -n for negative n)
+static inline int l_shl(int a, int n)
+{
+    if(n < 0)
+        return a >> FFMIN(-n, 31);
+    return sat32((int64_t)a * ((int64_t)1 << FFMIN(n, 32)));
+}
+
+static inline int l_shr(int a, int n)
+{
+    return l_shl(a, -n);
+}
+
+/// a >> n with rounding
+static inline int l_shr_r(int a, int n)
+{
+    if(n > 31)
+        return 0;
+    if(n <= 0)
+        return l_shl(a, -n);
+    return (a >> n) + ((a >> (n - 1)) & 1);
+}
+
+/// high part of value with rounding
+static inline int16_t round16(int a)
+{
+    return l_add(a, 0x8000) >> 16;
+}
+
+/// number of left shifts to normalize value into [0x40000000; 0x7fffffff] or [-0x80000000; -0x40000001]
+static inline int norm32(int a)
+{
+    if(!a)
+        return 0;
+    if(a == -1)
+        return 31;
+    return 30 - av_log2(a < 0 ? ~a : a);
+}
+
+/**
+ * \brief splits value into double precision format: hi*2^16 + lo*2
+ */
+static inline void l_extract(int value, int16_t* hi, int16_t* lo)
+{
+    *hi = value >> 16;
+    *lo = (value >> 1) - *hi * 32768;
+}
+
+static inline int l_comp(int16_t hi, int16_t lo)
+{
+    return l_mac(hi * 65536, lo, 1);
+}
+
+/// product of two double precision values
+static inline int mpy_32(int16_t hi1, int16_t lo1, int16_t hi2, int16_t lo2)
+{
+    int acc = l_mult(hi1, hi2);
+
+    acc = l_mac(acc, mult16(hi1, lo2), 1);
+    return l_mac(acc, mult16(lo1, hi2), 1);
+}
+
+/// product of double precision and 16-bit values
+static inline int mpy_32_16(int16_t hi, int16_t lo, int16_t n)
+{
+    return l_mac(l_mult(hi, n), mult16(lo, n), 1);
+}
+
+/**
+ * \brief num/denom, 0 <= num < denom
+ * \param num (Q31) numerator
+ * \param denom_hi high part of normalized denominator
+ * \param denom_lo low part of normalized denominator
+ * \return (Q31) result
+ */
+static int div_32(int num, int16_t denom_hi, int16_t denom_lo)
+{
+    int16_t approx, hi, lo, n_hi, n_lo;
+    int acc;
+
+    /* 1/denom by Newton's method, starting from 1/denom_hi */
+    approx = div16(0x3fff, denom_hi);
+    acc = l_sub(INT_MAX, mpy_32_16(denom_hi, denom_lo, approx));
+    l_extract(acc, &hi, &lo);
+    acc = mpy_32_16(hi, lo, approx);
+
+    l_extract(acc, &hi, &lo);
+    l_extract(num, &n_hi, &n_lo);
+    return l_shl(mpy_32(n_hi, n_lo, hi, lo), 2);
+}
+
+/**
+ * \brief log2(value), value > 0, as integer part and fraction
+ * \param frac [out] (Q15) fraction
+ */
+static void log2_q15(int value, int16_t* exp, int16_t* frac)
+{
+    int16_t i, a;
+    int shift;
+
+    if(value <= 0)
+    {
+        *exp = *frac = 0;
+        return;
+    }
+
+    shift = norm32(value);
+    value <<= shift;
+    *exp = 30 - shift;
+
+    i = (value >> 25) - 32;
+    a = (value >> 10) & 0x7fff;
+    *frac = l_msu(tab_log2[i] << 16, tab_log2[i] - tab_log2[i+1], a) >> 16;
+}
+
+/**
+ * \brief 2^(exp+frac)
+ * \param frac (Q15) fraction
+ */
+static int pow2_q15(int16_t exp, int16_t frac)
+{
+    int16_t i = frac >> 10, a = (frac << 5) & 0x7fff;
+
+    return l_shr_r(l_msu(tab_pow2[i] << 16, tab_pow2[i] - tab_pow2[i+1], a), 30 - exp);
+}
+
+/**
+ * \brief 1/sqrt(value), value > 0
+ * \return (Q30) result
+ */
+static int inv_sqrt_q30(int value)
+{
+    int16_t i, a;
+    int shift, exp;
+
+    if(value <= 0)
+        return 0x3fffffff;
+
+    shift = norm32(value);
+    value <<= shift;
+    exp = 30 - shift;
+    if(!(exp & 1))
+        value >>= 1;
+    exp = (exp >> 1) + 1;
+
+    i = (value >> 25) - 16;
+    a = (value >> 10) & 0x7fff;
+    return l_msu(tab_inv_sqrt[i] << 16, tab_inv_sqrt[i] - tab_inv_sqrt[i+1], a) >> exp;
+}
+
+/**
+ * \brief high-pass filtering and downscaling of input signal (3.1)
+ * \param ctx private data structure
+ * \param speech [in/out] input speech signal
+ * \param length size of input data
+ *
+ * Filter has cut-off frequency 140Hz
+ */
+static void g729_pre_process(G729A_EncoderContext* ctx, int16_t* speech, int length)
+{
+    int i, acc;
+
+    for(i=0; i<length; i++)
+    {
+        /* 3.1, Equation 1, b coefficients include division by 2 */
+        acc = mpy_32_16(ctx->hpf_y_hi[0], ctx->hpf_y_lo[0], 7807);
+        acc = l_add(acc, mpy_32_16(ctx->hpf_y_hi[1], ctx->hpf_y_lo[1], -3733));
+        acc = l_mac(acc, speech[i], 1899);
+        acc = l_mac(acc, ctx->hpf_x[0], -3798);
+        acc = l_mac(acc, ctx->hpf_x[1], 1899);
+        acc = l_shl(acc, 3);
+
+        ctx->hpf_x[1] = ctx->hpf_x[0];
+        ctx->hpf_x[0] = speech[i];
+        ctx->hpf_y_hi[1] = ctx->hpf_y_hi[0];
+        ctx->hpf_y_lo[1] = ctx->hpf_y_lo[0];
+        l_extract(acc, &ctx->hpf_y_hi[0], &ctx->hpf_y_lo[0]);
+
+        speech[i] = round16(acc);
+    }
+}
+
+/**
+ * \brief windowing, autocorrelation and lag windowing (3.2.1)
+ * \param speech (Q0) LP_WINDOW_SIZE samples of speech
+ * \param r_hi [out] normalized autocorrelation coefficients, high parts
+ * \param r_lo [out] normalized autocorrelation coefficients, low parts
+ */
+static void g729_autocorrelation(const int16_t* speech, int16_t* r_hi, int16_t* r_lo)
+{
+    int16_t ws[LP_WINDOW_SIZE];
+    int64_t energy;
+    int i, n, sum, shift;
+
+    for(n=0; n<LP_WINDOW_SIZE; n++)
+        ws[n] = mult16_r(speech[n], lp_window[n]);
+
+    /* signal is scaled down until its energy fits into 32 bits */
+    for(;;)
+    {
+        energy = 1; // avoids case of all zeros
+        for(n=0; n<LP_WINDOW_SIZE; n++)
+            energy += 2 * (int64_t)(ws[n] * ws[n]);
+        if(energy <= INT_MAX)
+            break;
+        for(n=0; n<LP_WINDOW_SIZE; n++)
+            ws[n] >>= 2;
+    }
+
+    shift = norm32(energy);
+    l_extract((int)energy << shift, &r_hi[0], &r_lo[0]);
+
+    for(i=1; i<=10; i++)
+    {
+        sum = 0;
+        for(n=0; n<LP_WINDOW_SIZE-i; n++)
+            sum = l_mac(sum, ws[n], ws[n+i]);
+        l_extract(l_shl(sum, shift), &r_hi[i], &r_lo[i]);
+
+        /* 3.2.1, Equation 7 */
+        l_extract(mpy_32(r_hi[i], r_lo[i], lag_window_hi[i-1], lag_window_lo[i-1]), &r_hi[i], &r_lo[i]);
+    }
+}
+
+/**
+ * \brief Levinson-Durbin recursion (3.2.2)
+ * \param r_hi normalized autocorrelation coefficients, high parts
+ * \param r_lo normalized autocorrelation coefficients, low parts
+ * \param lp_prev [in/out] (Q12) LP coefficients of previous frame
+ * \param lp [out] (Q12) LP coefficients
+ *
+ * When the filter is found unstable, LP coefficients of previous frame are used.
+ */
+static void g729_levinson(const int16_t* r_hi, const int16_t* r_lo, int16_t* lp_prev, int16_t* lp)
+{
+    int16_t a_hi[11], a_lo[11], an_hi[11], an_lo[11];
+    int16_t k_hi, k_lo, alpha_hi, alpha_lo, hi, lo;
+    int i, j, acc, k, alpha_exp;
+
+    /* k = a[1] = -r[1] / r[0] */
+    acc = l_comp(r_hi[1], r_lo[1]);
+    k = div_32(l_abs(acc), r_hi[0], r_lo[0]);
+    if(acc > 0)
+        k = l_negate(k);
+    l_extract(k, &k_hi, &k_lo);
+    l_extract(k >> 4, &a_hi[1], &a_lo[1]); // Q27
+
+    /* alpha = r[0] * (1 - k^2) */
+    acc = l_sub(INT_MAX, l_abs(mpy_32(k_hi, k_lo, k_hi, k_lo)));
+    l_extract(acc, &hi, &lo);
+    acc = mpy_32(r_hi[0], r_lo[0], hi, lo);
+    alpha_exp = norm32(acc);
+    l_extract(acc << alpha_exp, &alpha_hi, &alpha_lo);
+
+    for(i=2; i<=10; i++)
+    {
+        /* k = -(r[i] + sum(r[j]*a[i-j])) / alpha */
+        acc = 0;
+        for(j=1; j<i; j++)
+            acc = l_add(acc, mpy_32(r_hi[j], r_lo[j], a_hi[i-j], a_lo[i-j]));
+        acc = l_add(l_shl(acc, 4), l_comp(r_hi[i], r_lo[i]));
+
+        k = div_32(l_abs(acc), alpha_hi, alpha_lo);
+        if(acc > 0)
+            k = l_negate(k);
+        k = l_shl(k, alpha_exp);
+        l_extract(k, &k_hi, &k_lo);
+
+        if(abs16(k_hi) > 32750)
+        {
+            memcpy(lp, lp_prev, 10 * sizeof(int16_t));
+            return;
+        }
+
+        for(j=1; j<i; j++)
+        {
+            acc = l_add(mpy_32(k_hi, k_lo, a_hi[i-j], a_lo[i-j]), l_comp(a_hi[j], a_lo[j]));
+            l_extract(acc, &an_hi[j], &an_lo[j]);
+        }
+        l_extract(k >> 4, &an_hi[i], &an_lo[i]);
+
+        /* alpha *= 1 - k^2 */
+        acc = l_sub(INT_MAX, l_abs(mpy_32(k_hi, k_lo, k_hi, k_lo)));
+        l_extract(acc, &hi, &lo);
+        acc = mpy_32(alpha_hi, alpha_lo, hi, lo);
+        j = norm32(acc);
+        l_extract(acc << j, &alpha_hi, &alpha_lo);
+        alpha_exp += j;
+
+        memcpy(a_hi + 1, an_hi + 1, i * sizeof(int16_t));
+        memcpy(a_lo + 1, an_lo + 1, i * sizeof(int16_t));
+    }
+
+    for(i=0; i<10; i++)
+        lp_prev[i] = lp[i] = round16(l_shl(l_comp(a_hi[i+1], a_lo[i+1]), 1));
+}
+
+/**
+ * \brief evaluates Chebyshev series of sum or difference polynomial (3.2.3, Equation 13)
+ * \param x (Q15) cos(w)
+ * \param f polynomial coefficients in Q11 or Q10
+ * \param q Q of polynomial coefficients: 11 or 10
+ * \return (Q14) polynomial value
+ */
+static int16_t g729_chebyshev(int16_t x, const int16_t* f, int q)
+{
+    int16_t b0_hi, b0_lo, b1_hi, b1_lo, b2_hi = 1 << (q - 3), b2_lo = 0;
+    int i, acc;
+
+    acc = l_mult(x, 1 << (q - 2));
+    acc = l_mac(acc, f[1], 4096);
+    l_extract(acc, &b1_hi, &b1_lo);
+
+    for(i=2; i<5; i++)
+    {
+        /* b0 = 2*x*b1 - b2 + f[i] */
+        acc = l_shl(mpy_32_16(b1_hi, b1_lo, x), 1);
+        acc = l_mac(acc, b2_hi, -32768);
+        acc = l_msu(acc, b2_lo, 1);
+        acc = l_mac(acc, f[i], 4096);
+        l_extract(acc, &b0_hi, &b0_lo);
+
+        b2_hi = b1_hi;
+        b2_lo = b1_lo;
+        b1_hi = b0_hi;
+        b1_lo = b0_lo;
+    }
+
+    acc = mpy_32_16(b1_hi, b1_lo, x);
+    acc = l_mac(acc, b2_hi, -32768);
+    acc = l_msu(acc, b2_lo, 1);
+    acc = l_mac(acc, f[5], 2048);
+    return l_shl(acc, 17 - q) >> 16;
+}
+
+/**
+ * \brief LP to LSP conversion (3.2.3)
+ * \param lp (Q12) LP coefficients
+ * \param lsp_prev (Q15) LSP coefficients of previous frame
+ * \param lsp [out] (Q15) LSP coefficients
+ *
+ * Roots are searched on grid of GRID_POINTS intervals, each found interval is
+ * divided twice and linearly interpolated. When less than ten roots are found,
+ * LSP coefficients of previous frame are used.
+ */
+static void g729_lp2lsp(const int16_t* lp, const int16_t* lsp_prev, int16_t* lsp)
+{
+    int16_t f[2][6]; // sum and difference polynomials
+    int16_t x, y, xlow, ylow, xhigh, yhigh, xmid, ymid, sign;
+    int i, j, q, v1, v2, overflow, found = 0, p = 0, exp;
+
+    /* 3.2.3, Equations 15 and 16, Q10 is used when Q11 overflows */
+    for(q=11; ; q--)
+    {
+        overflow = 0;
+        f[0][0] = f[1][0] = 1 << q;
+        for(i=0; i<5; i++)
+        {
+            v1 = ((lp[i] + lp[9-i]) >> (12 - q)) - f[0][i];
+            v2 = ((lp[i] - lp[9-i]) >> (12 - q)) + f[1][i];
+            overflow |= v1 != av_clip_int16(v1) || v2 != av_clip_int16(v2);
+            f[0][i+1] = av_clip_int16(v1);
+            f[1][i+1] = av_clip_int16(v2);
+        }
+        if(!overflow || q == 10)
+            break;
+    }
+
+    xlow = lsp_grid[0];
+    ylow = g729_chebyshev(xlow, f[p], q);
+
+    for(j=1; j<=GRID_POINTS && found < 10; j++)
+    {
+        xhigh = xlow;
+        yhigh = ylow;
+        xlow = lsp_grid[j];
+        ylow = g729_chebyshev(xlow, f[p], q);
+
+        if(ylow * yhigh > 0)
+            continue;
+
+        for(i=0; i<2; i++)
+        {
+            xmid = (xlow >> 1) + (xhigh >> 1);
+            ymid = g729_chebyshev(xmid, f[p], q);
+            if(ylow * ymid <= 0)
+            {
+                yhigh = ymid;
+                xhigh = xmid;
+            }
+            else
+            {
+                ylow = ymid;
+                xlow = xmid;
+            }
+        }
+
+        /* xlow - ylow * (xhigh - xlow) / (yhigh - ylow) */
+        x = sub16(xhigh, xlow);
+        y = sub16(yhigh, ylow);
+        if(y)
+        {
+            sign = y;
+            y = abs16(y);
+            exp = norm16(y);
+            y = div16(16383, y << exp);
+            y = l_shr(l_mult(x, y), 20 - exp); // Q11
+            if(sign < 0)
+                y = negate16(y);
+            xlow = sub16(xlow, (int16_t)l_shr(l_mult(ylow, y), 11));
+        }
+
+        lsp[found++] = xlow;
+        p ^= 1;
+        ylow = g729_chebyshev(xlow, f[p], q);
+    }
+
+    if(found < 10)
+        memcpy(lsp, lsp_prev, 10 * sizeof(int16_t));
+}
+
+/**
+ * \brief LSP to LSF conversion, lsf = acos(lsp)
+ * \param lsp (Q15) LSP coefficients
+ * \param lsf [out] (Q13) LSF coefficients
+ */
+static void g729_lsp2lsf(const int16_t* lsp, int16_t* lsf)
+{
+    int16_t freq;
+    int i, ind = 63;
+
+    for(i=9; i>=0; i--)
+    {
+        while(ind > 0 && base_cos[ind] < lsp[i])
+            ind--;
+
+        freq = add16(ind << 9, (int16_t)(l_mult(slope_acos[ind], sub16(lsp[i], base_cos[ind])) >> 12));
+        lsf[i] = mult16(freq, 25736); // 2*PI in Q12
+    }
+}
+
+/**
+ * \brief weighting coefficients of LSF quantizer distance (3.2.4, Equation 22)
+ * \param lsf (Q13) LSF coefficients
+ * \param weight [out] normalized weights
+ */
+static void g729_lsf_weights(const int16_t* lsf, int16_t* weight)
+{
+    int16_t diff[10], tmp, max = 0;
+    int i, shift;
+
+    diff[0] = sub16(lsf[1], 1029 + 8192); // 0.04*PI + 1.0 in Q13
+    for(i=1; i<9; i++)
+        diff[i] = sub16(sub16(lsf[i+1], lsf[i-1]), 8192);
+    diff[9] = sub16(23677 - 8192, lsf[8]); // 0.92*PI - 1.0 in Q13
+
+    for(i=0; i<10; i++)
+    {
+        weight[i] = 2048; // 1.0 in Q11
+        if(diff[i] <= 0)
+        {
+            tmp = l_shl(l_mult(diff[i], diff[i]), 2) >> 16;
+            weight[i] = add16(l_shl(l_mult(tmp, 20480), 2) >> 16, 2048); // 10.0 in Q11
+        }
+    }
+
+    weight[4] = l_shl(l_mult(weight[4], 19661), 1) >> 16; // 1.2 in Q14
+    weight[5] = l_shl(l_mult(weight[5], 19661), 1) >> 16;
+
+    for(i=0; i<10; i++)
+        max = FFMAX(max, weight[i]);
+    shift = norm16(max);
+    for(i=0; i<10; i++)
+        weight[i] = shl16(weight[i], shift);
+}
+
+/**
+ * \brief LSF rearrangement (3.2.4), enforces minimal distance between coefficients
+ * \param lq [in/out] (Q13) quantizer output
+ * \param first index of first coefficient pair's second element
+ * \param last index of last coefficient pair's second element + 1
+ * \param gap (Q13) minimal distance
+ */
+static void g729_lsf_expand(int16_t* lq, int first, int last, int gap)
+{
+    int16_t diff;
+    int i;
+
+    for(i=first; i<last; i++)
+    {
+        diff = add16(sub16(lq[i-1], lq[i]), gap) >> 1;
+        if(diff > 0)
+        {
+            lq[i-1] = sub16(lq[i-1], diff);
+            lq[i]   = add16(lq[i], diff);
+        }
+    }
+}
+
+/**
+ * \brief second stage of LSF quantizer: lower or higher part search
+ * \param target (Q13) target vector
+ * \param cb1 (Q13) selected first stage vector
+ * \param weight weighting coefficients
+ * \param first first coefficient of part
+ * \param last last coefficient of part + 1
+ * \return index of the nearest second stage vector
+ */
+static int g729_lsf_select(const int16_t* target, const int16_t* cb1, const int16_t* weight, int first, int last)
+{
+    int16_t diff;
+    int i, k, dist, dist_min = INT_MAX, best = 0;
+
+    for(k=0; k<1<<L2_BITS; k++)
+    {
+        dist = 0;
+        for(i=first; i<last; i++)
+        {
+            diff = sub16(sub16(target[i], cb1[i]), cb_L2_L3[k][i]);
+            dist = l_mac(dist, mult16(weight[i], diff), diff);
+        }
+        if(dist < dist_min)
+        {
+            dist_min = dist;
+            best = k;
+        }
+    }
+    return best;
+}
+
+/**
+ * \brief LSF quantization (3.2.4)
+ * \param ctx private data structure
+ * \param lsf (Q13) LSF coefficients
+ * \param lsfq [out] (Q13) quantized LSF coefficients
+ * \param parm [out] parameters of the codec
+ *
+ * Both MA predictors are tried: first stage vector is nearest one to the
+ * target, lower and higher parts of the second stage are searched separately
+ * with weighted distance. Quantized coefficients are obtained as in decoder.
+ */
+static void g729_lsf_quantize(G729A_Context* ctx, const int16_t* lsf, int16_t* lsfq, G729_parameters* parm)
+{
+    int16_t weight[10], target[2][10], lq[10], diff;
+    int cand[2], idx_lo[2], idx_hi[2], dist[2];
+    int mode, i, k, acc, dist_min;
+
+    g729_lsf_weights(lsf, weight);
+
+    for(mode=0; mode<2; mode++)
+    {
+        /* target vector: LSF with MA prediction removed (reverted 3.2.4, Equation 20) */
+        for(i=0; i<10; i++)
+        {
+            acc = lsf[i] << 16;
+            for(k=0; k<MA_NP; k++)
+                acc = l_msu(acc, ctx->lq_prev[k][i], ma_predictor[mode][k][i]);
+            acc = l_mult(acc >> 16, ma_predictor_sum_inv[mode][i]);
+            target[mode][i] = l_shl(acc, 3) >> 16;
+        }
+
+        dist_min = INT_MAX;
+        cand[mode] = 0;
+        for(k=0; k<1<<L1_BITS; k++)
+        {
+            acc = 0;
+            for(i=0; i<10; i++)
+            {
+                diff = sub16(target[mode][i], cb_L1[k][i]);
+                acc = l_mac(acc, diff, diff);
+            }
+            if(acc < dist_min)
+            {
+                dist_min = acc;
+                cand[mode] = k;
+            }
+        }
+
+        idx_lo[mode] = g729_lsf_select(target[mode], cb_L1[cand[mode]], weight, 0, 5);
+        idx_hi[mode] = g729_lsf_select(target[mode], cb_L1[cand[mode]], weight, 5, 10);
+
+        for(i=0; i<10; i++)
+            lq[i] = add16(cb_L1[cand[mode]][i], cb_L2_L3[i < 5 ? idx_lo[mode] : idx_hi[mode]][i]);
+        g729_lsf_expand(lq, 1, 5, LSFQ_GAP1);
+        g729_lsf_expand(lq, 5, 10, LSFQ_GAP1);
+        g729_lsf_expand(lq, 1, 10, LSFQ_GAP2);
+
+        /* 3.2.4, Equation 21 */
+        dist[mode] = 0;
+        for(i=0; i<10; i++)
+        {
+            diff = mult16(sub16(lq[i], target[mode][i]), ma_predictor_sum[mode][i]);
+            dist[mode] = l_mac(dist[mode], l_shl(l_mult(weight[i], diff), 4) >> 16, diff);
+        }
+    }
+
+    mode = dist[1] < dist[0];
+    parm->ma_predictor     = mode;
+    parm->quantizer_1st    = cand[mode];
+    parm->quantizer_2nd_lo = idx_lo[mode];
+    parm->quantizer_2nd_hi = idx_hi[mode];
+
+    /* 3.2.4, Equations 19 and 20 */
+    for(i=0; i<10; i++)
+        lq[i] = add16(cb_L1[cand[mode]][i], cb_L2_L3[i < 5 ? idx_lo[mode] : idx_hi[mode]][i]);
+    g729_lsf_expand(lq, 1, 10, LSFQ_GAP1);
+    g729_lsf_expand(lq, 1, 10, LSFQ_GAP2);
+
+    for(i=0; i<10; i++)
+    {
+        acc = l_mult(lq[i], ma_predictor_sum[mode][i]);
+        for(k=0; k<MA_NP; k++)
+            acc = l_mac(acc, ctx->lq_prev[k][i], ma_predictor[mode][k][i]);
+        lsfq[i] = acc >> 16;
+    }
+
+    memmove(ctx->lq_prev[1], ctx->lq_prev[0], (MA_NP-1) * sizeof(ctx->lq_prev[0]));
+    memcpy(ctx->lq_prev[0], lq, sizeof(lq));
+
+    /* stability check, reference encoder makes single pass of bubble sort */
+    for(i=0; i<9; i++)
+        if(lsfq[i+1] < lsfq[i])
+            FFSWAP(int16_t, lsfq[i], lsfq[i+1]);
+
+    lsfq[0] = FFMAX(lsfq[0], LSFQ_MIN);
+    for(i=0; i<9; i++)
+        if(lsfq[i+1] - lsfq[i] < LSFQ_DIFF_MIN)
+            lsfq[i+1] = add16(lsfq[i], LSFQ_DIFF_MIN);
+    lsfq[9] = FFMIN(lsfq[9], LSFQ_MAX);
+}
+
+/**
+ * \brief LP coefficients of weighting filter A(z/gamma) (A.3.3)
+ * \param lp (Q12) LP coefficients
+ * \param gamma (Q15) weighting factor
+ * \param lpw [out] (Q12) weighted LP coefficients
+ */
+static void g729_weight_lp(const int16_t* lp, int16_t gamma, int16_t* lpw)
+{
+    int16_t fac = gamma;
+    int i;
+
+    for(i=0; i<10; i++)
+    {
+        lpw[i] = round16(l_mult(lp[i], fac));
+        fac = round16(l_mult(fac, gamma));
+    }
+}
+
+/**
+ * \brief LP residual, filtering through A(z)
+ * \param lp (Q12) LP coefficients
+ * \param in input signal, 10 samples before it are used as filter data
+ * \param out [out] residual signal
+ * \param length signal length
+ */
+static void g729_residual_filter(const int16_t* lp, const int16_t* in, int16_t* out, int length)
+{
+    int i, n, acc;
+
+    for(n=0; n<length; n++)
+    {
+        acc = l_mult(in[n], 4096);
+        for(i=0; i<10; i++)
+            acc = l_mac(acc, lp[i], in[n-i-1]);
+        out[n] = round16(l_shl(acc, 3));
+    }
+}
+
+/**
+ * \brief filtering through 1/A(z)
+ * \param lp (Q12) LP coefficients
+ * \param in input signal
+ * \param out [out] filtered signal (may be the same buffer as in)
+ * \param filter_data [in/out] last 10 samples of previous output
+ * \param length signal length
+ * \param update 1 - filter data should be updated, 0 - kept unchanged
+ */
+static void g729_synthesis_filter(const int16_t* lp, const int16_t* in, int16_t* out,
+                                  int16_t* filter_data, int length, int update)
+{
+    int16_t tmp[MAX_SUBFRAME_SIZE+10];
+    int i, n, acc;
+
+    memcpy(tmp, filter_data, 10 * sizeof(int16_t));
+    for(n=0; n<length; n++)
+    {
+        acc = l_mult(in[n], 4096);
+        for(i=0; i<10; i++)
+            acc = l_msu(acc, lp[i], tmp[n+9-i]);
+        tmp[n+10] = round16(l_shl(acc, 3));
+    }
+    memcpy(out, tmp + 10, length * sizeof(int16_t));
+
+    if(update)
+        memcpy(filter_data, tmp + length, 10 * sizeof(int16_t));
+}
+
+/**
+ * \brief correlation of signal with its delayed copy at even samples
+ */
+static int g729a_ol_correlation(const int16_t* sig, int delay, int length)
+{
+    int n, sum = 0;
+
+    for(n=0; n<length; n+=2)
+        sum = l_mac(sum, sig[n], sig[n-delay]);
+    return sum;
+}
+
+/**
+ * \brief maximum of correlation in range of pitch delays
+ * \param corr_max [out] maximal correlation
+ * \return pitch delay
+ */
+static int g729a_ol_search(const int16_t* sig, int t_min, int t_max, int step, int length, int* corr_max)
+{
+    int t, corr, best = t_min;
+
+    *corr_max = INT_MIN;
+    for(t=t_min; t<t_max; t+=step)
+    {
+        corr = g729a_ol_correlation(sig, t, length);
+        if(corr > *corr_max)
+        {
+            *corr_max = corr;
+            best = t;
+        }
+    }
+    return best;
+}
+
+/**
+ * \brief correlation normalized by energy of delayed signal
+ */
+static int16_t g729a_ol_normalize(const int16_t* sig, int delay, int corr, int length)
+{
+    int16_t corr_hi, corr_lo, inv_hi, inv_lo;
+    int n, energy = 1; // avoids division by zero
+
+    for(n=0; n<length; n+=2)
+        energy = l_mac(energy, sig[n-delay], sig[n-delay]);
+
+    l_extract(corr, &corr_hi, &corr_lo);
+    l_extract(inv_sqrt_q30(energy), &inv_hi, &inv_lo);
+    return mpy_32(corr_hi, corr_lo, inv_hi, inv_lo); // always fits into 16 bits
+}
+
+/**
+ * \brief open-loop pitch analysis (A.3.4)
+ * \param wsp (Q0) weighted speech, PITCH_MAX past samples are accessed
+ * \param length frame length
+ * \return open-loop pitch delay
+ *
+ * Delays are searched in three sections (20..39, 40..79, 80..143) on even
+ * samples only, smaller delays are favored when they are submultiples.
+ */
+static int g729a_open_loop_pitch(const int16_t* wsp, int length)
+{
+    int16_t sig_base[PITCH_MAX+2*MAX_SUBFRAME_SIZE], *sig = sig_base + PITCH_MAX;
+    int16_t max1, max2, max3;
+    int64_t energy = 0;
+    int n, t1, t2, t3, t, corr, corr_max;
+
+    for(n=-PITCH_MAX; n<length; n+=2)
+        energy += 2 * (int64_t)(wsp[n] * wsp[n]);
+
+    /* scaling to avoid overflow and to keep precision */
+    for(n=-PITCH_MAX; n<length; n++)
+    {
+        if(energy > INT_MAX)
+            sig[n] = wsp[n] >> 3;
+        else if(energy < 1 << 20)
+            sig[n] = shl16(wsp[n], 3);
+        else
+            sig[n] = wsp[n];
+    }
+
+    t1 = g729a_ol_search(sig, 20, 40, 1, length, &corr_max);
+    max1 = g729a_ol_normalize(sig, t1, corr_max, length);
+
+    t2 = g729a_ol_search(sig, 40, 80, 1, length, &corr_max);
+    max2 = g729a_ol_normalize(sig, t2, corr_max, length);
+
+    t3 = g729a_ol_search(sig, 80, PITCH_MAX, 2, length, &corr_max);
+    t = t3;
+    corr = g729a_ol_correlation(sig, t + 1, length);
+    if(corr > corr_max)
+    {
+        corr_max = corr;
+        t3 = t + 1;
+    }
+    corr = g729a_ol_correlation(sig, t - 1, length);
+    if(corr > corr_max)
+    {
+        corr_max = corr;
+        t3 = t - 1;
+    }
+    max3 = g729a_ol_normalize(sig, t3, corr_max, length);
+
+    /* multiples */
+    if(FFABS(2*t2 - t3) < 5)
+        max2 = add16(max2, max3 >> 2);
+    if(FFABS(3*t2 - t3) < 7)
+        max2 = add16(max2, max3 >> 2);
+    if(FFABS(2*t1 - t2) < 5)
+        max1 = add16(max1, mult16(max2, 6554)); // 0.2 in Q15
+    if(FFABS(3*t1 - t2) < 7)
+        max1 = add16(max1, mult16(max2, 6554));
+
+    if(max1 < max2)
+    {
+        max1 = max2;
+        t1 = t2;
+    }
+    if(max1 < max3)
+        t1 = t3;
+
+    return t1;
+}
+
+/**
+ * \brief scalar product with saturation of each accumulation step
+ * \param sum initial value
+ * \param overflow [out] set to 1 when saturation occurs (may be NULL)
+ */
+static int g729_dot_product(const int16_t* a, const int16_t* b, int length, int sum, int* overflow)
+{
+    int64_t acc;
+    int n;
+
+    for(n=0; n<length; n++)
+    {
+        acc = (int64_t)sum + l_mult(a[n], b[n]);
+        if(overflow && (acc != (int)acc || a[n] * b[n] == 0x40000000))
+            *overflow = 1;
+        sum = sat32(acc);
+    }
+    return sum;
+}
+
+/**
+ * \brief correlation of target signal and impulse response (3.7.1, Equation 38)
+ * \param h (Q12) impulse response
+ * \param x target signal
+ * \param d [out] correlation normalized to 13 bits
+ * \param length subframe length
+ */
+static void g729_backward_filter(const int16_t* h, const int16_t* x, int16_t* d, int length)
+{
+    int y[MAX_SUBFRAME_SIZE];
+    int i, n, shift, max = 0;
+
+    for(i=0; i<length; i++)
+    {
+        y[i] = 0;
+        for(n=i; n<length; n++)
+            y[i] = l_mac(y[i], x[n], h[n-i]);
+        max = FFMAX(max, l_abs(y[i]));
+    }
+
+    shift = 18 - FFMIN(norm32(max), 16);
+    for(i=0; i<length; i++)
+        d[i] = l_shr(y[i], shift);
+}
+
+/**
+ * \brief closed-loop pitch search (A.3.7)
+ * \param exc [in/out] excitation, adaptive-codebook vector is stored into current subframe
+ * \param x target signal
+ * \param h (Q12) impulse response of weighted synthesis filter
+ * \param t_min minimal pitch delay
+ * \param t_max maximal pitch delay
+ * \param frac_max_delay fractions are not searched for delays above this one
+ * \param pitch_delay_frac [out] pitch delay, fraction part [-1, 0, 1]
+ * \param length subframe length
+ * \return pitch delay, integer part
+ */
+static int g729a_pitch_search(int16_t* exc, const int16_t* x, const int16_t* h, int t_min, int t_max,
+                              int frac_max_delay, int* pitch_delay_frac, int length)
+{
+    int16_t d[MAX_SUBFRAME_SIZE], exc_best[MAX_SUBFRAME_SIZE];
+    int t, t0 = t_min, corr, corr_max = INT_MIN;
+
+    g729_backward_filter(h, x, d, length);
+
+    for(t=t_min; t<=t_max; t++)
+    {
+        corr = g729_dot_product(d, exc - t, length, 0, NULL);
+        if(corr > corr_max)
+        {
+            corr_max = corr;
+            t0 = t;
+        }
+    }
+
+    *pitch_delay_frac = 0;
+    g729_decode_ac_vector(t0, 0, exc, length);
+    if(t0 > frac_max_delay)
+        return t0;
+
+    corr_max = g729_dot_product(d, exc, length, 0, NULL);
+    memcpy(exc_best, exc, length * sizeof(int16_t));
+
+    g729_decode_ac_vector(t0, -1, exc, length);
+    corr = g729_dot_product(d, exc, length, 0, NULL);
+    if(corr > corr_max)
+    {
+        corr_max = corr;
+        *pitch_delay_frac = -1;
+        memcpy(exc_best, exc, length * sizeof(int16_t));
+    }
+
+    g729_decode_ac_vector(t0, 1, exc, length);
+    corr = g729_dot_product(d, exc, length, 0, NULL);
+    if(corr > corr_max)
+        *pitch_delay_frac = 1;
+    else
+        memcpy(exc, exc_best, length * sizeof(int16_t));
+
+    return t0;
+}
+
+/**
+ * \brief adaptive-codebook gain (3.7.3, Equation 43)
+ * \param x target signal
+ * \param y1 filtered adaptive-codebook vector
+ * \param g_coeff [out] <y1,y1>, its exponent, <x,y1>, its exponent
+ * \param length subframe length
+ * \return (Q14) gain pitch, bounded by 0 and 1.2
+ */
+static int16_t g729_pitch_gain(const int16_t* x, const int16_t* y1, int16_t* g_coeff, int length)
+{
+    int16_t y1_scaled[MAX_SUBFRAME_SIZE], xy, yy, gain;
+    int n, sum, shift, exp_xy, exp_yy, overflow;
+
+    for(n=0; n<length; n++)
+        y1_scaled[n] = y1[n] >> 2;
+
+    overflow = 0;
+    sum = g729_dot_product(y1, y1, length, 1, &overflow);
+    if(overflow)
+        sum = g729_dot_product(y1_scaled, y1_scaled, length, 1, NULL);
+    shift = norm32(sum);
+    yy = round16(l_shl(sum, shift));
+    exp_yy = shift - (overflow ? 4 : 0);
+
+    overflow = 0;
+    sum = g729_dot_product(x, y1, length, 0, &overflow);
+    if(overflow)
+        sum = g729_dot_product(x, y1_scaled, length, 0, NULL);
+    shift = norm32(sum);
+    xy = round16(l_shl(sum, shift));
+    exp_xy = shift - (overflow ? 2 : 0);
+
+    g_coeff[0] = yy;
+    g_coeff[1] = 15 - exp_yy;
+    g_coeff[2] = xy;
+    g_coeff[3] = 15 - exp_xy;
+
+    if(xy < 4)
+        return 0;
+
+    gain = shr16(div16(xy >> 1, yy), exp_xy - exp_yy);
+    return FFMIN(gain, GAIN_PITCH_MAX);
+}
+
+/**
+ * \brief checks whether gain pitch should be limited to avoid unstable excitation (3.8)
+ * \param exc_err (Q14) excitation error estimations
+ * \param pitch_delay_int pitch delay, integer part
+ * \param pitch_delay_frac pitch delay, fraction part
+ * \param subframe_size length of subframe
+ *
+ * \return 1 if taming is required, 0 - otherwise
+ */
+static int g729_taming_needed(const int* exc_err, int pitch_delay_int, int pitch_delay_frac, int subframe_size)
+{
+    int t = pitch_delay_int + (pitch_delay_frac > 0);
+    int i;
+
+    for(i=FFMAX(t - subframe_size - INTERPOL_LEN + 1, 0) / subframe_size; i<=FFMIN((t + INTERPOL_LEN - 3) / subframe_size, 3); i++)
+        if(exc_err[i] > EXC_ERR_THRESHOLD)
+            return 1;
+
+    return 0;
+}
+
+/**
+ * \brief updates excitation error estimations with quantized gain pitch (3.8)
+ * \param exc_err [in/out] (Q14) excitation error estimations
+ * \param gain_pitch (Q14) quantized gain pitch
+ * \param pitch_delay_int pitch delay, integer part
+ * \param subframe_size length of subframe
+ */
+static void g729_taming_update(int* exc_err, int16_t gain_pitch, int pitch_delay_int, int subframe_size)
+{
+    int16_t hi, lo;
+    int i, err, err_max = -1;
+
+    if(pitch_delay_int < subframe_size)
+    {
+        err = exc_err[0];
+        for(i=0; i<2; i++)
+        {
+            l_extract(err, &hi, &lo);
+            err = l_add(0x4000, l_shl(mpy_32_16(hi, lo, gain_pitch), 1));
+            err_max = FFMAX(err_max, err);
+        }
+    }
+    else
+    {
+        for(i=(pitch_delay_int - subframe_size) / subframe_size; i<=FFMIN((pitch_delay_int - 1) / subframe_size, 3); i++)
+        {
+            l_extract(exc_err[i], &hi, &lo);
+            err = l_add(0x4000, l_shl(mpy_32_16(hi, lo, gain_pitch), 1));
+            err_max = FFMAX(err_max, err);
+        }
+    }
+
+    for(i=3; i>0; i--)
+        exc_err[i] = exc_err[i-1];
+    exc_err[0] = err_max;
+}
+
+/**
+ * \brief first pair of pulses: two positions of track ta with largest
+ * correlation are combined with all positions of track tb
+ * \param ps [out] correlation of the best pair
+ * \param alp [out] energy of the best pair
+ */
+static void g729a_acelp_pair_first(const int16_t* d, int16_t (*phi)[MAX_SUBFRAME_SIZE], int ta, int tb, int length,
+                                   int* pa, int* pb, int16_t* ps, int16_t* alp)
+{
+    int16_t max, ps1, ps2, sq = -1, sq2, alp2;
+    int i, k, n = ta, m, prev = -1, acc;
+
+    *alp = 1;
+    *ps = 0;
+    *pa = ta;
+    *pb = tb;
+    for(k=0; k<2; k++)
+    {
+        max = -1;
+        for(i=ta; i<length; i+=5)
+            if(d[i] > max && i != prev)
+            {
+                max = d[i];
+                n = i;
+            }
+        prev = n;
+
+        ps1 = d[n];
+        acc = l_mult(phi[n][n], 8192); // 1/4
+        for(m=tb; m<length; m+=5)
+        {
+            ps2 = add16(ps1, d[m]);
+            alp2 = round16(l_mac(l_mac(acc, phi[n][m], 16384), phi[m][m], 8192));
+            sq2 = mult16(ps2, ps2);
+            if(l_msu(l_mult(*alp, sq2), sq, alp2) > 0)
+            {
+                sq = sq2;
+                *ps = ps2;
+                *alp = alp2;
+                *pa = n;
+                *pb = m;
+            }
+        }
+    }
+}
+
+/**
+ * \brief second pair of pulses: all positions of tracks tc and td are
+ * combined with pulses pa and pb
+ * \param ps correlation of the first pair
+ * \param alp energy of the first pair
+ * \param sq [out] squared correlation of the best four pulses
+ * \param alp_best [out] energy of the best four pulses
+ */
+static void g729a_acelp_pair_second(const int16_t* d, int16_t (*phi)[MAX_SUBFRAME_SIZE], int tc, int td, int length,
+                                    int pa, int pb, int16_t ps, int16_t alp, int* pc, int* pd, int16_t* sq, int16_t* alp_best)
+{
+    int16_t rrv[MAX_SUBFRAME_SIZE/5], ps1, ps2, sq2, alp2;
+    int i, k, n, m, acc, acc0 = l_mult(alp, 8192); // 1/4
+
+    *sq = -1;
+    *alp_best = 1;
+    *pc = tc;
+    *pd = td;
+
+    for(m=td, k=0; m<length; m+=5, k++)
+        rrv[k] = round16(l_mac(l_mac(l_mult(phi[m][pa], 8192), phi[m][pb], 8192), phi[m][m], 4096));
+
+    for(n=tc; n<length; n+=5)
+    {
+        ps1 = add16(ps, d[n]);
+        acc = l_mac(acc0, phi[n][pa], 4096); // 1/8
+        acc = l_mac(acc, phi[n][pb], 4096);
+        acc = l_mac(acc, phi[n][n], 2048);   // 1/16
+        for(m=td, i=0; m<length; m+=5, i++)
+        {
+            ps2 = add16(ps1, d[m]);
+            alp2 = round16(l_mac(l_mac(acc, phi[n][m], 4096), rrv[i], 16384));
+            sq2 = mult16(ps2, ps2);
+            if(l_msu(l_mult(*alp_best, sq2), *sq, alp2) > 0)
+            {
+                *sq = sq2;
+                *alp_best = alp2;
+                *pc = n;
+                *pd = m;
+            }
+        }
+    }
+}
+
+/**
+ * \brief fixed-codebook search, depth-first tree search of four pulses (A.3.8)
+ * \param x target signal with adaptive-codebook contribution removed
+ * \param h [in/out] (Q12) impulse response of weighted synthesis filter, pitch sharpening is applied to it
+ * \param pitch_delay integer part of pitch delay
+ * \param pitch_sharp (Q14) pitch sharpening of the previous subframe
+ * \param fc [out] (Q13) fixed-codebook vector
+ * \param y2 [out] (Q12) filtered fixed-codebook vector
+ * \param fc_index [out] fixed codebook index
+ * \param pulses_signs [out] signs of pulses
+ * \param subframe_size length of subframe
+ *
+ * Pulses are searched in pairs: two tracks of the first pair are chosen first,
+ * then two remaining pulses are found for it. Search is done with the first
+ * pair on tracks 2 and 3/4, then on tracks 3/4 and 0, for both track 3 and 4.
+ */
+static void g729a_acelp_search(const int16_t* x, int16_t* h, int pitch_delay, int16_t pitch_sharp,
+                               int16_t* fc, int16_t* y2, int* fc_index, int* pulses_signs, int subframe_size)
+{
+    int16_t hs[MAX_SUBFRAME_SIZE], d[MAX_SUBFRAME_SIZE], sign[MAX_SUBFRAME_SIZE];
+    int16_t phi[MAX_SUBFRAME_SIZE][MAX_SUBFRAME_SIZE]; // correlations of impulse response
+    int16_t sharp = shl16(pitch_sharp, 1), ps, alp, sq, psk = -1, alpk = 1;
+    int best[4] = {0, 1, 2, 3};
+    int i, j, n, track, acc, p[4];
+
+    if(pitch_delay < subframe_size)
+        for(n=pitch_delay; n<subframe_size; n++)
+            h[n] = add16(h[n], mult16(h[n - pitch_delay], sharp));
+
+    /* 3.8.1, Equation 48 */
+    g729_backward_filter(h, x, d, subframe_size);
+
+    /* 3.8.1, Equation 49, impulse response is scaled for precision */
+    acc = g729_dot_product(h, h, subframe_size, 0, NULL);
+    if(acc >> 16 > 32000)
+        for(n=0; n<subframe_size; n++)
+            hs[n] = h[n] >> 1;
+    else
+        for(n=0; n<subframe_size; n++)
+            hs[n] = shl16(h[n], norm32(acc) >> 1);
+
+    for(i=0; i<subframe_size; i++)
+        for(j=i; j<subframe_size; j++)
+        {
+            acc = g729_dot_product(hs, hs + j - i, subframe_size - j, 0, NULL);
+            phi[i][j] = phi[j][i] = acc >> 16;
+        }
+
+    /* signs of pulses are fixed by signs of correlation */
+    for(n=0; n<subframe_size; n++)
+    {
+        sign[n] = d[n] >= 0 ? 1 : -1;
+        if(d[n] < 0)
+            d[n] = negate16(d[n]);
+    }
+    for(i=0; i<subframe_size; i++)
+        for(j=0; j<subframe_size; j++)
+            if(i != j)
+                phi[i][j] = mult16(phi[i][j], sign[i] == sign[j] ? INT16_MAX : INT16_MIN);
+
+    for(track=3; track<5; track++)
+    {
+        /* first pair on tracks 2 and 3/4, second one on tracks 0 and 1 */
+        g729a_acelp_pair_first(d, phi, 2, track, subframe_size, &p[2], &p[3], &ps, &alp);
+        g729a_acelp_pair_second(d, phi, 0, 1, subframe_size, p[2], p[3], ps, alp, &p[0], &p[1], &sq, &alp);
+        if(l_msu(l_mult(alpk, sq), psk, alp) > 0)
+        {
+            psk = sq;
+            alpk = alp;
+            memcpy(best, p, sizeof(best));
+        }
+
+        /* first pair on tracks 3/4 and 0, second one on tracks 1 and 2 */
+        g729a_acelp_pair_first(d, phi, track, 0, subframe_size, &p[3], &p[0], &ps, &alp);
+        g729a_acelp_pair_second(d, phi, 1, 2, subframe_size, p[3], p[0], ps, alp, &p[1], &p[2], &sq, &alp);
+        if(l_msu(l_mult(alpk, sq), psk, alp) > 0)
+        {
+            psk = sq;
+            alpk = alp;
+            memcpy(best, p, sizeof(best));
+        }
+    }
+
+    memset(fc, 0, subframe_size * sizeof(int16_t));
+    memset(y2, 0, subframe_size * sizeof(int16_t));
+    *pulses_signs = 0;
+    for(i=0; i<4; i++)
+    {
+        n = best[i];
+        fc[n] = sign[n] > 0 ? 8191 : -8192;
+        for(j=n; j<subframe_size; j++)
+            y2[j] = sign[n] > 0 ? add16(y2[j], h[j-n]) : sub16(y2[j], h[j-n]);
+        if(sign[n] > 0)
+            *pulses_signs |= 1 << i;
+    }
+
+    /* reverted g729_decode_fc_vector */
+    *fc_index = (best[0] / 5) | (best[1] / 5) << 3 | (best[2] / 5) << 6 |
+                (((best[3] / 5) << 1) | (best[3] % 5 == 4)) << 9;
+
+    if(pitch_delay < subframe_size)
+        for(n=pitch_delay; n<subframe_size; n++)
+            fc[n] = add16(fc[n], mult16(fc[n - pitch_delay], sharp));
+}
+
+/**
+ * \brief correlations of target, filtered adaptive- and fixed-codebook vectors (3.9.2)
+ * \param x target signal
+ * \param y1 filtered adaptive-codebook vector
+ * \param y2 (Q12) filtered fixed-codebook vector
+ * \param g_coeff [out] mantissas of <y2,y2>, -2<x,y2>, 2<y1,y2> (stored into g_coeff[2..4])
+ * \param exp_coeff [out] their exponents
+ * \param length subframe length
+ */
+static void g729_gain_correlations(const int16_t* x, const int16_t* y1, const int16_t* y2,
+                                   int16_t* g_coeff, int16_t* exp_coeff, int length)
+{
+    int16_t y2_scaled[MAX_SUBFRAME_SIZE]; // Q9
+    int n, sum, shift;
+
+    for(n=0; n<length; n++)
+        y2_scaled[n] = y2[n] >> 3;
+
+    sum = g729_dot_product(y2_scaled, y2_scaled, length, 1, NULL);
+    shift = norm32(sum);
+    g_coeff[2] = round16(l_shl(sum, shift));
+    exp_coeff[2] = shift + 19 - 16;
+
+    sum = g729_dot_product(x, y2_scaled, length, 1, NULL);
+    shift = norm32(sum);
+    g_coeff[3] = negate16(round16(l_shl(sum, shift)));
+    exp_coeff[3] = shift + 10 - 16 - 1;
+
+    sum = g729_dot_product(y1, y2_scaled, length, 1, NULL);
+    shift = norm32(sum);
+    g_coeff[4] = round16(l_shl(sum, shift));
+    exp_coeff[4] = shift + 10 - 16 - 1;
+}
+
+/**
+ * \brief predicted gain of fixed-codebook vector (3.9.1)
+ * \param fc (Q13) fixed-codebook vector
+ * \param pred_energ_q (Q10) past quantized energies
+ * \param gain [out] predicted gain, mantissa
+ * \param exp [out] predicted gain, exponent (gain is Q[exp])
+ * \param length subframe length
+ */
+static void g729_gain_predict(const int16_t* fc, const int16_t* pred_energ_q, int16_t* gain, int16_t* exp, int length)
+{
+    int16_t e, frac;
+    int i, acc;
+
+    /* 3.9.1, Equation 66 and 69: 127.298 - 3.0103 * log2(energy) */
+    log2_q15(g729_dot_product(fc, fc, length, 0, NULL), &e, &frac);
+    acc = mpy_32_16(e, frac, -24660);  // -3.0103 in Q13
+    acc = l_mac(acc, 32588, 32);       // 127.298 in Q14
+
+    /* 3.9.1, Equation 70 */
+    acc = l_shl(acc, 10);
+    for(i=0; i<4; i++)
+        acc = l_mac(acc, ma_prediction_coeff[i], pred_energ_q[i]);
+
+    /* 3.9.1, Equation 71: 10^(x/20) = 2^(0.166*x) */
+    acc = l_shr(l_mult(acc >> 16, 5439), 8);
+    l_extract(acc, &e, &frac);
+    *gain = pow2_q15(14, frac);
+    *exp = 14 - e;
+}
+
+/**
+ * \brief updates past quantized energies (3.9.1, Equation 72)
+ * \param pred_energ_q [in/out] (Q10) past quantized energies
+ * \param cb_sum (Q13) sum of gain code factors from both codebooks
+ */
+static void g729_gain_update(int16_t* pred_energ_q, int cb_sum)
+{
+    int16_t exp, frac;
+
+    memmove(pred_energ_q + 1, pred_energ_q, 3 * sizeof(int16_t));
+    log2_q15(cb_sum, &exp, &frac);
+    pred_energ_q[0] = mult16(l_shl(l_comp(exp - 13, frac), 13) >> 16, 24660); // 20*log10(2) in Q12
+}
+
+/**
+ * \brief a - b of two products with separate exponents, result is normalized
+ * \param exp [out] exponent of result
+ */
+static int16_t g729_gain_term(int a, int exp_a, int b, int exp_b, int* exp)
+{
+    int acc, shift;
+
+    if(exp_a > exp_b)
+    {
+        acc = l_sub(l_shr(a, exp_a - exp_b + 1), l_shr(b, 1));
+        *exp = exp_b - 1;
+    }
+    else
+    {
+        acc = l_sub(l_shr(a, 1), l_shr(b, exp_b - exp_a + 1));
+        *exp = exp_a - 1;
+    }
+    shift = norm32(acc);
+    *exp += shift - 16;
+    return l_shl(acc, shift) >> 16;
+}
+
+/**
+ * \brief preselection of gain codebooks' candidates (3.9.2)
+ * \param best_gain (Q9, Q2) optimal gain pitch and gain code
+ * \param gcode0 (Q4) predicted gain code
+ * \param cand1 [out] first candidate of GA codebook (in ga_cb_order)
+ * \param cand2 [out] first candidate of GB codebook (in gb_cb_order)
+ */
+static void g729_gain_preselect(const int16_t* best_gain, int16_t gcode0, int* cand1, int* cand2)
+{
+    int16_t tmp;
+    int acc, cfbg, x, y;
+
+    /* x = (best_gain[1] - (coef[0][0]*best_gain[0] + coef[1][1])*gcode0) * inv_coef */
+    cfbg = l_mult(gain_presel_coef[0][0], best_gain[0]); // Q20
+    acc = l_add(cfbg, l_shr(gain_presel_coef32[1][1], 15));
+    acc = l_sub(l_shl(best_gain[1], 7), l_mult(acc >> 16, gcode0));
+    x = l_mult(l_shl(acc, 2) >> 16, GAIN_PRESEL_INV_COEF); // Q15
+
+    /* y = (coef[1][0]*(best_gain[0]*coef[0][0] - coef[0][1])*gcode0 - coef[0][0]*best_gain[1]) * inv_coef */
+    acc = l_sub(cfbg, l_shr(gain_presel_coef32[0][1], 10));
+    tmp = mult16(acc >> 16, gcode0);
+    acc = l_sub(l_mult(tmp, gain_presel_coef[1][0]), l_shr(l_mult(gain_presel_coef[0][0], best_gain[1]), 3));
+    y = l_mult(l_shl(acc, 2) >> 16, GAIN_PRESEL_INV_COEF); // Q16
+
+    *cand1 = *cand2 = 0;
+    if(gcode0 > 0)
+    {
+        while(*cand1 < GA_CB_SIZE - GA_CB_CANDIDATES && y > l_shr(l_mult(ga_cb_threshold[*cand1], gcode0), 3))
+            (*cand1)++;
+        while(*cand2 < GB_CB_SIZE - GB_CB_CANDIDATES && x > l_shr(l_mult(gb_cb_threshold[*cand2], gcode0), 5))
+            (*cand2)++;
+    }
+    else
+    {
+        while(*cand1 < GA_CB_SIZE - GA_CB_CANDIDATES && y < l_shr(l_mult(ga_cb_threshold[*cand1], gcode0), 3))
+            (*cand1)++;
+        while(*cand2 < GB_CB_SIZE - GB_CB_CANDIDATES && x < l_shr(l_mult(gb_cb_threshold[*cand2], gcode0), 5))
+            (*cand2)++;
+    }
+}
+
+/**
+ * \brief quantization of adaptive and fixed codebook gains (3.9.2)
+ * \param ctx private data structure
+ * \param fc (Q13) fixed-codebook vector
+ * \param g_coeff mantissas of <y1,y1>, -2<x,y1>, <y2,y2>, -2<x,y2>, 2<y1,y2>
+ * \param exp_coeff their exponents
+ * \param tamed 1 if gain pitch should be limited (3.8)
+ * \param gain_pitch [out] (Q14) quantized gain pitch
+ * \param gain_code [out] (Q1) quantized gain code
+ * \param ga_cb_index [out] GA codebook index
+ * \param gb_cb_index [out] GB codebook index
+ *
+ * Optimal gains select four GA and eight GB candidates, the pair with minimal
+ * error of Equation 73 is searched among them.
+ */
+static void g729a_gain_quantize(G729A_Context* ctx, const int16_t* fc, const int16_t* g_coeff, const int16_t* exp_coeff,
+                                int tamed, int16_t* gain_pitch, int16_t* gain_code, uint8_t* ga_cb_index, uint8_t* gb_cb_index)
+{
+    int16_t gcode0, exp_gcode0, gcode0_q4, denom, inv_denom, nume, best_gain[2];
+    int16_t coeff[5], coeff_lo[5], g_pitch, g_code, tmp;
+    int exp_min[5], exp, exp_denom, exp_inv_denom, exp_nume, e_min;
+    int acc, dist, dist_min, shift, ga, gb, cand1, cand2, i, j;
+    int index1, index2;
+
+    g729_gain_predict(fc, ctx->pred_energ_q, &gcode0, &exp_gcode0, ctx->subframe_size);
+
+    /* optimal gains (Equation 73 derivatives), 1/(4*c0*c2 - c4*c4) */
+    exp = exp_coeff[0] + exp_coeff[2] - 1;
+    i = 2 * exp_coeff[4] + 1;
+    if(exp > i)
+    {
+        acc = l_sub(l_shr(l_mult(g_coeff[0], g_coeff[2]), exp - i), l_mult(g_coeff[4], g_coeff[4]));
+        exp = i;
+    }
+    else
+        acc = l_sub(l_mult(g_coeff[0], g_coeff[2]), l_shr(l_mult(g_coeff[4], g_coeff[4]), i - exp));
+    shift = norm32(acc);
+    denom = l_shl(acc, shift) >> 16;
+    exp_denom = exp + shift - 16;
+    inv_denom = negate16(div16(16384, denom));
+    exp_inv_denom = 14 + 15 - exp_denom;
+
+    /* gain pitch: (2*c1*c2 - c3*c4) / denom */
+    nume = g729_gain_term(l_mult(g_coeff[1], g_coeff[2]), exp_coeff[1] + exp_coeff[2],
+                          l_mult(g_coeff[3], g_coeff[4]), exp_coeff[3] + exp_coeff[4] + 1, &exp_nume);
+    best_gain[0] = l_shr(l_mult(nume, inv_denom), exp_nume + exp_inv_denom - (9 + 16 - 1)) >> 16;
+    if(tamed)
+        best_gain[0] = FFMIN(best_gain[0], GAIN_PITCH_TAMED_BEST);
+
+    /* gain code: (2*c0*c3 - c1*c4) / denom */
+    nume = g729_gain_term(l_mult(g_coeff[0], g_coeff[3]), exp_coeff[0] + exp_coeff[3] + 1,
+                          l_mult(g_coeff[1], g_coeff[4]), exp_coeff[1] + exp_coeff[4] + 1, &exp_nume);
+    best_gain[1] = l_shr(l_mult(nume, inv_denom), exp_nume + exp_inv_denom - (2 + 16 - 1)) >> 16;
+
+    if(exp_gcode0 >= 4)
+        gcode0_q4 = shr16(gcode0, exp_gcode0 - 4);
+    else
+        gcode0_q4 = l_shl(gcode0, 4 + 16 - exp_gcode0) >> 16;
+
+    g729_gain_preselect(best_gain, gcode0_q4, &cand1, &cand2);
+
+    /* coefficients of Equation 73 are aligned to the same exponent */
+    exp_min[0] = exp_coeff[0] + 13;
+    exp_min[1] = exp_coeff[1] + 14;
+    exp_min[2] = exp_coeff[2] + 2 * exp_gcode0 - 21;
+    exp_min[3] = exp_coeff[3] + exp_gcode0 - 3;
+    exp_min[4] = exp_coeff[4] + exp_gcode0 - 4;
+    e_min = exp_min[0];
+    for(i=1; i<5; i++)
+        e_min = FFMIN(e_min, exp_min[i]);
+    for(i=0; i<5; i++)
+        l_extract(l_shr(g_coeff[i] << 16, exp_min[i] - e_min), &coeff[i], &coeff_lo[i]);
+
+    dist_min = INT_MAX;
+    index1 = cand1;
+    index2 = cand2;
+    for(i=cand1; i<cand1+GA_CB_CANDIDATES; i++)
+        for(j=cand2; j<cand2+GB_CB_CANDIDATES; j++)
+        {
+            ga = ga_cb_order[i];
+            gb = gb_cb_order[j];
+            g_pitch = add16(cb_GA[ga][0], cb_GB[gb][0]);
+            if(tamed && g_pitch >= GAIN_PITCH_TAMED_CB)
+                continue;
+
+            tmp = (cb_GA[ga][1] + cb_GB[gb][1]) >> 1; // Q12
+            g_code = mult16(gcode0, tmp);
+
+            dist = mpy_32_16(coeff[0], coeff_lo[0], mult16(g_pitch, g_pitch));
+            dist = l_add(dist, mpy_32_16(coeff[1], coeff_lo[1], g_pitch));
+            dist = l_add(dist, mpy_32_16(coeff[2], coeff_lo[2], mult16(g_code, g_code)));
+            dist = l_add(dist, mpy_32_16(coeff[3], coeff_lo[3], g_code));
+            dist = l_add(dist, mpy_32_16(coeff[4], coeff_lo[4], mult16(g_code, g_pitch)));
+            if(dist < dist_min)
+            {
+                dist_min = dist;
+                index1 = i;
+                index2 = j;
+            }
+        }
+
+    ga = ga_cb_order[index1];
+    gb = gb_cb_order[index2];
+    *ga_cb_index = ga;
+    *gb_cb_index = gb;
+
+    *gain_pitch = add16(cb_GA[ga][0], cb_GB[gb][0]);
+    acc = l_mult((cb_GA[ga][1] + cb_GB[gb][1]) >> 1, gcode0);
+    *gain_code = l_shl(acc, 4 - exp_gcode0) >> 16;
+
+    g729_gain_update(ctx->pred_energ_q, cb_GA[ga][1] + cb_GB[gb][1]);
+}
+
+/**
+ * \brief encode one frame of PCM samples into parameters vector
+ * \param ctx private data structure
+ * \param in 2 * subframe_size PCM samples
+ * \param parm [out] parameters of the codec
+ */
+static void g729a_encode_frame_internal(G729A_EncoderContext* ctx, const int16_t* in, G729_parameters* parm)
+{
+    G729A_Context *dec = &ctx->dec;
+    int subframe_size = dec->subframe_size;
+    int frame_size = 2 * subframe_size;
+    int16_t *speech = ctx->speech_base + LP_WINDOW_SIZE - frame_size - LOOKAHEAD_SIZE;
+    int16_t *wsp = ctx->wsp_base + PITCH_MAX;
+    int16_t *exc;
+    int16_t r_hi[11], r_lo[11];
+    int16_t lp[10], lp_q[20], lpw[20], lpt[10]; // Q12
+    int16_t lsp[10], lsp_q[10]; // Q15
+    int16_t lsf[10], lsf_q[10]; // Q13
+    int16_t h[MAX_SUBFRAME_SIZE], x[MAX_SUBFRAME_SIZE], x2[MAX_SUBFRAME_SIZE], fc[MAX_SUBFRAME_SIZE];
+    int16_t y1[MAX_SUBFRAME_SIZE], y2[MAX_SUBFRAME_SIZE], zero[10] = {0};
+    int16_t g_coeff[5], exp_coeff[5], gains[4], gain_pitch, gain_code;
+    int ol_pitch, t_min, t_max, pitch_delay_int, pitch_delay_frac, pulses_signs, tamed;
+    int i, n;
+
+    memmove(ctx->speech_base, ctx->speech_base + frame_size, (LP_WINDOW_SIZE - frame_size) * sizeof(int16_t));
+    memcpy(ctx->speech_base + LP_WINDOW_SIZE - frame_size, in, frame_size * sizeof(int16_t));
+    g729_pre_process(ctx, ctx->speech_base + LP_WINDOW_SIZE - frame_size, frame_size);
+
+    /* LP analysis (3.2.1 - 3.2.3) */
+    g729_autocorrelation(ctx->speech_base, r_hi, r_lo);
+    g729_levinson(r_hi, r_lo, ctx->lp_prev, lp);
+    g729_lp2lsp(lp, ctx->lsp_prev, lsp);
+    memcpy(ctx->lsp_prev, lsp, sizeof(lsp));
+
+    /* LSP quantization (3.2.4) and interpolation (3.2.5) */
+    g729_lsp2lsf(lsp, lsf);
+    g729_lsf_quantize(dec, lsf, lsf_q, parm);
+    g729_lsf2lsp(lsf_q, lsp_q);
+    g729_lp_decode(lsp_q, dec->lsp_prev, lp_q);
+
+    /* LP residual (stored in excitation buffer) and weighted speech (A.3.3) */
+    for(i=0; i<2; i++)
+    {
+        g729_weight_lp(lp_q + i*10, GAMMA_W, lpw + i*10);
+        g729_residual_filter(lp_q + i*10, speech + i*subframe_size, dec->exc + i*subframe_size, subframe_size);
+
+        for(n=0; n<10; n++)
+            lpt[n] = sub16(lpw[i*10+n], mult16(n ? lpw[i*10+n-1] : 4096, GAMMA_WSP));
+        g729_synthesis_filter(lpt, dec->exc + i*subframe_size, wsp + i*subframe_size,
+                ctx->wsp_filter_data, subframe_size, 1);
+    }
+
+    ol_pitch = g729a_open_loop_pitch(wsp, frame_size);
+
+    t_min = av_clip(ol_pitch - 3, PITCH_MIN, PITCH_MAX - 6);
+    t_max = t_min + 6;
+
+    for(i=0; i<2; i++)
+    {
+        exc = dec->exc + i*subframe_size;
+
+        /* impulse response of weighted synthesis filter */
+        memset(x2, 0, subframe_size * sizeof(int16_t));
+        x2[0] = 4096;
+        g729_synthesis_filter(lpw + i*10, x2, h, zero, subframe_size, 0);
+
+        /* target signal (3.6) */
+        g729_synthesis_filter(lpw + i*10, exc, x, ctx->err_filter_data, subframe_size, 0);
+
+        /* adaptive-codebook search (A.3.7) */
+        pitch_delay_int = g729a_pitch_search(exc, x, h, t_min, t_max, i ? PITCH_MAX : 84,
+                &pitch_delay_frac, subframe_size);
+
+        /* reverted 4.1.3 */
+        if(!i)
+        {
+            if(pitch_delay_int <= 85)
+                parm->ac_index[i] = 3 * (pitch_delay_int - 19) + pitch_delay_frac - 1;
+            else
+                parm->ac_index[i] = pitch_delay_int + 112;
+
+            t_min = av_clip(pitch_delay_int - 5, PITCH_MIN, PITCH_MAX - 9);
+            t_max = t_min + 9;
+        }
+        else
+            parm->ac_index[i] = 3 * (pitch_delay_int - t_min) + pitch_delay_frac + 2;
+
+        /* adaptive-codebook gain (3.7.3) */
+        g729_synthesis_filter(lpw + i*10, exc, y1, zero, subframe_size, 0);
+        gain_pitch = g729_pitch_gain(x, y1, gains, subframe_size);
+
+        tamed = g729_taming_needed(ctx->exc_err, pitch_delay_int, pitch_delay_frac, subframe_size);
+        if(tamed)
+            gain_pitch = FFMIN(gain_pitch, GAIN_PITCH_TAMED);
+
+        /* fixed-codebook search (A.3.8) */
+        for(n=0; n<subframe_size; n++)
+            x2[n] = sub16(x[n], l_shl(l_mult(y1[n], gain_pitch), 1) >> 16);
+        g729a_acelp_search(x2, h, pitch_delay_int, dec->pitch_sharp, fc, y2,
+                &parm->fc_indexes[i], &pulses_signs, subframe_size);
+        parm->pulses_signs[i] = pulses_signs;
+
+        /* gains quantization (3.9.2) */
+        g_coeff[0]   = gains[0];
+        exp_coeff[0] = -gains[1];
+        g_coeff[1]   = negate16(gains[2]);
+        exp_coeff[1] = -(gains[3] + 1);
+        g729_gain_correlations(x, y1, y2, g_coeff, exp_coeff, subframe_size);
+        g729a_gain_quantize(dec, fc, g_coeff, exp_coeff, tamed, &gain_pitch, &gain_code,
+                &parm->ga_cb_index[i], &parm->gb_cb_index[i]);
+
+        dec->pitch_sharp = av_clip(gain_pitch, SHARP_MIN, SHARP_MAX);
+
+        /* excitation and memory update (3.10) */
+        for(n=0; n<subframe_size; n++)
+            exc[n] = round16(l_shl(l_mac(l_mult(exc[n], gain_pitch), fc[n], gain_code), 1));
+
+        for(n=0; n<10; n++)
+        {
+            int j = subframe_size - 10 + n;
+            ctx->err_filter_data[n] = sub16(x[j], add16(l_shl(l_mult(y1[j], gain_pitch), 1) >> 16,
+                                                        l_shl(l_mult(y2[j], gain_code), 2) >> 16));
+        }
+        g729_taming_update(ctx->exc_err, gain_pitch, pitch_delay_int, subframe_size);
+    }
+
+    /* 3.7.2 */
+    parm->parity = !g729_parity_check(parm->ac_index[0], 0);
+
+    //Save signal for using in next frame
+    memmove(dec->exc_base, dec->exc_base + frame_size, (PITCH_MAX+INTERPOL_LEN)*sizeof(int16_t));
+    memmove(ctx->wsp_base, ctx->wsp_base + frame_size, PITCH_MAX*sizeof(int16_t));
+}
+
+/**
+ * \brief encodes parameters vector into one G.729 frame (10 bytes long)
+ * \param ctx private data structure
+ * \param parm parameters of the codec
+ * \param buf [out] output buffer
+ * \param buf_size size of output buffer
+ */
+static void g729_parm2bytes(const G729A_Context *ctx, const G729_parameters *parm, uint8_t *buf, int buf_size)
+{
+    PutBitContext pb;
+
+    init_put_bits(&pb, buf, buf_size);
+
+    put_bits(&pb, L0_BITS,        parm->ma_predictor);     //L0
+    put_bits(&pb, L1_BITS,        parm->quantizer_1st);    //L1
+    put_bits(&pb, L2_BITS,        parm->quantizer_2nd_lo); //L2
+    put_bits(&pb, L3_BITS,        parm->quantizer_2nd_hi); //L3
+
+    put_bits(&pb, P1_BITS,        parm->ac_index[0]);      //P1
+    put_bits(&pb, P0_BITS,        parm->parity);           //P0 (parity)
+    put_bits(&pb, FC_BITS(ctx),   parm->fc_indexes[0]);    //C1
+    put_bits(&pb, FC_PULSE_COUNT, parm->pulses_signs[0]);  //S1
+    put_bits(&pb, GA_BITS,        parm->ga_cb_index[0]);   //GA1
+    put_bits(&pb, GB_BITS,        parm->gb_cb_index[0]);   //GB1
+
+    put_bits(&pb, P2_BITS,        parm->ac_index[1]);      //P2
+    put_bits(&pb, FC_BITS(ctx),   parm->fc_indexes[1]);    //C2
+    put_bits(&pb, FC_PULSE_COUNT, parm->pulses_signs[1]);  //S2
+    put_bits(&pb, GA_BITS,        parm->ga_cb_index[1]);   //GA2
+    put_bits(&pb, GB_BITS,        parm->gb_cb_index[1]);   //GB2
+
+    flush_put_bits(&pb);
+}
+
+/**
+ * \brief G.729A encoder initialization
+ * \param avctx private data structure
+ * \return 0 if success, non-zero otherwise
+ */
+static int ff_g729a_encoder_init(AVCodecContext * avctx)
+{
+    G729A_EncoderContext* ctx=avctx->priv_data;
+    int i, ret;
+
+    if((ret = g729a_context_init(avctx, &ctx->dec)))
+        return ret;
+
+    if(ctx->dec.format)
+    {
+        av_log(avctx, AV_LOG_ERROR, "Sample rate %d is not supported by encoder\n", avctx->sample_rate);
+        return AVERROR_NOFMT;
+    }
+
+    for(i=0; i<10; i++)
+        ctx->lsp_prev[i] = lsp_init[i];
+
+    for(i=0; i<4; i++)
+        ctx->exc_err[i] = 0x4000; // 1.0 in Q14
+
+    return 0;
+}
+
+static int ff_g729a_encode_frame(AVCodecContext *avctx,
+                                 uint8_t *buf, int buf_size, void *data)
+{
+    G729_parameters parm;
+    G729A_EncoderContext *ctx=avctx->priv_data;
+    int out_frame_size = formats[ctx->dec.format].input_frame_size;
+
+    if (buf_size<out_frame_size)
+        return AVERROR(EIO);
+
+    g729a_encode_frame_internal(ctx, data, &parm);
+    g729_parm2bytes(&ctx->dec, &parm, buf, out_frame_size);
+
+    return out_frame_size;
+}
+
+AVCodec g729a_encoder =
+{
+    "g729a",
+    CODEC_TYPE_AUDIO,
+    CODEC_ID_G729A,
+    sizeof(G729A_EncoderContext),
+    ff_g729a_encoder_init,
+    ff_g729a_encode_frame,
+    NULL,
+    NULL,
+};
+
+#ifdef G729A_NATIVE
+/* debugging  stubs */
+void* g729a_decoder_init()
+{
+    AVCodecContext *avctx=av_mallocz(sizeof(AVCodecContext));
+    avctx->priv_data=av_mallocz(sizeof(G729A_Context));
+    avctx->sample_rate=8000;
+    avctx->channels=1;
+    ff_g729a_decoder_init(avctx);
+    return avctx;
+}
+int g729a_decoder_uninit(void* ctx)
+{
+    AVCodecContext *avctx=ctx;
+
+    av_free(avctx->priv_data);
+    av_free(avctx);
+    return 0;
+}
+/**
+ * \brief packs ITU serial frame (sync word, size, one word per bit) into 10 bytes
+ *
+ * \return 1 if frame is marked as erased (zero bit word, same as in reference decoder), 0 - otherwise
+ */
+static int g729_serial2bytes(const int16_t *serial, uint8_t *buf)
+{
+    int i, j, erased = 0;
+
+    serial += 2; // skip sync word and size
+    for(i=0; i<10; i++)
+    {
+        buf[i] = 0;
+        for(j=0; j<8; j++, serial++)
+        {
+            buf[i] = buf[i] << 1 | (*serial == 0x81);
+            erased |= !*serial;
+        }
+    }
+    return erased;
+}
+int  g729a_decode_frame(AVCodecContext* avctx, int16_t* serial, int serial_size, int16_t* out_frame, int out_frame_size)
+{
+    G729_parameters parm;
+    uint8_t buf[10];
+    int frame_erasure;
+
+    frame_erasure  = g729_serial2bytes(serial, buf);
+    frame_erasure |= g729_bytes2parm(avctx->priv_data, buf, sizeof(buf), &parm);
+
+    return g729a_decode_frame_internal(avctx->priv_data, out_frame, out_frame_size, &parm, frame_erasure);
+}
+int  g729a_decode_frames(void** ctx, int count, int16_t** serial, int serial_size, int16_t** out_frames, int out_frame_size)
+{
+    G729_parameters parm[BATCH_SIZE];
+    int frame_erasure[BATCH_SIZE];
+    G729A_Context *priv[BATCH_SIZE];
+    uint8_t buf[10];
+    int i, c;
+
+    for(i=0; i<count; i+=BATCH_SIZE)
+    {
+        for(c=0; c<FFMIN(count-i, BATCH_SIZE); c++)
+        {
+            priv[c] = ((AVCodecContext*)ctx[i+c])->priv_data;
+            frame_erasure[c]  = g729_serial2bytes(serial[i+c], buf);
+            frame_erasure[c] |= g729_bytes2parm(priv[c], buf, sizeof(buf), parm + c);
+        }
+        g729a_decode_frames_internal(priv, c, out_frames + i, parm, frame_erasure);
+    }
+
+    return 2 * sizeof(int16_t) * priv[0]->subframe_size;
+}
+int  g729a_decode_lost_frame(AVCodecContext* avctx, int16_t* out_frame, int out_frame_size)
+{
+    return g729a_conceal_frame(avctx->priv_data, out_frame, out_frame_size);
+}
+void* g729a_encoder_init()
+{
+    AVCodecContext *avctx=av_mallocz(sizeof(AVCodecContext));
+    avctx->priv_data=av_mallocz(sizeof(G729A_EncoderContext));
+    avctx->sample_rate=8000;
+    avctx->channels=1;
+    ff_g729a_encoder_init(avctx);
+    return avctx;
+}
+void g729a_encoder_uninit(void* ctx)
+{
+    AVCodecContext *avctx=ctx;
+
+    av_free(avctx->priv_data);
+    av_free(avctx);
+}
+int  g729a_encode_frame(AVCodecContext* avctx, int16_t* data, int data_size, int16_t* serial, int serial_size)
+{
+    G729A_EncoderContext *ctx=avctx->priv_data;
+    G729_parameters parm;
+
+    g729a_encode_frame_internal(ctx, data, &parm);
+    g729_parm2bytes(&ctx->dec, &parm, (uint8_t*)serial, 80);
+
+    return 82;
+}
+#endif /* G729A_NATIVE */
+
+#if defined(G729A_NATIVE) && defined(TEST)
+/*
+  DSP routines test.
+
+  Compares optimized DSP routines with reference ones on random data and
+  checks that decoder output (including concealment of missing frames) does
+  not depend on selected routines. Decoded bitstreams are given in ITU serial
+  format (e.g. test vectors from ITU's G.729 Annex A package), random frames
+  are used when no file is given.
+  Encoder output is compared with bitstream of reference encoder when speech
+  of test vector is found next to it (X.IN for X.BIT), synthetic speech also
+  must survive encoding and decoding with reasonable SNR.
+
+  usage: test_dsp [file.bit ...]
+*/
+#define SERIAL_SIZE 82
+
+static uint32_t test_seed = 1;
+
+static int test_random(int range)
+{
+    test_seed = test_seed * 1664525 + 1013904223;
+    return (int)(test_seed >> 8) % range;
+}
+
+static void test_fill(int16_t *buf, int length, int range)
+{
+    int i;
+
+    for(i=0; i<length; i++)
+        buf[i] = test_random(2*range) - range;
+}
+
+static int test_kernels(int cpu_flags)
+{
+    int16_t lp[10], in[MAX_SUBFRAME_SIZE+16], ref[MAX_SUBFRAME_SIZE], out[MAX_SUBFRAME_SIZE];
+    int (*sum_of_squares_opt)(const int16_t*, int, int, int);
+    void (*residual_opt)(const int16_t*, const int16_t*, int16_t*, int);
+    int errors = 0;
+    int i, size, offset, shift;
+
+    g729_dsp_init(cpu_flags);
+    sum_of_squares_opt = g729_dsp.sum_of_squares;
+    residual_opt       = g729_dsp.residual;
+
+    for(i=0; i<10000; i++)
+    {
+        size   = test_random(MAX_SUBFRAME_SIZE+1);
+        offset = test_random(8);
+        shift  = test_random(5);
+
+        test_fill(in, MAX_SUBFRAME_SIZE+16, 4096);
+        if(sum_of_squares_c(in, size, offset, shift) != sum_of_squares_opt(in, size, offset, shift))
+            errors++;
+
+        // residual: coefficients and signal are limited to avoid 32-bit overflow in reference code
+        test_fill(lp, 10, 8192);
+        test_fill(in, MAX_SUBFRAME_SIZE+10, 16384);
+        memset(ref, 0, sizeof(ref));
+        memset(out, 0, sizeof(out));
+        residual_c(lp, in + 10, ref, size);
+        residual_opt(lp, in + 10, out, size);
+        if(memcmp(ref, out, sizeof(ref)))
+            errors++;
+    }
+    return errors;
+}
+
+#define TEST_LOSS_PERIOD 50 // every 50th frame is decoded as missing one
+
+static int test_decode(int cpu_flags, const int16_t *serial, int frames)
+{
+    AVCodecContext *ref_ctx = g729a_decoder_init();
+    AVCodecContext *opt_ctx = g729a_decoder_init();
+    int16_t ref[80], out[80];
+    int errors = 0;
+    int i;
+
+    for(i=0; i<frames; i++)
+    {
+        if(i % TEST_LOSS_PERIOD == TEST_LOSS_PERIOD - 1)
+        {
+            g729_dsp_init(0);
+            g729a_decode_lost_frame(ref_ctx, ref, 80);
+            g729_dsp_init(cpu_flags);
+            g729a_decode_lost_frame(opt_ctx, out, 80);
+        }
+        else
+        {
+            g729_dsp_init(0);
+            g729a_decode_frame(ref_ctx, (int16_t*)serial + i*SERIAL_SIZE, SERIAL_SIZE, ref, 80);
+            g729_dsp_init(cpu_flags);
+            g729a_decode_frame(opt_ctx, (int16_t*)serial + i*SERIAL_SIZE, SERIAL_SIZE, out, 80);
+        }
+        if(memcmp(ref, out, sizeof(ref)))
+            errors++;
+    }
+
+    g729a_decoder_uninit(ref_ctx);
+    g729a_decoder_uninit(opt_ctx);
+    return errors;
+}
+
+#define ENCODE_FRAMES 500
+#define ENCODE_MIN_SNR 5.0 // dB
+
+/**
+ * synthetic voiced speech: pulse train with slowly changing pitch
+ * filtered by three formant resonators
+ */
+static void test_speech(int16_t *speech, int length)
+{
+    static const double formant[3] = {700, 1200, 2500};
+    double y[3][3] = {{0}};
+    double phase = 0, v;
+    int n, i;
+
+    for(n=0; n<length; n++)
+    {
+        phase += (110 + 50 * sin(2 * M_PI * n / 16000)) / 8000;
+        v = phase >= 1;
+        phase -= v;
+        for(i=0; i<3; i++)
+        {
+            v += 2 * 0.95 * cos(2 * M_PI * formant[i] / 8000) * y[i][1] - 0.95 * 0.95 * y[i][2];
+            y[i][2] = y[i][1];
+            y[i][1] = v;
+        }
+        speech[n] = av_clip_int16(lrint(v * 60 * (0.5 + 0.5 * sin(2 * M_PI * n / 6000))));
+    }
+}
+
+static void test_encode(double *snr)
+{
+    static int16_t in[ENCODE_FRAMES*80], out[ENCODE_FRAMES*80];
+    AVCodecContext *enc_ctx = g729a_encoder_init();
+    AVCodecContext *dec_ctx = g729a_decoder_init();
+    int16_t serial[SERIAL_SIZE];
+    double signal = 0, noise = 0;
+    int i, n;
+
+    test_speech(in, ENCODE_FRAMES*80);
+
+    for(i=0; i<ENCODE_FRAMES; i++)
+    {
+        g729a_encode_frame(enc_ctx, in + i*80, 80, serial, SERIAL_SIZE);
+        g729a_decode_frame(dec_ctx, serial, SERIAL_SIZE, out + i*80, 80);
+    }
+
+    // encoder delays signal by LOOKAHEAD_SIZE samples
+    for(n=10*80; n<(ENCODE_FRAMES-1)*80; n++)
+    {
+        signal += in[n] * (double)in[n];
+        noise  += (in[n] - out[n + LOOKAHEAD_SIZE]) * (double)(in[n] - out[n + LOOKAHEAD_SIZE]);
+    }
+    *snr = 10 * log10(signal / (noise + 1));
+
+    g729a_encoder_uninit(enc_ctx);
+    g729a_decoder_uninit(dec_ctx);
+}
+
+/**
+ * reads whole file of 16-bit words
+ * \return number of read records of record_size words, -1 if file can not be opened
+ */
+static int test_load(const char *name, int record_size, int16_t **data)
+{
+    FILE *f;
+    int count;
+
+    if(!(f = fopen(name, "rb")))
+        return -1;
+    fseek(f, 0, SEEK_END);
+    count = ftell(f) / (record_size * sizeof(int16_t));
+    fseek(f, 0, SEEK_SET);
+    *data = malloc(count * record_size * sizeof(int16_t));
+    count = fread(*data, record_size * sizeof(int16_t), count, f);
+    fclose(f);
+    return count;
+}
+
+/**
+ * encodes speech of ITU test vector (X.IN next to X.BIT) and compares
+ * the result with bitstream of reference encoder
+ * \return number of mismatched frames, -1 if there is no input speech file
+ */
+static int test_encode_vector(const char *name, const int16_t *serial, int frames)
+{
+    AVCodecContext *ctx;
+    char in_name[1024];
+    int16_t *in, out[SERIAL_SIZE];
+    int i, count, errors = 0;
+    const char *ext = strrchr(name, '.');
+
+    if(!ext || strlen(name) >= sizeof(in_name))
+        return -1;
+    strcpy(in_name, name);
+    strcpy(in_name + (ext - name), ext[1] == 'b' ? ".in" : ".IN");
+
+    if((count = test_load(in_name, 80, &in)) < 0)
+        return -1;
+
+    ctx = g729a_encoder_init();
+    for(i=0; i<FFMIN(count, frames); i++)
+    {
+        g729a_encode_frame(ctx, in + i*80, 80, out, SERIAL_SIZE);
+        if(memcmp(out, serial + i*SERIAL_SIZE, sizeof(out)))
+            errors++;
+    }
+    g729a_encoder_uninit(ctx);
+    free(in);
+
+    return errors + (count != frames);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct
+    {
+        const char *name;
+        int flags;
+    } impl[] =
+    {
+#ifdef HAVE_X86_SIMD
+        { "sse2", G729_CPU_SSE2 },
+        { "avx2", G729_CPU_SSE2 | G729_CPU_AVX2 },
+#endif
+        { NULL, 0 }
+    };
+    int16_t *serial;
+    int frames, i, j, k, errors, total = 0;
+    double snr;
+
+    for(i=1; i<argc || i==1; i++)
+    {
+        if(argc > 1)
+        {
+            if((frames = test_load(argv[i], SERIAL_SIZE, &serial)) < 0)
+            {
+                printf("%s: can not open\n", argv[i]);
+                return 1;
+            }
+        }
+        else
+        {
+            frames = 1000;
+            serial = malloc(frames * SERIAL_SIZE * sizeof(int16_t));
+            for(j=0; j<frames*SERIAL_SIZE; j++)
+                serial[j] = j % SERIAL_SIZE == 0 ? 0x6b21 :
+                            j % SERIAL_SIZE == 1 ? 0x0050 : test_random(2) ? 0x81 : 0x7f;
+        }
+
+        for(k=0; impl[k].name; k++)
+        {
+#ifdef HAVE_X86_SIMD
+            if((g729_cpu_flags() & impl[k].flags) != impl[k].flags)
+            {
+                if(i == 1)
+                    printf("%s: not supported by CPU, skipped\n", impl[k].name);
+                continue;
+            }
+#endif
+            if(i == 1)
+            {
+                errors = test_kernels(impl[k].flags);
+                printf("%s: kernels %s\n", impl[k].name, errors ? "FAILED" : "OK");
+                total += errors;
+            }
+
+            errors = test_decode(impl[k].flags, serial, frames);
+            printf("%s: %s: %d frames, %s\n", impl[k].name, argc > 1 ? argv[i] : "random frames",
+                   frames, errors ? "FAILED" : "bit-exact");
+            total += errors;
+        }
+
+        if(argc > 1 && (errors = test_encode_vector(argv[i], serial, frames)) >= 0)
+        {
+            printf("%s: encoder: %s\n", argv[i], errors ? "FAILED" : "bit-exact");
+            total += errors;
+        }
+        free(serial);
+    }
+
+    test_encode(&snr);
+    printf("encoder: %d frames of synthetic speech, SNR %.1f dB\n", ENCODE_FRAMES, snr);
+    total += snr < ENCODE_MIN_SNR;
+
+    return total ? 1 : 0;
+}
+#endif /* G729A_NATIVE && TEST */
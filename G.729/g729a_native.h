@@ -1,12 +1,39 @@
 #ifndef H_G729_NATIVE_H
 #define H_G729_NATIVE_H
 
+#ifndef HAVE_PTHREADS
+#define HAVE_PTHREADS 1
+#endif
+
 #define av_free(ptr) if(ptr) free(ptr)
 #define av_mallocz(A) calloc(A,1)
 #define av_malloc(A) malloc(A)
 #define FFSWAP(type,a,b) do{type SWAP_tmp= b; b= a; a= SWAP_tmp;}while(0)
 #define FFMAX(a,b) ((a) > (b) ? (a) : (b))
 #define FFMIN(a,b) ((a) > (b) ? (b) : (a))
+#define FFABS(a) ((a) >= 0 ? (a) : (-(a)))
+
+static inline int av_clip(int a, int amin, int amax)
+{
+    if (a < amin)      return amin;
+    else if (a > amax) return amax;
+    else               return a;
+}
+
+static inline int16_t av_clip_int16(int a)
+{
+    if ((a+32768) & ~65535) return (a>>31) ^ 32767;
+    else                    return a;
+}
+
+static inline int av_log2(unsigned int v)
+{
+    int n = 0;
+
+    while(v >>= 1)
+        n++;
+    return n;
+}
 
 #define AVERROR(x) x
 
@@ -39,38 +66,38 @@ typedef struct{
                   const uint8_t *buf, int buf_size);
 }AVCodec;
 
+#define AV_RB16(x)  ((((uint8_t*)(x))[0] << 8) | ((uint8_t*)(x))[1])
+#define AV_RB32(x)  ((((uint8_t*)(x))[0] << 24) | \
+                     (((uint8_t*)(x))[1] << 16) | \
+                     (((uint8_t*)(x))[2] <<  8) | \
+                      ((uint8_t*)(x))[3])
+
 typedef struct {
   int16_t *buf;
   int idx;
   int buf_size;
-} GetBitContext;
+} PutBitContext;
 
-static int init_get_bits(GetBitContext* pgb, const unsigned char* buf, int buf_size)
+static void init_put_bits(PutBitContext* ppb, unsigned char* buf, int buf_size)
 {
-    pgb->buf=(uint16_t *)buf;
-    pgb->buf+=2;//skip syncwork and size
-    pgb->idx=0;
-    pgb->buf_size=buf_size;
-    return 0;
+    ppb->buf=(int16_t *)buf;
+    ppb->buf[0]=0x6b21;//syncword
+    ppb->buf[1]=0x0050;//size
+    ppb->buf+=2;
+    ppb->idx=0;
+    ppb->buf_size=buf_size;
 }
 
-static int get_bits1(GetBitContext* pgb)
+static void put_bits(PutBitContext* ppb, int n, unsigned int value)
 {
-    return 0;
+    int j;
+
+    for(j=n-1; j>=0 && ppb->idx < ppb->buf_size; j--)
+        ppb->buf[ppb->idx++] = (value >> j) & 1 ? 0x81 : 0x7f;
 }
 
-static int get_bits(GetBitContext* pgb, int n)
+static void flush_put_bits(PutBitContext* ppb)
 {
-    int j, tmp=0;
-
-    if(n>32 || pgb->idx+n >= pgb->buf_size) return 0;
-
-    for(j=0; j<n; j++)
-    {
-        tmp<<= 1;
-        tmp |= pgb->buf[pgb->idx++]==0x81?1:0;
-    }
-    return tmp;
 }
 
 static void dmp_d(char* name, float* arr, int size)